@@ -0,0 +1,65 @@
+/*
+* Client that replays a response from memory: no network is used, so the
+* benchmark measures only the time spent by the library on the device.
+* Every write() from MySQL gets the next response: first the authentication
+* OK, then the same result set again and again.
+*/
+
+#include <Client.h>
+
+class MemoryClient : public Client
+{
+public:
+  MemoryClient(const uint8_t *handshake, size_t handshakeLen, const uint8_t *result, size_t resultLen) :
+    handshake(handshake), handshakeLen(handshakeLen), result(result), resultLen(resultLen) {}
+
+  int connect(IPAddress, uint16_t) { return start(); }
+  int connect(const char *, uint16_t) { return start(); }
+  int connect(IPAddress, uint16_t, int32_t) { return start(); }
+  int connect(const char *, uint16_t, int32_t) { return start(); }
+
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t write(const uint8_t *, size_t size) {
+    // Authentication packet, then commands
+    static const uint8_t ok[] = {0x07, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00};
+    if (writes++ == 0)
+      setData(ok, sizeof(ok));
+    else
+      setData(result, resultLen);
+    return size;
+  }
+  int available() { return len - pos; }
+  int read() { return pos < len ? data[pos++] : -1; }
+  int read(uint8_t *buf, size_t size) {
+    if (pos == len)
+      return -1;
+    if (size > len - pos)
+      size = len - pos;
+    memcpy(buf, data + pos, size);
+    pos += size;
+    return size;
+  }
+  int peek() { return pos < len ? data[pos] : -1; }
+  void flush() {}
+  void stop() { open = false; }
+  uint8_t connected() { return open; }
+  operator bool() { return open; }
+
+private:
+  const uint8_t *handshake, *result, *data = nullptr;
+  size_t handshakeLen, resultLen, len = 0, pos = 0;
+  uint32_t writes = 0;
+  bool open = false;
+
+  int start() {
+    open = true;
+    writes = 0;
+    setData(handshake, handshakeLen);
+    return 1;
+  }
+  void setData(const uint8_t *buf, size_t size) {
+    data = buf;
+    len = size;
+    pos = 0;
+  }
+};
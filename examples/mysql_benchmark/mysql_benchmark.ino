@@ -0,0 +1,167 @@
+/*
+* Measure the time spent by the library to decode result sets on the device.
+* Responses are replayed from RAM (see MemoryClient.h), so neither WiFi
+* nor a server are needed. Same synthetic result sets of extras/host/mysql_bench.
+*/
+
+#include <MySQL.h>
+#include "MemoryClient.h"
+
+#define MAX_RESULT_SIZE (96 * 1024)
+
+uint8_t handshake[128];
+size_t handshakeLen = 0;
+uint8_t *result = nullptr;
+size_t resultLen = 0;
+
+
+// Append a packet header to buffer and return the payload position
+uint8_t *beginPacket(uint8_t *buf, size_t &len, uint8_t seq) {
+  buf[len + 3] = seq;
+  return buf + len + 4;
+}
+
+void endPacket(uint8_t *buf, size_t &len, uint8_t *end) {
+  size_t payload = end - (buf + len + 4);
+  buf[len] = payload & 0xFF;
+  buf[len + 1] = (payload >> 8) & 0xFF;
+  buf[len + 2] = (payload >> 16) & 0xFF;
+  len += payload + 4;
+}
+
+uint8_t *putString(uint8_t *p, const char *text) {
+  size_t len = strlen(text);
+  *p++ = len;
+  memcpy(p, text, len);
+  return p + len;
+}
+
+void buildHandshake() {
+  static const char version[] = "8.0.36";
+  uint8_t *p = beginPacket(handshake, handshakeLen, 0);
+  *p++ = 0x0A;
+  memcpy(p, version, sizeof(version));
+  p += sizeof(version);
+  memset(p, 1, 4 + 8 + 1);                          // thread id, seed, filler
+  p += 13;
+  *p++ = 0x0D; *p++ = 0xA6;                         // capabilities (low)
+  *p++ = 0xFF; *p++ = 0x02; *p++ = 0x00;            // charset, status
+  *p++ = 0x0B; *p++ = 0x00;                         // capabilities (high)
+  *p++ = 21;
+  memset(p, 0, 10);
+  p += 10;
+  memset(p, 2, 12);                                 // seed
+  p += 12;
+  *p++ = 0;
+  endPacket(handshake, handshakeLen, p);
+}
+
+// Result set of rows x columns, same values of the host benchmark
+bool buildResult(uint32_t rows, uint16_t columns) {
+  resultLen = 0;
+  uint8_t seq = 1;
+  uint8_t *p = beginPacket(result, resultLen, seq++);
+  *p++ = columns;
+  endPacket(result, resultLen, p);
+
+  for (uint16_t c = 0; c < columns; c++) {
+    char name[8];
+    snprintf(name, sizeof(name), "col%u", c);
+    p = beginPacket(result, resultLen, seq++);
+    p = putString(p, "def");
+    p = putString(p, "db");
+    p = putString(p, "fake");
+    p = putString(p, "fake");
+    p = putString(p, name);
+    p = putString(p, name);
+    const uint8_t fixed[] = {0x0C, 0xFF, 0x00, 16, 0, 0, 0, (uint8_t)(c % 2 ? MYSQL_TYPE_VAR_STRING : MYSQL_TYPE_LONG), 0, 0, 0, 0, 0};
+    memcpy(p, fixed, sizeof(fixed));
+    endPacket(result, resultLen, p + sizeof(fixed));
+  }
+
+  const uint8_t eof[] = {0xFE, 0x00, 0x00, 0x02, 0x00};
+  p = beginPacket(result, resultLen, seq++);
+  memcpy(p, eof, sizeof(eof));
+  endPacket(result, resultLen, p + sizeof(eof));
+
+  for (uint32_t r = 0; r < rows; r++) {
+    if (resultLen + columns * 20 + 32 > MAX_RESULT_SIZE)
+      return false;
+    p = beginPacket(result, resultLen, seq++);
+    for (uint16_t c = 0; c < columns; c++) {
+      char value[24];
+      if (c % 2 && (r + c) % 7 == 0) {
+        *p++ = 0xFB;
+        continue;
+      }
+      if (c % 2)
+        snprintf(value, sizeof(value), "value-%.10lu", (unsigned long)(r * 31 + c));
+      else
+        snprintf(value, sizeof(value), "%lu", (unsigned long)(r * columns + c));
+      p = putString(p, value);
+    }
+    endPacket(result, resultLen, p);
+  }
+
+  p = beginPacket(result, resultLen, seq++);
+  memcpy(p, eof, sizeof(eof));
+  endPacket(result, resultLen, p + sizeof(eof));
+  return true;
+}
+
+void countRow(const Row_t &row, void *userData) {
+  (*(uint32_t *)userData)++;
+}
+
+void bench(uint32_t rows, uint16_t columns, bool stream) {
+  if (!buildResult(rows, columns)) {
+    Serial.printf("%u x %u: result set too large\n", rows, columns);
+    return;
+  }
+
+  MemoryClient client(handshake, handshakeLen, result, resultLen);
+  MySQL sql(&client, "127.0.0.1", 3306);
+  sql.connect("user", "password", "db");
+
+  uint32_t iterations = 0, heapUsed = 0;
+  uint32_t start = micros();
+  do {
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if (stream) {
+      uint32_t count = 0;
+      sql.queryStream("SELECT", countRow, &count);
+    }
+    else {
+      DataQuery_t data;
+      sql.query(data, "SELECT");
+      heapUsed = freeHeap - ESP.getFreeHeap();
+    }
+    iterations++;
+  } while (micros() - start < 1000000);
+  float seconds = (micros() - start) / 1e6;
+
+  Serial.printf("%-12s %6u x %2u  %9.0f rows/s  %9.0f bytes/s  %6u heap bytes\n",
+                stream ? "queryStream" : "query", rows, columns,
+                rows * iterations / seconds, resultLen * iterations / seconds, heapUsed);
+}
+
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("******************************************************");
+
+  result = (uint8_t *)malloc(MAX_RESULT_SIZE);
+  buildHandshake();
+
+  const uint32_t rowCounts[] = {10, 100, 1000};
+  const uint16_t columnCounts[] = {2, 8, 32};
+  for (uint32_t rows : rowCounts) {
+    for (uint16_t columns : columnCounts) {
+      bench(rows, columns, false);
+      bench(rows, columns, true);
+    }
+  }
+}
+
+void loop() {
+}
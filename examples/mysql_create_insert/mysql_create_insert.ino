@@ -9,7 +9,6 @@
 
 WiFiClient client;
 MySQL sql(&client, dbHost, dbPort);
-#define MAX_QUERY_LEN 512
 
 const char* table = "reset_reasons";    // Table name
 uint32_t pollTime = 5000;               // Waiting time between one request and the next
@@ -57,7 +56,7 @@ const char* getResetReason(int reason) {
 
 
 static const char createQuery[] PROGMEM = R"string_literal(
-CREATE TABLE `%s` (
+CREATE TABLE %I (
   `id` INT UNSIGNED NOT NULL AUTO_INCREMENT,
   `timestamp` TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
   `MAC address` VARCHAR(18) NOT NULL,
@@ -69,9 +68,9 @@ CREATE TABLE `%s` (
 )string_literal";
 
 static const char insertQuery[] PROGMEM = R"string_literal(
-INSERT INTO `%s`
+INSERT INTO %I
   (`MAC address`, `CPU0 reset reason`, `CPU1 reset reason`)
-  VALUES ('%s', '%s', '%s');
+  VALUES (%s, %s, %s);
 )string_literal";
 
 static const char selectQuery[] PROGMEM = R"string_literal(
@@ -81,27 +80,11 @@ SELECT
   `CPU0 reset reason`,
   `CPU1 reset reason`,
   timestamp AS `Inserted at`
-  FROM %s
+  FROM %I
   ORDER BY id DESC LIMIT 10;
 )string_literal";
 
 
-// Variadic function that will execute the query selected with passed parameters
-bool queryExecute(DataQuery_t& data, const char* queryStr, ...) {
-  if (sql.connected()) {
-    char buf[MAX_QUERY_LEN];
-    va_list args;
-    va_start (args, queryStr);
-    vsnprintf (buf, sizeof(buf), queryStr, args);
-    va_end (args);
-
-    Serial.printf("Executing SQL query: %s\n", buf);
-    // Execute the query
-    return sql.query(data, buf);
-  }
-  return false;
-}
-
 
 void setup() {
   Serial.begin(115200);
@@ -128,7 +111,7 @@ void setup() {
   // Create table if not exists
   Serial.println("Create table if not exists");
   DataQuery_t data;
-  if (!queryExecute(data, createQuery, table)) {
+  if (!sql.queryf(data, createQuery, table)) {
     Serial.println("CREATE query error. Table already defined");
   }
   data.clear();
@@ -141,7 +124,8 @@ void setup() {
   Serial.println(getResetReason(rtc_get_reset_reason(1)));
   Serial.println();
 
-  if (queryExecute( data, insertQuery, table,
+  // Strings are quoted and escaped by queryf() (%s), table name too (%I)
+  if (sql.queryf( data, insertQuery, table,
       WiFi.macAddress().c_str(),
       getResetReason(rtc_get_reset_reason(0)),
       getResetReason(rtc_get_reset_reason(1)))
@@ -163,7 +147,7 @@ void loop() {
     DataQuery_t data;
 
     // Select last 10 records using som alias and print them to Serial
-    if (queryExecute(data, selectQuery, table)) {
+    if (sql.queryf(data, selectQuery, table)) {
       Serial.println("SELECT query executed.");
       if (data.recordCount) {
         // Print formatted content of table
@@ -28,25 +28,6 @@ Gpio_t gpios[] = {
 
 WiFiClient client;
 MySQL sql(&client, dbHost, dbPort);
-#define MAX_QUERY_LEN 256
-
-// Variadic function that will execute the query selected with passed parameters
-bool queryExecute(DataQuery_t& data, const char* queryStr, ...) {
-  if (sql.connected()) {
-    char buf[MAX_QUERY_LEN];
-    va_list args;
-    va_start (args, queryStr);
-    vsnprintf (buf, sizeof(buf), queryStr, args);
-    va_end (args);
-
-#if PRINT_SQL
-    Serial.printf("Executing SQL query: %s\n", buf);
-#endif
-    // Execute the query
-    return sql.query(data, buf);
-  }
-  return false;
-}
 
 // Read the state of outputs from DB and set level 
 void updateOutputs() {
@@ -61,19 +42,24 @@ void updateOutputs() {
 
     // Create a DataQuery_t object for store query results
     DataQuery_t data;
-    if (queryExecute(data, "SELECT * FROM %s WHERE type = %d", table, OUTPUT)){
+    // Query is formatted directly in the packet buffer (%I is a table or column name)
+    if (sql.queryf(data, "SELECT * FROM %I WHERE type = %d", table, OUTPUT)){
 
       // Print formatted content of table
       // sql.printResult(data, Serial);
       // Serial.print('\n');
       
-      // Update output state
-      for (int row = 0; row < data.recordCount; row++) { 
-        String type = data.getRowValue(row, "type");
-        String pin = data.getRowValue(row, "gpio");
-        String level = data.getRowValue(row, "state");
-        if (type.toInt() == OUTPUT) {
-          digitalWrite(pin.toInt(), level.toInt());
+      // Update output state (resolve column index once, then use it for each row)
+      int typeCol = data.getFieldIndex("type");
+      int gpioCol = data.getFieldIndex("gpio");
+      int stateCol = data.getFieldIndex("state");
+      for (uint32_t row = 0; row < data.recordCount; row++) { 
+        // Typed getters decode values directly, without temporary String objects
+        int type = data.getInt(row, typeCol);
+        int pin = data.getInt(row, gpioCol);
+        int level = data.getInt(row, stateCol);
+        if (type == OUTPUT) {
+          digitalWrite(pin, level);
         }
       }
       
@@ -111,9 +97,14 @@ void updateInputs() {
     // Start new connection to DB
     sql.connect(user, password, database, true);
 
-    // Do the SQL update query
+    // Do the SQL update query (all statements in one round-trip)
     DataQuery_t data;
-    queryExecute(data, strSql.c_str());
+    sql.query(data, strSql.c_str());
+
+    // Each statement has its own result, check them all
+    while (sql.hasMoreResults()) {
+      sql.nextResult(data);
+    }
 
     // Close the connection
     sql.disconnect();
@@ -129,23 +120,23 @@ void createUpdateTable() {
     // Create table if not exists
     Serial.println("Create table if not exists");
     DataQuery_t data;
-    if (!queryExecute(data, CREATE_TABLE_SQL, table)) {
+    if (!sql.queryf(data, CREATE_TABLE_SQL, table)) {
       Serial.println("CREATE query error. Table already defined");
     }    
 
-    // Prepare the SQL string with each gpio record
-    String strSql = "INSERT IGNORE INTO " + String(table) + " (gpio, type, state, label) VALUES ";
+    // Insert a record for each gpio: rows are written directly in the packet
+    // buffer with values escaped, and sent in more INSERT if they don't fit
+    delay(500);
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "INSERT IGNORE INTO %s (gpio, type, state, label) VALUES ", table);
+    BulkInserter insert(&sql);
+    insert.begin(prefix);
     for (Gpio_t &gpio : gpios) {
-      char rowSql[64];   
-      snprintf(rowSql, sizeof(rowSql), "(%d, %d, %d, '%s'),", gpio.pin, gpio.type, gpio.state, gpio.label);
-      strSql += rowSql;
+      insert.addRow(gpio.pin, gpio.type, gpio.state, gpio.label);
+    }
+    if (insert.end()) {
+      Serial.printf("%d records inserted\n", (int)insert.getAffectedRows());
     }
-    strSql[strSql.length()-1] = ';';      // Replace last ',' with ';'
-    
-    // Do the SQL insert/update query
-    delay(500);
-    data.clear();
-    queryExecute(data, strSql.c_str());
 
     // Close the connection
     sql.disconnect();
@@ -12,7 +12,7 @@ uint32_t pollTime = 5000;                      // Waiting time between one reque
 
 
 static const char CREATE_TABLE_SQL[] PROGMEM = R"string_literal(
-CREATE TABLE `%s` (
+CREATE TABLE %I (
   `gpio` int(11) NOT NULL,
   `type` int(11) DEFAULT 0,
   `state` tinyint(1) DEFAULT 0,
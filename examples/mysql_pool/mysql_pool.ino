@@ -0,0 +1,59 @@
+#if defined(ESP8266)
+  #include <ESP8266WiFi.h>
+#else
+ #include <WiFi.h>
+#endif
+
+#include <MySQLPool.h>
+#include "secrets.h"
+
+// One socket for each session that can be open at the same time
+WiFiClient client1;
+WiFiClient client2;
+MySQLPool pool(dbHost, dbPort);
+#define MAX_QUERY_LEN 128
+
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("******************************************************");
+  Serial.print("Connecting to WiFI");
+
+  WiFi.begin(ssid, wifiPwd);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+    Serial.print(".");
+  }
+
+  Serial.print("\nWiFi connected, IP address: ");
+  Serial.println(WiFi.localIP());
+
+  // Sessions are opened only when needed and then kept open
+  pool.addClient(&client1);
+  pool.addClient(&client2);
+  pool.begin(user, password, database);
+}
+
+void loop() {
+  // NON-blocking delay of pollTime
+  static uint32_t lastPollTime = millis();
+  if (millis() - lastPollTime > pollTime) {
+    lastPollTime = millis();
+
+    // No connection and login here: the session is already authenticated
+    MySQL *sql = pool.acquire();
+    if (sql) {
+      char buf[MAX_QUERY_LEN];
+      snprintf(buf, sizeof(buf), "SELECT * FROM %s", table);
+      DataQuery_t data;
+      if (sql->query(data, buf)) {
+        sql->printResult(data, Serial);
+      }
+      // Give the session back to the pool, do not disconnect
+      pool.release(sql);
+    }
+  }
+
+  // Ping idle sessions, so server will not close them (see wait_timeout)
+  pool.maintain();
+}
@@ -0,0 +1,86 @@
+#if defined(ESP8266)
+  #include <ESP8266WiFi.h>
+#else
+ #include <WiFi.h>
+#endif
+
+#include <MySQL.h>
+#include "secrets.h"
+
+WiFiClient client;
+MySQL sql(&client, dbHost, dbPort);
+
+// Statements are parsed by server only once, then executed with new values
+PreparedStatement insertStmt(&sql);
+PreparedStatement selectStmt(&sql);
+
+static const char createQuery[] PROGMEM = R"string_literal(
+CREATE TABLE IF NOT EXISTS `%s` (
+  `id` INT UNSIGNED NOT NULL AUTO_INCREMENT,
+  `sensor` VARCHAR(32) NOT NULL,
+  `value` FLOAT NOT NULL,
+  `timestamp` TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+  PRIMARY KEY (`id`)
+) ENGINE=INNODB DEFAULT CHARSET=utf8;
+)string_literal";
+
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("******************************************************");
+  Serial.print("Connecting to WiFI");
+
+  WiFi.begin(ssid, wifiPwd);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+    Serial.print(".");
+  }
+
+  Serial.print("\nWiFi connected, IP address: ");
+  Serial.println(WiFi.localIP());
+
+  //Open MySQL session
+  Serial.print("Connecting to... ");
+  Serial.println(dbHost);
+
+	if (sql.connect(user, password, database)) {
+    Serial.println();
+  }
+
+  // Create table if not exists
+  char buf[256];
+  snprintf(buf, sizeof(buf), createQuery, table);
+  DataQuery_t data;
+  sql.query(data, buf);
+
+  // '?' are placeholders for values bound before each execution
+  snprintf(buf, sizeof(buf), "INSERT INTO %s (sensor, value) VALUES (?, ?)", table);
+  if (!insertStmt.prepare(buf))
+    Serial.println(sql.getLastError());
+
+  snprintf(buf, sizeof(buf), "SELECT id, sensor, value FROM %s WHERE value > ? ORDER BY id DESC LIMIT 5", table);
+  if (!selectStmt.prepare(buf))
+    Serial.println(sql.getLastError());
+}
+
+void loop() {
+  // Insert a new record, values are sent in binary form
+  float value = random(0, 1000) / 10.0;
+  insertStmt.bindString(0, "random");
+  insertStmt.bindFloat(1, value);
+  if (insertStmt.execute()) {
+    Serial.printf("Inserted value %.1f\n", value);
+  }
+
+  // Read last records: numeric columns are decoded without any text conversion
+  selectStmt.bindFloat(0, 50.0);
+  if (selectStmt.execute()) {
+    char sensor[33];
+    while (selectStmt.next()) {
+      selectStmt.copyValue(1, sensor, sizeof(sensor));
+      Serial.printf("id: %d, sensor: %s, value: %.1f\n", (int)selectStmt.getInt(0), sensor, selectStmt.getFloat(2));
+    }
+  }
+  Serial.print('\n');
+  delay(pollTime);
+}
@@ -0,0 +1,77 @@
+#if defined(ESP8266)
+  #include <ESP8266WiFi.h>
+#else
+ #include <WiFi.h>
+#endif
+
+#include <MySQL.h>
+#include "secrets.h"
+
+WiFiClient client;
+MySQL sql(&client, dbHost, dbPort);
+
+// Up to 4KB of results, valid for 60 seconds
+QueryCache cache(4096, 60000);
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("******************************************************");
+  Serial.print("Connecting to WiFI");
+
+  WiFi.begin(ssid, wifiPwd);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+    Serial.print(".");
+  }
+
+  Serial.print("\nWiFi connected, IP address: ");
+  Serial.println(WiFi.localIP());
+
+  // Repeated reads of query() and queryf() are served from cache
+  sql.setQueryCache(&cache);
+
+  //Open MySQL session
+  Serial.print("Connecting to... ");
+  Serial.println(dbHost);
+
+	if (sql.connect(user, password, database)) {
+    Serial.println();
+  }
+  delay(2000);
+}
+
+void loop() {
+  static uint32_t count = 0;
+
+  if (!sql.connected()) {
+    sql.connect(user, password, database);
+    delay(pollTime);
+    return;
+  }
+
+  /*
+  * Same query at every loop: only the first one (and the first after 60s)
+  * is sent to server, the others take no round trip.
+  */
+  DataQuery_t data;
+  uint32_t start = millis();
+  if (sql.queryf(data, "SELECT * FROM %I", table)) {
+    Serial.printf("%lu records in %lu ms (cache hits: %lu, misses: %lu)\n",
+                  (unsigned long)data.recordCount, millis() - start, cache.hits(), cache.misses());
+  }
+  else {
+    Serial.println(sql.getLastError());
+  }
+
+  /*
+  * A write on this connection drops cached results,
+  * so next loop reads the new record from server.
+  */
+  if (++count % 5 == 0) {
+    sql.queryf(data, "INSERT INTO %I () VALUES ()", table);
+    Serial.printf("Record added, %u results cached\n", cache.count());
+  }
+
+  Serial.print('\n');
+  delay(pollTime);
+}
@@ -0,0 +1,10 @@
+const char* ssid = "xxxxxxx";				   // WiFi SSID
+const char* wifiPwd = "xxxxxxxx";              // WiFi password
+
+const char* user = "dbuser";                   // MySQL user login username
+const char* password = "dbpassword";           // MySQL user login password
+const char* dbHost = "192.168.1.1";            // MySQL hostname or IP address
+const char* database = "databaseName";         // Database name
+const char* table = "tableName";               // Table name
+uint16_t dbPort = 3306;                        // MySQL host port
+uint32_t pollTime = 5000;                      // Waiting time between one request and the next
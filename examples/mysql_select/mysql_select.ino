@@ -9,23 +9,6 @@
 
 WiFiClient client;
 MySQL sql(&client, dbHost, dbPort);
-#define MAX_QUERY_LEN 128
-
-// Variadic function that will execute the query selected with passed parameters
-bool queryExecute(DataQuery_t& data, const char* queryStr, ...) {
-  if (sql.connected()) {
-    char buf[MAX_QUERY_LEN];
-    va_list args;
-    va_start (args, queryStr);
-    vsnprintf (buf, sizeof(buf), queryStr, args);
-    va_end (args);
-
-    Serial.printf("Executing SQL query: %s\n", buf);
-    // Execute the query
-    return sql.query(data, buf);
-  }
-  return false;
-}
 
 
 void setup() {
@@ -57,7 +40,8 @@ void setup() {
 void loop() {
   // Create a DataQuery_t object for store query results
   DataQuery_t data;
-  if (queryExecute(data, "SELECT * FROM %s", table)){
+  // Query is formatted directly in the packet buffer (%I is a table or column name)
+  if (sql.queryf(data, "SELECT * FROM %I", table)){
     Serial.println("Query executed.");
     if (data.recordCount) {
       // Print formatted content of table
@@ -65,7 +49,8 @@ void loop() {
       Serial.print('\n');
 
       /*
-      * data.fields is a std::vector<Field_t> object (Field_t defined in DataQuery.h)
+      * data.fields is a FieldList of Field_t (defined in DataQuery.h), a std::vector or
+      * a fixed size array on AVR (MYSQL_STATIC_STORAGE)
       * which you can manually iterate using a range based for loop for easy data parsing
       */
       for (Field_t field : data.fields) {
@@ -74,25 +59,16 @@ void loop() {
       Serial.print('\n');
 
       /*
-      * data.records is a std::vector<Record_t> object (Record_t defined in DataQuery.h)
-      * which you can manually iterate using a range based for loop as for fields
-      * or as alternative you can iterate each record with a classic for loop
+      * All records are stored in a single buffer inside data object:
+      * iterate each record with a classic for loop and get values with getRowValue()
       */
-      for (int row = 0; row < data.recordCount; row++) {
+      for (uint32_t row = 0; row < data.recordCount; row++) {
         for (int col = 0; col < data.fieldCount; col++) {
           String value = data.getRowValue(row, col);
-          // String value = data.records.record.at(i).c_str();
           Serial.printf("%s, ", value.c_str());
         }
         Serial.print('\n');
       }
-
-      // for (Record_t rec : data.records, i++) {
-      //   for (int col = 0; col < data.fieldCount; col++) {
-      //     Serial.printf("%s, ", rec.record.at(i).c_str());
-      //   }
-      //   Serial.print('\n');
-      // }
     }
   }
   Serial.print('\n');
@@ -0,0 +1,78 @@
+#if defined(ESP8266)
+  #include <ESP8266WiFi.h>
+#else
+ #include <WiFi.h>
+#endif
+
+#include <MySQL.h>
+#include "secrets.h"
+
+WiFiClient client;
+MySQL sql(&client, dbHost, dbPort);
+#define MAX_QUERY_LEN 128
+
+// Result must stay valid while the query is running
+DataQuery_t data;
+
+/*
+* Called from sql.poll() when the query is completed
+*/
+void queryDone(MySQL *sql, bool success, void *userData) {
+  if (success) {
+    Serial.printf("Query executed, %lu rows recieved.\n", (unsigned long)data.recordCount);
+    sql->printResult(data, Serial);
+  }
+  else {
+    Serial.printf("Query failed: %s\n", sql->getLastError());
+  }
+}
+
+
+void setup() {
+  Serial.begin(115200);
+  pinMode(LED_BUILTIN, OUTPUT);
+  Serial.println("******************************************************");
+  Serial.print("Connecting to WiFI");
+
+  WiFi.begin(ssid, wifiPwd);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+    Serial.print(".");
+  }
+
+  Serial.print("\nWiFi connected, IP address: ");
+  Serial.println(WiFi.localIP());
+
+  //Open MySQL session
+  Serial.print("Connecting to... ");
+  Serial.println(dbHost);
+
+  if (sql.connect(user, password, database)) {
+    Serial.println();
+  }
+}
+
+void loop() {
+  // NON-blocking delay of pollTime
+  static uint32_t lastPollTime = millis();
+  if (millis() - lastPollTime > pollTime && !sql.busy() && sql.connected()) {
+    lastPollTime = millis();
+
+    char buf[MAX_QUERY_LEN];
+    snprintf(buf, sizeof(buf), "SELECT * FROM %s", table);
+    Serial.printf("Executing SQL query: %s\n", buf);
+
+    // Send query and return immediately
+    sql.beginQuery(data, buf, queryDone);
+  }
+
+  // Read what server has sent so far, it never waits
+  sql.poll();
+
+  // Meanwhile loop() keeps running
+  static uint32_t blinkTime = millis();
+  if (millis() - blinkTime > 250) {
+    blinkTime = millis();
+    digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN));
+  }
+}
@@ -0,0 +1,61 @@
+#if defined(ESP8266)
+  #include <ESP8266WiFi.h>
+#else
+ #include <WiFi.h>
+#endif
+
+#include <MySQL.h>
+#include "secrets.h"
+
+WiFiClient client;
+MySQL sql(&client, dbHost, dbPort);
+
+/*
+* Called once for each row as soon as it has been decompressed.
+*/
+void countRow(const Row_t &row, void *userData) {
+  uint32_t *rowCount = (uint32_t *)userData;
+  (*rowCount)++;
+}
+
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("******************************************************");
+  Serial.print("Connecting to WiFI");
+
+  WiFi.begin(ssid, wifiPwd);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+    Serial.print(".");
+  }
+
+  Serial.print("\nWiFi connected, IP address: ");
+  Serial.println(WiFi.localIP());
+
+  // Ask server for compressed protocol (must be set before connect)
+  sql.setCompression(true);
+
+  //Open MySQL session
+  Serial.print("Connecting to... ");
+  Serial.println(dbHost);
+
+	if (sql.connect(user, password, database)) {
+    Serial.println();
+    Serial.println(sql.compressed() ? "Compressed protocol enabled" : "Server does not support compression");
+  }
+  delay(2000);
+}
+
+void loop() {
+  if (sql.connected()) {
+    // Text result sets are very repetitive, the bytes recieved drop several times
+    uint32_t rowCount = 0;
+    uint32_t start = millis();
+    if (sql.queryStreamf(countRow, &rowCount, "SELECT * FROM %I", table)) {
+      Serial.printf("Query executed, %d rows recieved in %d ms.\n", rowCount, millis() - start);
+    }
+  }
+  Serial.print('\n');
+  delay(pollTime);
+}
@@ -0,0 +1,74 @@
+#if defined(ESP8266)
+  #include <ESP8266WiFi.h>
+#else
+ #include <WiFi.h>
+#endif
+
+#include <MySQL.h>
+#include "secrets.h"
+
+WiFiClient client;
+MySQL sql(&client, dbHost, dbPort);
+#define MAX_QUERY_LEN 128
+
+/*
+* Called once for each row as soon as it has been recieved from server.
+* Row values point directly to the recieved packet (they are not null-terminated)
+* and are valid only inside this function: copy what you need to keep.
+*/
+void printRow(const Row_t &row, void *userData) {
+  uint32_t *rowCount = (uint32_t *)userData;
+  (*rowCount)++;
+
+  char value[32];
+  for (int col = 0; col < row.count(); col++) {
+    if (row.isNull(col)) {
+      Serial.printf("%s: NULL, ", row.getFieldName(col));
+      continue;
+    }
+    row.copyValue(col, value, sizeof(value));
+    Serial.printf("%s: %s, ", row.getFieldName(col), value);
+  }
+  Serial.print('\n');
+}
+
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("******************************************************");
+  Serial.print("Connecting to WiFI");
+
+  WiFi.begin(ssid, wifiPwd);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+    Serial.print(".");
+  }
+
+  Serial.print("\nWiFi connected, IP address: ");
+  Serial.println(WiFi.localIP());
+
+  //Open MySQL session
+  Serial.print("Connecting to... ");
+  Serial.println(dbHost);
+
+	if (sql.connect(user, password, database)) {
+    Serial.println();
+  }
+  delay(2000);
+}
+
+void loop() {
+  if (sql.connected()) {
+    char buf[MAX_QUERY_LEN];
+    snprintf(buf, sizeof(buf), "SELECT * FROM %s", table);
+    Serial.printf("Executing SQL query: %s\n", buf);
+
+    // Rows are never stored: RAM usage does not depend on the number of records
+    uint32_t rowCount = 0;
+    if (sql.queryStream(buf, printRow, &rowCount)) {
+      Serial.printf("Query executed, %d rows recieved.\n", rowCount);
+    }
+  }
+  Serial.print('\n');
+  delay(pollTime);
+}
@@ -50,19 +50,22 @@ void setup() {
 }
 
 void loop() {
-  // Create a DataQuery_t object for store query results
-  DataQuery_t data;
+  // Query results stored without heap: up to 10 rows of 8 columns, 256 chars for all values
+  StaticDataQuery_t<10, 8, 256> data;
   char query[MAX_QUERY_LEN];
   snprintf(query, MAX_QUERY_LEN, "SELECT * FROM %s", table);
   if (sql.query(data, query )){
     Serial.println(F("Query executed."));
+    if (data.overflow())
+      Serial.println(F("Result too large, some rows have been dropped"));
     if (data.recordCount) {
       // Print formatted content of table
       sql.printResult(data, Serial);
       Serial.print('\n');
 
       /*
-      * data.fields is a std::vector<Field_t> object (Field_t defined in DataQuery.h)
+      * data.fields is a FieldList of Field_t (defined in DataQuery.h), a std::vector or
+      * a fixed size array on AVR (MYSQL_STATIC_STORAGE)
       * which you can manually iterate using a range based for loop for easy data parsing
       */
       for (Field_t field : data.fields) {
@@ -74,11 +77,10 @@ void loop() {
       Serial.print('\n');
 
       /*
-      * data.records is a std::vector<Record_t> object (Record_t defined in DataQuery.h)
-      * which you can manually iterate using a range based for loop as for fields
-      * or as alternative you can iterate each record with a classic for loop
+      * All records are stored in a single buffer inside data object:
+      * iterate each record with a classic for loop and get values with getRowValue()
       */
-      for (int row = 0; row < data.recordCount; row++) {
+      for (uint32_t row = 0; row < data.recordCount; row++) {
         for (int col = 0; col < data.fieldCount; col++) {
           String value = data.getRowValue(row, col);
           Serial.print(value);
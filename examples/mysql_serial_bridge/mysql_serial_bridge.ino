@@ -12,21 +12,6 @@ MySQL sql(&client, dbHost, dbPort);
 #define MAX_QUERY_LEN 128
 char sql_str[MAX_QUERY_LEN];
 
-// Variadic function that will execute the query selected with passed parameters
-bool queryExecute(DataQuery_t& data, const char* queryStr, ...) {
-  if (sql.connected()) {
-    char buf[MAX_QUERY_LEN];
-    va_list args;
-    va_start (args, queryStr);
-    vsnprintf (buf, sizeof(buf), queryStr, args);
-    va_end (args);
-
-    Serial.printf("\nExecuting SQL query: %s\n", buf);
-    // Execute the query
-    return sql.query(data, buf);
-  }
-  return false;
-}
 
 
 void setup() {
@@ -64,11 +49,9 @@ void loop() {
       char ch = (char) Serial.read();
       // Skip new line and carriage return
       if (ch != '\n' && ch != '\r') {
-        // Add escape to single quote
-        if (ch == '\'') {
-          sql_str[pos++] = '\\';
-        }
-        sql_str[pos++] = ch;
+        // The statement is sent as is (use sql.queryf() to escape values)
+        if (pos < MAX_QUERY_LEN - 1)
+          sql_str[pos++] = ch;
       }
       else {
         sql_str[pos] = '\0';  // Add string terminator
@@ -83,7 +66,8 @@ void loop() {
 
     // Create a DataQuery_t object for store query results
     DataQuery_t data;
-    if (queryExecute(data, sql_str)){
+    Serial.printf("\nExecuting SQL query: %s\n", sql_str);
+    if (sql.query(data, sql_str)){
       Serial.println("Query executed.");
 
       // Check if the query has some records
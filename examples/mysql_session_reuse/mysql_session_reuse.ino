@@ -0,0 +1,76 @@
+#if defined(ESP8266)
+  #include <ESP8266WiFi.h>
+#else
+ #include <WiFi.h>
+#endif
+
+#include <MySQL.h>
+#include "secrets.h"
+
+WiFiClient client;
+MySQL sql(&client, dbHost, dbPort);
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("******************************************************");
+  Serial.print("Connecting to WiFI");
+
+  WiFi.begin(ssid, wifiPwd);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+    Serial.print(".");
+  }
+
+  Serial.print("\nWiFi connected, IP address: ");
+  Serial.println(WiFi.localIP());
+
+  //Open MySQL session
+  Serial.print("Connecting to... ");
+  Serial.println(dbHost);
+
+	if (sql.connect(user, password, database)) {
+    Serial.println();
+  }
+  delay(2000);
+}
+
+void loop() {
+  if (!sql.connected()) {
+    // Connection lost: TCP connection and login again
+    sql.connect(user, password, database);
+    delay(pollTime);
+    return;
+  }
+
+  DataQuery_t data;
+
+  /*
+  * A session variable set by a previous loop would change the result:
+  * resetSession() gives back a clean session with a single command,
+  * without closing the TCP connection.
+  */
+  uint32_t start = millis();
+  if (sql.resetSession()) {
+    Serial.printf("Session reset in %lu ms\n", millis() - start);
+    sql.queryf(data, "SELECT COUNT(*) FROM %I", table);
+    Serial.printf("Records in %s: %s\n", table, data.getRowValue(0, 0));
+  }
+
+  /*
+  * Reports are read with another user and database on the same connection,
+  * then the session goes back to the first user.
+  */
+  start = millis();
+  if (sql.changeUser(reportUser, reportPassword, reportDatabase)) {
+    Serial.printf("Logged in as %s in %lu ms\n", reportUser, millis() - start);
+    if (sql.query(data, "SHOW TABLES"))
+      sql.printResult(data, Serial);
+    sql.changeUser(user, password, database);
+  }
+  else {
+    Serial.println(sql.getLastError());
+  }
+
+  Serial.print('\n');
+  delay(pollTime);
+}
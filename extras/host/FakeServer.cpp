@@ -0,0 +1,598 @@
+#include "FakeServer.h"
+
+#include <Inflate.h>
+#include <PacketsTypes.h>
+
+#include <algorithm>
+
+#define COM_QUIT        0x01
+#define COM_STMT_CLOSE  0x19
+
+
+void FakeServer::reset(void)
+{
+    mGreeting.clear();
+    mScript.clear();
+    mResponder = nullptr;
+    mResponderData = nullptr;
+    mCompressed = false;
+    mDrip = 0;
+    this->stop();
+    bytesIn = bytesOut = packetsIn = connects = sequenceErrors = 0;
+    mZSequence = 0;
+}
+
+int FakeServer::connect(const char *host, uint16_t port)
+{
+    (void)host;
+
+    this->stop();
+    mConnected = true;
+    connects++;
+    lastPort = port;
+    packetsIn = 0;
+    this->send(mGreeting);
+    return 1;
+}
+
+void FakeServer::stop()
+{
+    mConnected = false;
+    mIn.clear();
+    mPlain.clear();
+    mOut.clear();
+    mOutPos = 0;
+    mVisible = 0;
+}
+
+size_t FakeServer::write(uint8_t c)
+{
+    return this->write(&c, 1);
+}
+
+size_t FakeServer::write(const uint8_t *buf, size_t size)
+{
+    if (!mConnected)
+        return 0;
+
+    bytesIn += size;
+    mIn.insert(mIn.end(), buf, buf + size);
+    this->parse_input();
+    return size;
+}
+
+/**
+ * @brief Bytes that can be read without waiting
+ *
+ */
+size_t FakeServer::readable(void)
+{
+    if (mDrip == 0)
+        return mOut.size() - mOutPos;
+    return mVisible - mOutPos;
+}
+
+int FakeServer::available()
+{
+    // Once all visible bytes are read, next chunk arrives at the following call
+    if (mDrip && mVisible == mOutPos && mVisible < mOut.size()) {
+        mDripWait = !mDripWait;
+        if (!mDripWait)
+            mVisible = std::min(mOut.size(), mVisible + mDrip);
+    }
+    return this->readable();
+}
+
+int FakeServer::read()
+{
+    if (this->readable() == 0)
+        return -1;
+    return mOut[mOutPos++];
+}
+
+int FakeServer::read(uint8_t *buf, size_t size)
+{
+    size_t avail = this->readable();
+    if (avail == 0)
+        return -1;
+    if (size > avail)
+        size = avail;
+    memcpy(buf, mOut.data() + mOutPos, size);
+    mOutPos += size;
+    return size;
+}
+
+int FakeServer::peek()
+{
+    if (mOutPos == mOut.size())
+        return -1;
+    return mOut[mOutPos];
+}
+
+/**
+ * @brief Copy the bytes available, then wait the timeout if they are not enough
+ *
+ * Nothing else can arrive while the caller is blocked, but the time a
+ * real socket would wait is kept so timings match a device.
+ */
+size_t FakeServer::readBytes(char *buffer, size_t length)
+{
+    // Bytes sent by server arrive while waiting
+    if (mDrip)
+        mVisible = std::max(mVisible, std::min(mOut.size(), mOutPos + length));
+
+    int len = this->read((uint8_t *)buffer, length);
+    if (len < 0)
+        len = 0;
+    if ((size_t)len < length)
+        delay(_timeout);
+    return len;
+}
+
+/**
+ * @brief Split the bytes written by client in packets
+ *
+ */
+void FakeServer::parse_input(void)
+{
+    // First packet (authentication) is never compressed
+    if (!mCompressed || packetsIn == 0) {
+        mPlain.insert(mPlain.end(), mIn.begin(), mIn.end());
+        mIn.clear();
+    }
+    else {
+        while (mIn.size() >= 7) {
+            uint32_t len = mIn[0] | (mIn[1] << 8) | (mIn[2] << 16);
+            uint32_t plain_len = mIn[4] | (mIn[5] << 8) | (mIn[6] << 16);
+            if (mIn.size() < len + 7)
+                break;
+
+            size_t offset = mPlain.size();
+            if (plain_len == 0) {
+                mPlain.insert(mPlain.end(), mIn.begin() + 7, mIn.begin() + 7 + len);
+            }
+            else {
+                mPlain.resize(offset + plain_len);
+                zlibInflate(mPlain.data() + offset, plain_len, mIn.data() + 7, len);
+            }
+
+            // A command (packet sequence 0) starts a new compressed sequence, a reply goes on with it
+            if (mPlain.size() >= offset + 4) {
+                uint8_t expected = (mPlain[offset + 3] == 0) ? 0 : (uint8_t)(mZSequence + 1);
+                if (mIn[3] != expected)
+                    sequenceErrors++;
+            }
+            mIn.erase(mIn.begin(), mIn.begin() + 7 + len);
+        }
+    }
+
+    size_t pos = 0;
+    while (mPlain.size() - pos >= 4) {
+        uint32_t len = mPlain[pos] | (mPlain[pos + 1] << 8) | (mPlain[pos + 2] << 16);
+        if (mPlain.size() - pos < len + 4)
+            break;
+        this->on_packet(mPlain.data() + pos + 4, len);
+        pos += len + 4;
+
+        // Remaining bytes are in compressed packets
+        if (mCompressed && packetsIn == 1 && pos < mPlain.size()) {
+            mIn.insert(mIn.begin(), mPlain.begin() + pos, mPlain.end());
+            mPlain.resize(pos);
+            this->parse_input();
+            return;
+        }
+    }
+    mPlain.erase(mPlain.begin(), mPlain.begin() + pos);
+}
+
+void FakeServer::on_packet(const uint8_t *payload, size_t len)
+{
+    packetsIn++;
+    mLastPacket.assign(payload, payload + len);
+
+    // Authentication packet is a response too, commands without response don't use the script
+    if (packetsIn > 1 && len > 0) {
+        if (payload[0] == COM_QUIT) {
+            mConnected = false;
+            return;
+        }
+        if (payload[0] == COM_STMT_CLOSE)
+            return;
+    }
+
+    if (!mScript.empty()) {
+        this->send(mScript.front());
+        mScript.pop_front();
+    }
+    else if (mResponder != nullptr) {
+        this->send(mResponder(payload, len, mResponderData));
+    }
+}
+
+void FakeServer::send(const Bytes &bytes)
+{
+    // Release bytes already read
+    if (mOutPos == mOut.size()) {
+        mOut.clear();
+        mOutPos = 0;
+        mVisible = 0;
+    }
+    mOut.insert(mOut.end(), bytes.begin(), bytes.end());
+    bytesOut += bytes.size();
+
+    // Responses after authentication are compressed packets
+    if (mCompressed && packetsIn > 1) {
+        size_t pos = 0;
+        while (pos + 7 <= bytes.size()) {
+            mZSequence = bytes[pos + 3];
+            pos += 7 + (bytes[pos] | (bytes[pos + 1] << 8) | (bytes[pos + 2] << 16));
+        }
+    }
+}
+
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool FakeServer::loadCapture(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == nullptr)
+        return false;
+
+    Bytes greeting;
+    std::deque<Bytes> script;
+    Bytes *current = &greeting;
+    bool ret = true;
+    char line[4096];
+
+    while (ret && fgets(line, sizeof(line), file)) {
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        char *p = line;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '\0' || *p == '\n' || *p == '\r')
+            continue;
+        if ((p[0] != 'S' && p[0] != 'C') || p[1] != ':') {
+            ret = false;
+            break;
+        }
+        bool server = (p[0] == 'S');
+
+        Bytes bytes;
+        for (p += 2; *p; p++) {
+            if (hex_value(*p) < 0)
+                continue;
+            if (hex_value(p[1]) < 0) {
+                ret = false;
+                break;
+            }
+            bytes.push_back(hex_value(p[0]) << 4 | hex_value(p[1]));
+            p++;
+        }
+
+        if (server) {
+            current->insert(current->end(), bytes.begin(), bytes.end());
+            continue;
+        }
+
+        // Client packet: next server bytes are its response
+        if (bytes.size() > 4 && !script.empty() && (bytes[4] == COM_QUIT || bytes[4] == COM_STMT_CLOSE))
+            continue;
+        script.push_back(Bytes());
+        current = &script.back();
+    }
+    fclose(file);
+
+    if (ret) {
+        mGreeting = greeting;
+        mScript = script;
+    }
+    return ret;
+}
+
+
+void FakeServer::put_int(Bytes &out, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+        out.push_back((value >> (8 * i)) & 0xFF);
+}
+
+void FakeServer::put_lenenc_int(Bytes &out, uint64_t value)
+{
+    if (value < 251) {
+        out.push_back(value);
+    }
+    else if (value < 0x10000) {
+        out.push_back(0xFC);
+        put_int(out, value, 2);
+    }
+    else if (value < 0x1000000) {
+        out.push_back(0xFD);
+        put_int(out, value, 3);
+    }
+    else {
+        out.push_back(0xFE);
+        put_int(out, value, 8);
+    }
+}
+
+void FakeServer::put_lenenc_string(Bytes &out, const char *text)
+{
+    if (text == nullptr) {
+        out.push_back(0xFB);
+        return;
+    }
+    size_t len = strlen(text);
+    put_lenenc_int(out, len);
+    out.insert(out.end(), text, text + len);
+}
+
+Bytes FakeServer::packet(uint8_t seq, const Bytes &payload)
+{
+    Bytes out;
+    put_packet(out, seq, payload);
+    return out;
+}
+
+/**
+ * @brief Append payload in packets of up to 0xFFFFFF bytes, seq is updated
+ *
+ */
+void FakeServer::put_packet(Bytes &out, uint8_t &seq, const Bytes &payload)
+{
+    size_t pos = 0;
+    while (true) {
+        size_t len = std::min(payload.size() - pos, (size_t)0xFFFFFF);
+        put_int(out, len, 3);
+        out.push_back(seq++);
+        out.insert(out.end(), payload.begin() + pos, payload.begin() + pos + len);
+        pos += len;
+        if (len < 0xFFFFFF)
+            break;
+    }
+}
+
+void FakeServer::put_column(Bytes &out, uint8_t &seq, const FakeColumn_t &column)
+{
+    Bytes payload;
+    put_lenenc_string(payload, "def");
+    put_lenenc_string(payload, "db");
+    put_lenenc_string(payload, "fake");
+    put_lenenc_string(payload, "fake");
+    put_lenenc_string(payload, column.name);
+    put_lenenc_string(payload, column.name);
+    payload.push_back(0x0C);
+    put_int(payload, 0xFF, 2);
+    put_int(payload, column.length, 4);
+    payload.push_back(column.type);
+    put_int(payload, column.flags, 2);
+    payload.push_back(0);
+    put_int(payload, 0, 2);
+    put_packet(out, seq, payload);
+}
+
+void FakeServer::put_eof(Bytes &out, uint8_t &seq, uint16_t status)
+{
+    put_packet(out, seq, Bytes{0xFE, 0x00, 0x00, (uint8_t)(status & 0xFF), (uint8_t)(status >> 8)});
+}
+
+// Seed of handshake and auth switch requests, always the same
+static const uint8_t seed[20] = {
+    0x3a, 0x25, 0x5e, 0x10, 0x61, 0x7f, 0x2b, 0x4d, 0x13, 0x48,
+    0x5f, 0x6b, 0x01, 0x32, 0x74, 0x23, 0x3c, 0x27, 0x45, 0x70
+};
+
+/**
+ * @brief Protocol 10 handshake
+ *
+ */
+Bytes FakeServer::handshake(uint32_t capabilities, const char *version, const char *plugin)
+{
+    Bytes payload;
+    payload.push_back(0x0A);
+    payload.insert(payload.end(), version, version + strlen(version) + 1);
+    put_int(payload, 1, 4);                         // connection id
+    payload.insert(payload.end(), seed, seed + 8);
+    payload.push_back(0);
+    put_int(payload, capabilities & 0xFFFF, 2);
+    payload.push_back(0xFF);                        // utf8mb4_0900_ai_ci
+    put_int(payload, 0x0002, 2);                    // autocommit
+    put_int(payload, capabilities >> 16, 2);
+    payload.push_back(21);
+    payload.insert(payload.end(), 10, 0);
+    payload.insert(payload.end(), seed + 8, seed + 20);
+    payload.push_back(0);
+    payload.insert(payload.end(), plugin, plugin + strlen(plugin) + 1);
+    return packet(0, payload);
+}
+
+/**
+ * @brief Ask the client to authenticate again with plugin
+ *
+ */
+Bytes FakeServer::authSwitch(uint8_t seq, const char *plugin)
+{
+    Bytes payload;
+    payload.push_back(0xFE);
+    payload.insert(payload.end(), plugin, plugin + strlen(plugin) + 1);
+    payload.insert(payload.end(), seed, seed + 20);
+    payload.push_back(0);
+    return packet(seq, payload);
+}
+
+/**
+ * @brief caching_sha2_password result, 0x03 fast auth succeeded, 0x04 full authentication needed
+ *
+ */
+Bytes FakeServer::authMoreData(uint8_t seq, uint8_t status)
+{
+    return packet(seq, Bytes{0x01, status});
+}
+
+Bytes FakeServer::ok(uint8_t seq, uint64_t affectedRows, uint64_t lastInsertId, uint16_t status)
+{
+    Bytes payload;
+    payload.push_back(0x00);
+    put_lenenc_int(payload, affectedRows);
+    put_lenenc_int(payload, lastInsertId);
+    put_int(payload, status, 2);
+    put_int(payload, 0, 2);
+    return packet(seq, payload);
+}
+
+Bytes FakeServer::err(uint8_t seq, uint16_t code, const char *sqlState, const char *message)
+{
+    Bytes payload;
+    payload.push_back(0xFF);
+    put_int(payload, code, 2);
+    payload.push_back('#');
+    payload.insert(payload.end(), sqlState, sqlState + 5);
+    payload.insert(payload.end(), message, message + strlen(message));
+    return packet(seq, payload);
+}
+
+/**
+ * @brief Text result set: column count, column definitions, EOF, rows, EOF
+ *
+ */
+Bytes FakeServer::resultSet(uint8_t seq, const std::vector<FakeColumn_t> &columns, const std::vector<FakeRow_t> &rows, uint16_t status)
+{
+    Bytes out, payload;
+
+    put_lenenc_int(payload, columns.size());
+    put_packet(out, seq, payload);
+    for (const FakeColumn_t &column : columns)
+        put_column(out, seq, column);
+    put_eof(out, seq, status);
+
+    for (const FakeRow_t &row : rows) {
+        payload.clear();
+        for (const char *value : row)
+            put_lenenc_string(payload, value);
+        put_packet(out, seq, payload);
+    }
+
+    put_eof(out, seq, status);
+    return out;
+}
+
+/**
+ * @brief COM_STMT_PREPARE_OK, followed by parameters and columns definitions
+ *
+ */
+Bytes FakeServer::prepareOk(uint8_t seq, uint32_t id, const std::vector<FakeColumn_t> &columns, uint16_t paramCount)
+{
+    Bytes out, payload;
+
+    payload.push_back(0x00);
+    put_int(payload, id, 4);
+    put_int(payload, columns.size(), 2);
+    put_int(payload, paramCount, 2);
+    payload.push_back(0);
+    put_int(payload, 0, 2);
+    put_packet(out, seq, payload);
+
+    if (paramCount) {
+        for (uint16_t i = 0; i < paramCount; i++)
+            put_column(out, seq, {"?", MYSQL_TYPE_VAR_STRING, 0, 0});
+        put_eof(out, seq);
+    }
+    if (columns.size()) {
+        for (const FakeColumn_t &column : columns)
+            put_column(out, seq, column);
+        put_eof(out, seq);
+    }
+    return out;
+}
+
+/**
+ * @brief Binary result set of COM_STMT_EXECUTE, values are given as text
+ *
+ * Integers and doubles are converted to the size of the column type,
+ * dates are "YYYY-MM-DD", other values are sent as strings.
+ */
+Bytes FakeServer::binaryResultSet(uint8_t seq, const std::vector<FakeColumn_t> &columns, const std::vector<FakeRow_t> &rows)
+{
+    Bytes out, payload;
+
+    put_lenenc_int(payload, columns.size());
+    put_packet(out, seq, payload);
+    for (const FakeColumn_t &column : columns)
+        put_column(out, seq, column);
+    put_eof(out, seq);
+
+    for (const FakeRow_t &row : rows) {
+        payload.assign(1 + (columns.size() + 7 + 2) / 8, 0);
+        for (size_t col = 0; col < row.size(); col++) {
+            const char *value = row[col];
+            if (value == nullptr) {
+                payload[1 + (col + 2) / 8] |= 1 << ((col + 2) % 8);
+                continue;
+            }
+
+            switch (columns[col].type) {
+                case MYSQL_TYPE_TINY:
+                    put_int(payload, strtoll(value, nullptr, 10), 1);
+                    break;
+                case MYSQL_TYPE_SHORT:
+                    put_int(payload, strtoll(value, nullptr, 10), 2);
+                    break;
+                case MYSQL_TYPE_LONG:
+                    put_int(payload, strtoll(value, nullptr, 10), 4);
+                    break;
+                case MYSQL_TYPE_LONGLONG:
+                    put_int(payload, strtoll(value, nullptr, 10), 8);
+                    break;
+                case MYSQL_TYPE_DOUBLE: {
+                    double number = strtod(value, nullptr);
+                    uint64_t bits;
+                    memcpy(&bits, &number, 8);
+                    put_int(payload, bits, 8);
+                    break;
+                }
+                case MYSQL_TYPE_DATE: {
+                    unsigned year = 0, month = 0, day = 0;
+                    sscanf(value, "%u-%u-%u", &year, &month, &day);
+                    payload.push_back(4);
+                    put_int(payload, year, 2);
+                    payload.push_back(month);
+                    payload.push_back(day);
+                    break;
+                }
+                default:
+                    put_lenenc_string(payload, value);
+                    break;
+            }
+        }
+        put_packet(out, seq, payload);
+    }
+
+    put_eof(out, seq);
+    return out;
+}
+
+/**
+ * @brief Wrap bytes in a compressed packet without compressing them
+ *
+ */
+Bytes FakeServer::compressedPacket(uint8_t seq, const Bytes &data)
+{
+    Bytes out;
+    put_int(out, data.size(), 3);
+    out.push_back(seq);
+    put_int(out, 0, 3);
+    out.insert(out.end(), data.begin(), data.end());
+    return out;
+}
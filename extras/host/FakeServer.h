@@ -0,0 +1,188 @@
+/**
+ * @file FakeServer.h
+ * @brief In-process MySQL server for host builds, it replays scripted packet streams
+ *
+ * FakeServer is the Client given to MySQL: bytes written by the library are
+ * split in packets, and for each command packet the next scripted response
+ * is made available to read. Scripts are built with the packet helpers or
+ * loaded from a capture file (see loadCapture()).
+ */
+
+#ifndef FAKE_SERVER_H
+#define FAKE_SERVER_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include <deque>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+typedef struct {
+    const char *name;
+    uint8_t     type;
+    uint32_t    length;
+    uint16_t    flags;
+} FakeColumn_t;
+
+// Values of a row, nullptr is NULL
+typedef std::vector<const char *> FakeRow_t;
+
+class FakeServer : public Client
+{
+public:
+    /**
+     * @brief Invoked for a command packet when the script is over
+     *
+     * @param payload Payload of the command packet (command byte first)
+     * @param len Length of payload
+     * @param userData Opaque pointer given to setResponder()
+     * @return Bytes Response, sent as is
+     */
+    typedef Bytes (*Responder)(const uint8_t *payload, size_t len, void *userData);
+
+    /**
+     * @brief Bytes sent as soon as the client connects (handshake)
+     */
+    void greet(const Bytes &bytes) {
+        mGreeting = bytes;
+    }
+    /**
+     * @brief Add the response to next command packet to the script
+     */
+    void respond(const Bytes &bytes) {
+        mScript.push_back(bytes);
+    }
+    void setResponder(Responder responder, void *userData = nullptr) {
+        mResponder = responder;
+        mResponderData = userData;
+    }
+    /**
+     * @brief Packets written by client after authentication are in compressed packets
+     */
+    void setCompressed(bool enable) {
+        mCompressed = enable;
+    }
+    /**
+     * @brief Make responses arrive a few bytes at a time, 0 to send them at once
+     *
+     * Non-blocking reads (available(), read()) see at most bytes more bytes
+     * every other call of available(), so poll() finds packets split at any
+     * point. Blocking reads (readBytes()) wait for the bytes they need.
+     */
+    void setDrip(size_t bytes) {
+        mDrip = bytes;
+        mVisible = mOutPos;
+    }
+    /**
+     * @brief Load greeting and responses from a capture file
+     *
+     * Text file, one packet stream per line, '#' starts a comment:
+     *   S: 4a 00 00 00 0a 38 2e ...   bytes sent by server
+     *   C: 21 00 00 00 03 ...         a packet sent by client
+     * Server bytes before the first C: line are the greeting, the following
+     * ones are the response to the last C: line. Content of C: lines is not
+     * compared, but COM_QUIT and COM_STMT_CLOSE are skipped as the
+     * server does not reply to them.
+     *
+     * @return bool false if file can't be read or is not valid
+     */
+    bool loadCapture(const char *path);
+    /**
+     * @brief Forget script, greeting and counters
+     */
+    void reset(void);
+
+    // Counters, they can be cleared at any time
+    size_t bytesIn = 0;
+    size_t bytesOut = 0;
+    size_t packetsIn = 0;
+    size_t connects = 0;
+    uint16_t lastPort = 0;
+    // Compressed packets recieved with a sequence ID a server would reject
+    size_t sequenceErrors = 0;
+
+    /**
+     * @brief Payload of last packet written by client
+     */
+    const Bytes &lastPacket(void) {
+        return mLastPacket;
+    }
+    /**
+     * @brief Number of scripted responses not used yet
+     */
+    size_t pending(void) {
+        return mScript.size();
+    }
+
+    // Client interface
+    int connect(const char *host, uint16_t port) override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t *buf, size_t size) override;
+    int peek() override;
+    size_t readBytes(char *buffer, size_t length) override;
+    void flush() override {}
+    void stop() override;
+    uint8_t connected() override {
+        return mConnected;
+    }
+    operator bool() override {
+        return mConnected;
+    }
+    using Client::readBytes;
+
+    // Packet helpers, seq is the sequence ID of the first packet.
+    // Payloads of 16MB or more are split in more packets.
+    static Bytes packet(uint8_t seq, const Bytes &payload);
+    static Bytes handshake(uint32_t capabilities, const char *version = "8.0.36-fake", const char *plugin = "mysql_native_password");
+    static Bytes authSwitch(uint8_t seq, const char *plugin);
+    static Bytes authMoreData(uint8_t seq, uint8_t status);
+    static Bytes ok(uint8_t seq, uint64_t affectedRows = 0, uint64_t lastInsertId = 0, uint16_t status = 0x0002);
+    static Bytes err(uint8_t seq, uint16_t code, const char *sqlState, const char *message);
+    static Bytes resultSet(uint8_t seq, const std::vector<FakeColumn_t> &columns, const std::vector<FakeRow_t> &rows, uint16_t status = 0x0002);
+    static Bytes compressedPacket(uint8_t seq, const Bytes &data);
+    static Bytes prepareOk(uint8_t seq, uint32_t id, const std::vector<FakeColumn_t> &columns, uint16_t paramCount);
+    static Bytes binaryResultSet(uint8_t seq, const std::vector<FakeColumn_t> &columns, const std::vector<FakeRow_t> &rows);
+
+private:
+    Bytes mGreeting;
+    std::deque<Bytes> mScript;
+    Responder mResponder = nullptr;
+    void *mResponderData = nullptr;
+    bool mCompressed = false;
+    bool mConnected = false;
+    // Sequence ID of last compressed packet sent
+    uint8_t mZSequence = 0;
+
+    // Bytes written by client not yet parsed, and payload of compressed packets
+    Bytes mIn;
+    Bytes mPlain;
+    Bytes mLastPacket;
+
+    // Bytes to be read by client are mOut[mOutPos, end)
+    Bytes mOut;
+    size_t mOutPos = 0;
+
+    // With drip feeding only mOut[mOutPos, mVisible) can be read without waiting
+    size_t mDrip = 0;
+    size_t mVisible = 0;
+    bool mDripWait = false;
+
+    void parse_input(void);
+    void on_packet(const uint8_t *payload, size_t len);
+    void send(const Bytes &bytes);
+    size_t readable(void);
+
+    static void put_lenenc_int(Bytes &out, uint64_t value);
+    static void put_lenenc_string(Bytes &out, const char *text);
+    static void put_int(Bytes &out, uint64_t value, int size);
+    static void put_packet(Bytes &out, uint8_t &seq, const Bytes &payload);
+    static void put_column(Bytes &out, uint8_t &seq, const FakeColumn_t &column);
+    static void put_eof(Bytes &out, uint8_t &seq, uint16_t status = 0x0002);
+};
+
+#endif
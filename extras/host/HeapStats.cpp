@@ -0,0 +1,87 @@
+#include "HeapStats.h"
+
+#include <malloc.h>
+
+#ifdef MYSQL_HOST_NO_HEAP_STATS
+
+bool heapStatsEnabled(void) { return false; }
+HeapStats_t heapStats(void) { return HeapStats_t{0, 0, 0}; }
+void heapStatsResetPeak(void) {}
+
+#else
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+static HeapStats_t stats = {0, 0, 0};
+
+static void count_alloc(void *ptr)
+{
+    if (ptr == nullptr)
+        return;
+    stats.allocations++;
+    stats.liveBytes += malloc_usable_size(ptr);
+    if (stats.liveBytes > stats.peakBytes)
+        stats.peakBytes = stats.liveBytes;
+}
+
+static void count_free(void *ptr)
+{
+    if (ptr != nullptr)
+        stats.liveBytes -= malloc_usable_size(ptr);
+}
+
+// operator new and delete of libstdc++ use these too
+extern "C" void *malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    count_alloc(ptr);
+    return ptr;
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    void *ptr = __libc_calloc(count, size);
+    count_alloc(ptr);
+    return ptr;
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    count_free(ptr);
+    void *ret = __libc_realloc(ptr, size);
+    if (ret == nullptr && ptr != nullptr && size != 0) {
+        // Old block is still valid
+        stats.liveBytes += malloc_usable_size(ptr);
+        return ret;
+    }
+    count_alloc(ret);
+    return ret;
+}
+
+extern "C" void free(void *ptr)
+{
+    count_free(ptr);
+    __libc_free(ptr);
+}
+
+bool heapStatsEnabled(void)
+{
+    return true;
+}
+
+HeapStats_t heapStats(void)
+{
+    return stats;
+}
+
+void heapStatsResetPeak(void)
+{
+    stats.peakBytes = stats.liveBytes;
+}
+
+#endif
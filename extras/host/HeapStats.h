@@ -0,0 +1,24 @@
+/**
+ * @file HeapStats.h
+ * @brief Count heap allocations of the process (malloc family is wrapped)
+ *
+ * Not available with sanitizers, they wrap malloc themselves:
+ * heapStatsEnabled() is false and all counters stay 0.
+ */
+
+#ifndef HEAP_STATS_H
+#define HEAP_STATS_H
+
+#include <stddef.h>
+
+typedef struct {
+    size_t allocations;     // malloc, calloc, realloc and new calls
+    size_t liveBytes;       // bytes currently allocated
+    size_t peakBytes;       // max of liveBytes since last heapStatsResetPeak()
+} HeapStats_t;
+
+bool heapStatsEnabled(void);
+HeapStats_t heapStats(void);
+void heapStatsResetPeak(void);
+
+#endif
@@ -0,0 +1,307 @@
+/**
+ * @file mysql_bench.cpp
+ * @brief Micro-benchmarks of the protocol hot paths, run against FakeServer
+ *
+ *   mysql_bench [--quick] [--csv]
+ *
+ * Result sets are synthetic (see make_result()), so numbers can be compared
+ * between builds: keep a --csv output as baseline and diff it.
+ */
+
+#include <MySQL.h>
+#include "FakeServer.h"
+#include "HeapStats.h"
+
+#include <chrono>
+
+#define SERVER_CAPS (CLIENT_FLAGS | CLIENT_CONNECT_WITH_DB)
+
+typedef struct {
+    const char *name;
+    uint32_t    rows;
+    uint32_t    bytes;
+    double      seconds;
+    size_t      allocations;
+    size_t      peakBytes;
+    uint32_t    iterations;
+} BenchResult_t;
+
+static bool csv = false;
+static bool quick = false;
+
+static double now(void)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const BenchResult_t &r)
+{
+    double rows = (double)r.rows * r.iterations;
+    double bytes = (double)r.bytes * r.iterations;
+
+    if (csv) {
+        printf("%s,%u,%u,%.0f,%.0f,%.3f,%zu,%.3f\n", r.name, r.rows, r.bytes, rows / r.seconds, bytes / r.seconds,
+               rows ? r.allocations / rows : 0.0, r.peakBytes, r.seconds * 1e9 / r.iterations);
+        return;
+    }
+    printf("%-28s %7u %9u %12.0f %10.1f %10.3f %10zu %12.0f\n", r.name, r.rows, r.bytes,
+           rows / r.seconds, bytes / r.seconds / 1e6, rows ? r.allocations / rows : 0.0, r.peakBytes,
+           r.seconds * 1e9 / r.iterations);
+}
+
+/**
+ * @brief Result set of rows x columns, values of 1 to 16 chars and some NULL
+ *
+ */
+static Bytes make_result(uint32_t rows, uint16_t columns, std::vector<std::string> &values)
+{
+    static char names[64][12];
+    std::vector<FakeColumn_t> cols;
+    for (uint16_t c = 0; c < columns; c++) {
+        snprintf(names[c], sizeof(names[c]), "col%u", c);
+        cols.push_back({names[c], (uint8_t)(c % 2 ? MYSQL_TYPE_VAR_STRING : MYSQL_TYPE_LONG), 16, 0});
+    }
+
+    values.clear();
+    values.reserve(rows * columns);
+    for (uint32_t r = 0; r < rows; r++) {
+        for (uint16_t c = 0; c < columns; c++) {
+            if (c % 2)
+                values.push_back(std::string("value-") + std::to_string(r * 31 + c).substr(0, 10));
+            else
+                values.push_back(std::to_string(r * columns + c));
+        }
+    }
+
+    std::vector<FakeRow_t> data(rows);
+    for (uint32_t r = 0; r < rows; r++) {
+        for (uint16_t c = 0; c < columns; c++) {
+            bool null = (c % 2) && ((r + c) % 7 == 0);
+            data[r].push_back(null ? nullptr : values[r * columns + c].c_str());
+        }
+    }
+    return FakeServer::resultSet(1, cols, data);
+}
+
+static void count_row(const Row_t &row, void *userData)
+{
+    (*(uint32_t *)userData) += row.count();
+}
+
+/**
+ * @brief Run query() or queryStream() on the same result set until 0.2s are elapsed
+ *
+ */
+static void bench_query(MySQL &sql, FakeServer &server, uint32_t rows, uint16_t columns, bool stream)
+{
+    std::vector<std::string> values;
+    Bytes result = make_result(rows, columns, values);
+    char name[48];
+    snprintf(name, sizeof(name), "%s %ux%u", stream ? "queryStream" : "query", rows, columns);
+
+    BenchResult_t r = {name, rows, (uint32_t)result.size(), 0, 0, 0, 0};
+    double limit = quick ? 0.02 : 0.2;
+    double start = now();
+    do {
+        server.respond(result);
+        HeapStats_t before = heapStats();
+        heapStatsResetPeak();
+
+        if (stream) {
+            uint32_t cells = 0;
+            sql.queryStream("SELECT", count_row, &cells);
+        }
+        else {
+            DataQuery_t data;
+            sql.query(data, "SELECT");
+        }
+
+        HeapStats_t after = heapStats();
+        r.allocations += after.allocations - before.allocations;
+        if (after.peakBytes - before.liveBytes > r.peakBytes)
+            r.peakBytes = after.peakBytes - before.liveBytes;
+        r.iterations++;
+        r.seconds = now() - start;
+    } while (r.seconds < limit);
+
+    report(r);
+}
+
+static void bench_lenenc_int(void)
+{
+    // Mix of 1, 3, 4 and 9 bytes encodings
+    Bytes buffer;
+    for (int i = 0; i < 4096; i++) {
+        uint8_t tmp[9];
+        uint64_t value = (i % 4 == 0) ? 200 : (i % 4 == 1) ? 60000 : (i % 4 == 2) ? 0xABCDEF : 0x123456789ULL;
+        if (value < 251) {
+            buffer.push_back(value);
+            continue;
+        }
+        int len = (value < 0x10000) ? 2 : (value < 0x1000000) ? 3 : 8;
+        buffer.push_back(len == 2 ? 0xFC : len == 3 ? 0xFD : 0xFE);
+        memcpy(tmp, &value, len);
+        buffer.insert(buffer.end(), tmp, tmp + len);
+    }
+
+    BenchResult_t r = {"readLenEncInt x4096", 0, (uint32_t)buffer.size(), 0, 0, 0, 0};
+    uint64_t sum = 0;
+    double start = now();
+    do {
+        int offset = 0;
+        uint8_t size;
+        while (offset < (int)buffer.size()) {
+            sum += readLenEncInt(buffer.data(), offset, &size);
+            offset += size;
+        }
+        r.iterations++;
+        r.seconds = now() - start;
+    } while (r.seconds < (quick ? 0.02 : 0.2));
+
+    report(r);
+    if (sum == 42)
+        printf("\n");
+}
+
+static void bench_lenenc_string(void)
+{
+    Bytes buffer;
+    for (int i = 0; i < 1024; i++) {
+        char text[32];
+        int len = snprintf(text, sizeof(text), "value number %d", i);
+        buffer.push_back(len);
+        buffer.insert(buffer.end(), text, text + len);
+    }
+
+    BenchResult_t r = {"readLenEncString x1024", 0, (uint32_t)buffer.size(), 0, 0, 0, 0};
+    char value[32];
+    double start = now();
+    do {
+        int offset = 0;
+        uint8_t size;
+        while (offset < (int)buffer.size()) {
+            offset += readLenEncString(value, buffer.data(), offset, &size);
+            offset += size;
+        }
+        r.iterations++;
+        r.seconds = now() - start;
+    } while (r.seconds < (quick ? 0.02 : 0.2));
+
+    report(r);
+}
+
+static Bytes respond_ok(const uint8_t *, size_t, void *)
+{
+    return FakeServer::ok(2);
+}
+
+/**
+ * @brief changeUser() on the open connection, it runs MySQL::scramble_password():
+ * 3x SHA1 when the password changes, 2x SHA1 when stage 2 of the same password is reused
+ *
+ */
+static void bench_scramble(MySQL &sql, FakeServer &server, bool cached)
+{
+    BenchResult_t r = {cached ? "changeUser cached (2x SHA1)" : "changeUser (3x SHA1)", 0, 0, 0, 0, 0, 0};
+    const char *passwords[2] = {"dbpassword", "dbpassworx"};
+
+    server.setResponder(respond_ok);
+    double start = now();
+    do {
+        sql.changeUser("user", passwords[cached ? 0 : r.iterations % 2], "db");
+        r.iterations++;
+        r.seconds = now() - start;
+    } while (r.seconds < (quick ? 0.02 : 0.2));
+    server.setResponder(nullptr);
+
+    report(r);
+}
+
+// Print destination that drops everything
+class NullPrint : public Print
+{
+public:
+    size_t write(uint8_t) override { return 1; }
+    size_t write(const uint8_t *, size_t size) override { return size; }
+};
+
+static void bench_print_result(MySQL &sql, FakeServer &server, uint32_t rows, uint16_t columns)
+{
+    std::vector<std::string> values;
+    server.respond(make_result(rows, columns, values));
+    DataQuery_t data;
+    sql.query(data, "SELECT");
+
+    char name[48];
+    snprintf(name, sizeof(name), "printResult %ux%u", rows, columns);
+    BenchResult_t r = {name, rows, 0, 0, 0, 0, 0};
+    NullPrint sink;
+    double start = now();
+    do {
+        HeapStats_t before = heapStats();
+        sql.printResult(data, sink);
+        r.allocations += heapStats().allocations - before.allocations;
+        r.iterations++;
+        r.seconds = now() - start;
+    } while (r.seconds < (quick ? 0.02 : 0.2));
+
+    report(r);
+}
+
+static void bench_connect(MySQL &sql, FakeServer &server)
+{
+    BenchResult_t r = {"connect", 0, 0, 0, 0, 0, 0};
+    server.respond(FakeServer::ok(2));
+    double start = now();
+    HeapStats_t before = heapStats();
+    sql.connect("user", "password", "db");
+    r.seconds = now() - start;
+    r.allocations = heapStats().allocations - before.allocations;
+    r.iterations = 1;
+    report(r);
+}
+
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else if (strcmp(argv[i], "--quick") == 0)
+            quick = true;
+    }
+
+    // Library logs would be part of the timings
+    Serial.mute(true);
+
+    if (csv)
+        printf("name,rows,bytes,rows_per_s,bytes_per_s,allocs_per_row,peak_heap,ns_per_op\n");
+    else
+        printf("%-28s %7s %9s %12s %10s %10s %10s %12s\n", "benchmark", "rows", "bytes",
+               "rows/s", "MB/s", "allocs/row", "peak heap", "ns/op");
+    if (!heapStatsEnabled())
+        printf("# heap statistics not available in this build\n");
+
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    bench_connect(sql, server);
+
+    bench_lenenc_int();
+    bench_lenenc_string();
+    bench_scramble(sql, server, false);
+    bench_scramble(sql, server, true);
+
+    static const uint32_t row_counts[] = {10, 1000, 10000};
+    static const uint16_t column_counts[] = {2, 8, 32};
+    for (uint32_t rows : row_counts) {
+        if (quick && rows > 1000)
+            continue;
+        for (uint16_t columns : column_counts) {
+            bench_query(sql, server, rows, columns, false);
+            bench_query(sql, server, rows, columns, true);
+        }
+    }
+    bench_print_result(sql, server, 100, 8);
+    return 0;
+}
@@ -0,0 +1,1086 @@
+/**
+ * @file mysql_replay.cpp
+ * @brief Run the library against FakeServer on a host
+ *
+ *   mysql_replay                               built-in scenarios, exit code 1 on failure
+ *   mysql_replay [-z] capture.txt "query"...   replay a capture and print the results
+ *
+ * -z requests the compressed protocol (the capture must be compressed too).
+ */
+
+#include <MySQL.h>
+#include <MySQLPool.h>
+#include "FakeServer.h"
+
+#define SERVER_CAPS (CLIENT_FLAGS | CLIENT_CONNECT_WITH_DB)
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+
+static void scenario_lenenc(void)
+{
+    // Values after a one byte prefix, as in a packet
+    const uint8_t one[] = {0x00, 0xFA};
+    const uint8_t null_marker[] = {0x00, 0xFB, 0x41};
+    const uint8_t two[] = {0x00, 0xFC, 0x34, 0x12};
+    const uint8_t three[] = {0x00, 0xFD, 0x56, 0x34, 0x12};
+    const uint8_t eight[] = {0x00, 0xFE, 0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01};
+    uint8_t size = 0;
+
+    CHECK(readLenEncInt(one, 1, &size) == 250 && size == 1);
+    CHECK(readLenEncInt(null_marker, 1, &size) == LENENC_NULL && size == 1);
+    CHECK(readLenEncInt(two, 1, &size) == 0x1234 && size == 3);
+    CHECK(readLenEncInt(three, 1, &size) == 0x123456 && size == 4);
+    CHECK(readLenEncInt(eight, 1, &size) == 0x0102030405060708ULL && size == 9);
+    CHECK(readLenEncInt(two, 1) == 0x1234);
+
+    // Strings: NULL is empty and takes only its marker
+    const uint8_t text[] = {0x00, 0x03, 'a', 'b', 'c', 0xFB};
+    char buf[8];
+    CHECK(skipLenEncString(text, 1) == 4);
+    CHECK(skipLenEncString(text, 5) == 1);
+    CHECK(readLenEncString(buf, text, 1, &size) == 3 && size == 1 && strcmp(buf, "abc") == 0);
+    CHECK(readLenEncString(buf, text, 5, &size) == 0 && size == 1 && buf[0] == '\0');
+
+    Bytes long_text = {0xFC, 0x2C, 0x01};
+    long_text.resize(3 + 300, 'x');
+    CHECK(skipLenEncString(long_text.data(), 0) == 303);
+}
+
+static void scenario_query(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+
+    std::vector<FakeColumn_t> columns = {
+        {"gpio", MYSQL_TYPE_LONG, 11, NOT_NULL_FLAG},
+        {"label", MYSQL_TYPE_VAR_STRING, 64, 0},
+        {"state", MYSQL_TYPE_TINY, 1, 0}
+    };
+    server.respond(FakeServer::resultSet(1, columns, {{"2", "led", "1"}, {"4", nullptr, "0"}}));
+
+    DataQuery_t data;
+    CHECK(sql.query(data, "SELECT * FROM gpios"));
+    CHECK(data.fieldCount == 3);
+    CHECK(data.recordCount == 2);
+    CHECK(data.getInt(1, "gpio") == 4);
+    CHECK(strcmp(data.getRowValue(0, "label"), "led") == 0);
+    CHECK(data.isNull(1, "label"));
+
+    // Error packet
+    server.respond(FakeServer::err(1, 1146, "42S02", "Table 'db.nope' doesn't exist"));
+    CHECK(!sql.query(data, "SELECT * FROM nope"));
+    CHECK(strcmp(sql.getLastSQLSTATE(), "42S02") == 0);
+
+    // Values are escaped in the packet sent
+    server.respond(FakeServer::ok(1, 1, 7));
+    CHECK(sql.queryf(data, "INSERT INTO %I VALUES (%d, %s)", "gpios", 5, "it's"));
+    const Bytes &sent = server.lastPacket();
+    const char expected[] = "\x03INSERT INTO `gpios` VALUES (5, 'it\\'s')";
+    CHECK(sent.size() == sizeof(expected) - 1 && memcmp(sent.data(), expected, sent.size()) == 0);
+    CHECK(sql.getAffectedRows() == 1);
+    CHECK(sql.getLastInsertId() == 7);
+
+    // More rows than a 16-bit counter
+    std::vector<FakeRow_t> many(70000, FakeRow_t{"7"});
+    many.back() = FakeRow_t{"8"};
+    server.respond(FakeServer::resultSet(1, {{"n", MYSQL_TYPE_LONG, 11, 0}}, many));
+    CHECK(sql.query(data, "SELECT n FROM big"));
+    CHECK(data.recordCount == 70000);
+    CHECK(data.getInt(69999, 0) == 8);
+
+    // Column name is the NULL marker: result dropped, session still usable
+    Bytes bad = FakeServer::packet(1, {0x01});
+    Bytes def = FakeServer::packet(2, {0x03, 'd', 'e', 'f', 0x00, 0x00, 0x00, 0xFB, 0x00, 0x0C, 0x21, 0x00,
+                                       0x0B, 0x00, 0x00, 0x00, MYSQL_TYPE_LONG, 0x00, 0x00, 0x00, 0x00, 0x00});
+    Bytes eof = FakeServer::packet(3, {0xFE, 0x00, 0x00, 0x02, 0x00});
+    Bytes row = FakeServer::packet(4, {0x01, '1'});
+    Bytes end = FakeServer::packet(5, {0xFE, 0x00, 0x00, 0x02, 0x00});
+    for (const Bytes *part : {&def, &eof, &row, &end})
+        bad.insert(bad.end(), part->begin(), part->end());
+    server.respond(bad);
+    CHECK(!sql.query(data, "SELECT 1"));
+    CHECK(strcmp(sql.getLastError(), "Column definition not valid") == 0);
+    CHECK(data.fieldCount == 0);
+
+    // Value lengths past the end of the row, also when they wrap 32 bits: query fails
+    std::vector<FakeColumn_t> one = {{"a", MYSQL_TYPE_VAR_STRING, 16, 0}};
+    for (const Bytes &payload : {Bytes{0x05, 'a', 'b'}, Bytes{0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 'a'}, Bytes{0xFC, 0x01}}) {
+        bad = FakeServer::resultSet(1, one, {});
+        bad.resize(bad.size() - 9);
+        Bytes row_ok = FakeServer::packet(4, {0x01, 'x'});
+        Bytes row_bad = FakeServer::packet(5, payload);
+        Bytes end_ok = FakeServer::packet(6, {0xFE, 0x00, 0x00, 0x02, 0x00});
+        for (const Bytes *part : {&row_ok, &row_bad, &end_ok})
+            bad.insert(bad.end(), part->begin(), part->end());
+        server.respond(bad);
+        CHECK(!sql.query(data, "SELECT a FROM t"));
+        CHECK(strcmp(sql.getLastError(), "Row not valid") == 0);
+        CHECK(data.recordCount == 1);
+    }
+
+    server.respond(FakeServer::ok(1));
+    CHECK(sql.ping());
+    CHECK(server.pending() == 0);
+}
+
+static void sum_lengths(const Row_t &row, void *userData)
+{
+    *(uint32_t *)userData += row.getLength(0);
+}
+
+static void scenario_large_packet(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+
+    // Row larger than the buffer but within MYSQL_MAX_PACKET_SIZE
+    std::string fits(BUFF_SIZE + 100, 'a');
+    std::string huge(MYSQL_MAX_PACKET_SIZE + 1, 'b');
+    std::vector<FakeColumn_t> columns = {{"blob", MYSQL_TYPE_BLOB, 0xFFFFFF, 0}};
+    uint32_t total = 0;
+    server.respond(FakeServer::resultSet(1, columns, {{"x"}, {fits.c_str()}}));
+    CHECK(sql.queryStream("SELECT blob FROM t", sum_lengths, &total));
+    CHECK(total == fits.size() + 1);
+
+    // Larger rows are dropped, next ones are read and the query fails
+    total = 0;
+    server.respond(FakeServer::resultSet(1, columns, {{"x"}, {huge.c_str()}, {"y"}}));
+    CHECK(!sql.queryStream("SELECT blob FROM t", sum_lengths, &total));
+    CHECK(strcmp(sql.getLastError(), "Packet larger than MYSQL_MAX_PACKET_SIZE") == 0);
+    CHECK(total == 2);
+
+    // Row of 16MB or more is split in packets, all of them are dropped
+    std::string split(0xFFFFFF, 'c');
+    total = 0;
+    server.respond(FakeServer::resultSet(1, columns, {{split.c_str()}, {"z"}}));
+    CHECK(!sql.queryStream("SELECT blob FROM t", sum_lengths, &total));
+    CHECK(strcmp(sql.getLastError(), "Packet larger than MYSQL_MAX_PACKET_SIZE") == 0);
+    CHECK(total == 1);
+
+    server.respond(FakeServer::ok(1));
+    CHECK(sql.ping());
+    CHECK(server.pending() == 0);
+}
+
+static void scenario_prepared(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+    PreparedStatement stmt(&sql);
+
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+
+    std::vector<FakeColumn_t> columns = {
+        {"id", MYSQL_TYPE_LONG, 11, NOT_NULL_FLAG},
+        {"name", MYSQL_TYPE_VAR_STRING, 32, 0},
+        {"born", MYSQL_TYPE_DATE, 10, 0}
+    };
+    server.respond(FakeServer::prepareOk(1, 7, columns, 1));
+    CHECK(stmt.prepare("SELECT id, name, born FROM people WHERE id > ?"));
+    CHECK(stmt.getParamCount() == 1);
+    CHECK(stmt.getFieldCount() == 3);
+    CHECK(strcmp(stmt.getFieldName(2), "born") == 0);
+
+    // Binary rows, temporal values are not numbers
+    std::vector<FakeRow_t> rows = {{"2", "ann", "1990-05-17"}, {"3", nullptr, "2001-01-02"}};
+    server.respond(FakeServer::binaryResultSet(1, columns, rows));
+    CHECK(stmt.bindInt(0, 1000));
+    CHECK(stmt.execute());
+    const uint8_t execute[] = {0x17, 7, 0, 0, 0, 0x00, 1, 0, 0, 0, 0x00, 1, MYSQL_TYPE_SHORT, 0x00, 0xE8, 0x03};
+    CHECK(server.lastPacket().size() == sizeof(execute));
+    CHECK(memcmp(server.lastPacket().data(), execute, sizeof(execute)) == 0);
+
+    CHECK(stmt.next());
+    CHECK(stmt.getInt(0) == 2);
+    char name[8];
+    CHECK(stmt.copyValue(1, name, sizeof(name)) == 3 && strcmp(name, "ann") == 0);
+    CHECK(stmt.getLength(2) == 4);
+    CHECK(stmt.getInt(2) == 0);
+    CHECK(stmt.next());
+    CHECK(stmt.getInt(0) == 3);
+    CHECK(stmt.isNull(1));
+    CHECK(!stmt.next());
+
+    // Rows not read are dropped by close(), COM_STMT_CLOSE has no response
+    server.respond(FakeServer::binaryResultSet(1, columns, rows));
+    CHECK(stmt.execute());
+    CHECK(stmt.next());
+    CHECK(stmt.close());
+    CHECK(server.lastPacket().size() == 5 && server.lastPacket()[0] == 0x19 && server.lastPacket()[1] == 7);
+    CHECK(!stmt.execute());
+
+    // Rows not read are dropped before another command
+    server.respond(FakeServer::prepareOk(1, 10, columns, 0));
+    CHECK(stmt.prepare("SELECT id, name, born FROM people"));
+    server.respond(FakeServer::binaryResultSet(1, columns, rows));
+    CHECK(stmt.execute());
+    CHECK(stmt.next());
+    server.respond(FakeServer::ok(1));
+    CHECK(sql.ping());
+    CHECK(!stmt.next());
+
+    // Row shorter than its NULL bitmap: result is dropped up to EOF
+    Bytes result = FakeServer::binaryResultSet(1, columns, {});
+    result.resize(result.size() - 9);
+    Bytes short_row = FakeServer::packet(6, {0x00});
+    Bytes last_row = FakeServer::packet(7, {0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 'a', 0x04, 0xD0, 0x07, 0x01, 0x01});
+    Bytes end = FakeServer::packet(8, {0xFE, 0x00, 0x00, 0x02, 0x00});
+    for (const Bytes *part : {&short_row, &last_row, &end})
+        result.insert(result.end(), part->begin(), part->end());
+    server.respond(result);
+    CHECK(stmt.execute());
+    CHECK(!stmt.next());
+    CHECK(strcmp(sql.getLastError(), "Row not valid") == 0);
+    server.respond(FakeServer::ok(1));
+    CHECK(sql.ping());
+    CHECK(stmt.close());
+
+    server.respond(FakeServer::err(1, 1146, "42S02", "Table 'db.nope' doesn't exist"));
+    CHECK(!stmt.prepare("SELECT * FROM nope"));
+    CHECK(strcmp(sql.getLastSQLSTATE(), "42S02") == 0);
+
+    // Statement with a definition not valid is released on server
+    server.respond(FakeServer::prepareOk(1, 8, {{nullptr, MYSQL_TYPE_LONG, 11, 0}}, 0));
+    CHECK(!stmt.prepare("SELECT 1"));
+    CHECK(strcmp(sql.getLastError(), "Column definition not valid") == 0);
+    CHECK(server.lastPacket().size() == 5 && server.lastPacket()[0] == 0x19 && server.lastPacket()[1] == 8);
+
+    // A row too large ends the result, session is still usable
+    std::string huge(MYSQL_MAX_PACKET_SIZE + 1, 'x');
+    std::vector<FakeColumn_t> blob = {{"data", MYSQL_TYPE_BLOB, 0xFFFF, 0}};
+    server.respond(FakeServer::prepareOk(1, 9, blob, 0));
+    CHECK(stmt.prepare("SELECT data FROM files"));
+    server.respond(FakeServer::binaryResultSet(1, blob, {{"a"}, {huge.c_str()}, {"b"}}));
+    CHECK(stmt.execute());
+    CHECK(stmt.next());
+    CHECK(stmt.getLength(0) == 1);
+    CHECK(!stmt.next());
+    CHECK(strcmp(sql.getLastError(), "Packet larger than MYSQL_MAX_PACKET_SIZE") == 0);
+    CHECK(stmt.close());
+
+    server.respond(FakeServer::ok(1));
+    CHECK(sql.ping());
+    CHECK(server.pending() == 0);
+}
+
+typedef struct {
+    int calls;
+    bool success;
+    uint32_t rows;
+} AsyncResult_t;
+
+static void on_done(MySQL *, bool success, void *userData)
+{
+    AsyncResult_t *result = (AsyncResult_t *)userData;
+    result->calls++;
+    result->success = success;
+}
+
+static void count_row(const Row_t &row, void *userData)
+{
+    ((AsyncResult_t *)userData)->rows += row.getInt(0);
+}
+
+static void scenario_async(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+
+    // Response arrives 5 bytes at a time, poll() reads what is there and returns
+    std::vector<FakeColumn_t> columns = {{"id", MYSQL_TYPE_LONG, 11, 0}, {"label", MYSQL_TYPE_VAR_STRING, 16, 0}};
+    std::vector<FakeRow_t> rows = {{"1", "one"}, {"2", "two"}, {"3", nullptr}};
+    server.setDrip(5);
+    server.respond(FakeServer::resultSet(1, columns, rows));
+
+    DataQuery_t data;
+    AsyncResult_t result = {0, false, 0};
+    CHECK(sql.beginQuery(data, "SELECT id, label FROM t", on_done, &result));
+    int polls = 0;
+    while (sql.poll())
+        polls++;
+    CHECK(polls > 10);
+    CHECK(result.calls == 1 && result.success);
+    CHECK(data.recordCount == 3);
+    CHECK(strcmp(data.getRowValue(1, "label"), "two") == 0);
+    CHECK(data.isNull(2, "label"));
+
+    // Rows streamed one byte at a time
+    server.setDrip(1);
+    server.respond(FakeServer::resultSet(1, columns, rows));
+    result = {0, false, 0};
+    CHECK(sql.beginQuery("SELECT id, label FROM t", count_row, on_done, &result));
+    while (sql.poll()) {;}
+    CHECK(result.calls == 1 && result.success);
+    CHECK(result.rows == 6);
+
+    // Errors are reported to onDone
+    server.respond(FakeServer::err(1, 1146, "42S02", "Table 'db.nope' doesn't exist"));
+    result = {0, false, 0};
+    CHECK(sql.beginQuery(data, "SELECT * FROM nope", on_done, &result));
+    while (sql.poll()) {;}
+    CHECK(result.calls == 1 && !result.success);
+    CHECK(strcmp(sql.getLastSQLSTATE(), "42S02") == 0);
+
+    // Blocking reads wait for the bytes still missing
+    server.respond(FakeServer::resultSet(1, columns, rows));
+    CHECK(sql.query(data, "SELECT id, label FROM t"));
+    CHECK(data.recordCount == 3);
+
+    server.setDrip(0);
+    server.respond(FakeServer::ok(1));
+    CHECK(sql.ping());
+    CHECK(server.pending() == 0);
+}
+
+static void scenario_batch(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+
+    // All queries are sent before reading, a failed one does not stop the others
+    std::vector<FakeColumn_t> columns = {{"id", MYSQL_TYPE_LONG, 11, 0}};
+    server.respond(FakeServer::resultSet(1, columns, {{"1"}, {"2"}}));
+    server.respond(FakeServer::err(1, 1146, "42S02", "Table 'db.nope' doesn't exist"));
+    server.respond(FakeServer::ok(1, 1, 5));
+    server.respond(FakeServer::resultSet(1, columns, {{"4"}, {"5"}, {"6"}}));
+    server.setDrip(3);
+
+    DataQuery_t data;
+    AsyncResult_t streamed = {0, false, 0};
+    BatchQuery_t batch[4] = {
+        {"SELECT id FROM t", &data, nullptr, nullptr, false, 0, 0},
+        {"SELECT id FROM nope", nullptr, nullptr, nullptr, false, 0, 0},
+        {"INSERT INTO t () VALUES ()", nullptr, nullptr, nullptr, false, 0, 0},
+        {"SELECT id FROM u", nullptr, count_row, &streamed, false, 0, 0}
+    };
+    size_t packets = server.packetsIn;
+    CHECK(!sql.queryBatch(batch, 4));
+    CHECK(server.packetsIn == packets + 4);
+    CHECK(batch[0].success && data.recordCount == 2 && data.getInt(1, 0) == 2);
+    CHECK(!batch[1].success);
+    CHECK(batch[2].success && batch[2].affectedRows == 1 && batch[2].lastInsertId == 5);
+    CHECK(batch[3].success && streamed.rows == 15);
+    server.setDrip(0);
+
+    const char *const queries[] = {"SELECT id FROM t", "SELECT id FROM u"};
+    DataQuery_t results[2];
+    server.respond(FakeServer::resultSet(1, columns, {{"1"}}));
+    server.respond(FakeServer::resultSet(1, columns, {{"2"}, {"3"}}));
+    CHECK(sql.queryBatch(queries, results, 2));
+    CHECK(results[0].recordCount == 1 && results[1].recordCount == 2);
+    CHECK(results[1].getInt(1, 0) == 3);
+    CHECK(server.pending() == 0);
+}
+
+typedef struct {
+    size_t maxPayload;
+    bool fail;
+} BulkServer_t;
+
+// OK with one affected row for each row of the INSERT
+static Bytes respond_insert(const uint8_t *payload, size_t len, void *userData)
+{
+    BulkServer_t *state = (BulkServer_t *)userData;
+    if (len > state->maxPayload)
+        state->maxPayload = len;
+    if (state->fail)
+        return FakeServer::err(1, 1062, "23000", "Duplicate entry");
+
+    uint64_t rows = 0;
+    for (size_t i = 0; i < len; i++)
+        rows += (payload[i] == '(');
+    return FakeServer::ok(1, rows);
+}
+
+static void scenario_bulk_insert(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+    BulkInserter bulk(&sql);
+    BulkServer_t state = {0, false};
+
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+    server.setResponder(respond_insert, &state);
+
+    // Statements are sent when the next row does not fit in maxPacket
+    bulk.setMaxPacket(64);
+    CHECK(bulk.begin("INSERT INTO t VALUES "));
+    for (int i = 0; i < 20; i++)
+        CHECK(bulk.addRow(i, "it's", nullptr));
+    CHECK(bulk.end());
+    CHECK(bulk.getRowCount() == 20);
+    CHECK(bulk.getAffectedRows() == 20);
+    CHECK(bulk.getStatementCount() > 1);
+    CHECK(state.maxPayload <= 64);
+    const Bytes &sent = server.lastPacket();
+    const char *tail = "(19,'it\\'s',NULL)";
+    CHECK(sent.size() > strlen(tail) && memcmp(sent.data() + sent.size() - strlen(tail), tail, strlen(tail)) == 0);
+
+    // A row larger than a statement is refused
+    std::string text(100, 'a');
+    CHECK(bulk.begin("INSERT INTO t VALUES "));
+    CHECK(!bulk.addRow(1, text.c_str()));
+    CHECK(bulk.end());
+    CHECK(bulk.getStatementCount() == 0);
+
+    // Errors are reported by end(), rows go on being sent
+    state.fail = true;
+    size_t packets = server.packetsIn;
+    CHECK(bulk.begin("INSERT INTO t VALUES "));
+    for (int i = 0; i < 20; i++)
+        bulk.addRow(i, "it's", nullptr);
+    CHECK(!bulk.end());
+    CHECK(server.packetsIn - packets == bulk.getStatementCount());
+    CHECK(bulk.getAffectedRows() == 0);
+
+    server.setResponder(nullptr);
+    server.respond(FakeServer::ok(1));
+    CHECK(sql.ping());
+    CHECK(server.pending() == 0);
+}
+
+static void scenario_pool(void)
+{
+    FakeServer first, second;
+    MySQLPool pool("127.0.0.1", 3306);
+
+    CHECK(pool.addClient(&first));
+    CHECK(pool.addClient(&second));
+    CHECK(pool.size() == 2);
+    pool.begin("user", "password", "db");
+    first.greet(FakeServer::handshake(SERVER_CAPS));
+    second.greet(FakeServer::handshake(SERVER_CAPS));
+
+    // Sessions are opened only when needed
+    first.respond(FakeServer::ok(2));
+    MySQL *a = pool.acquire();
+    CHECK(a != nullptr);
+    CHECK(first.connects == 1 && second.connects == 0);
+    second.respond(FakeServer::ok(2));
+    MySQL *b = pool.acquire();
+    CHECK(b != nullptr && b != a);
+    CHECK(pool.acquire() == nullptr);
+    CHECK(pool.available() == 0);
+
+    // Released session is reused without a new connection
+    pool.release(a);
+    CHECK(pool.available() == 1);
+    CHECK(pool.acquire() == a);
+    CHECK(first.connects == 1);
+    pool.release(a);
+    pool.release(b);
+
+    // Idle sessions are pinged, a session running a query is skipped
+    pool.setPingInterval(0);
+    std::vector<FakeColumn_t> columns = {{"id", MYSQL_TYPE_LONG, 11, 0}};
+    DataQuery_t data;
+    second.respond(FakeServer::resultSet(1, columns, {{"1"}}));
+    CHECK(b->beginQuery(data, "SELECT id FROM t", nullptr));
+    first.respond(FakeServer::ok(1));
+    size_t packets = second.packetsIn;
+    pool.maintain();
+    CHECK(first.pending() == 0);
+    CHECK(second.packetsIn == packets);
+    first.respond(FakeServer::ok(1));
+    CHECK(pool.acquire() == a);
+    while (b->poll()) {;}
+    CHECK(data.recordCount == 1);
+
+    // Lost session is opened again
+    second.stop();
+    second.respond(FakeServer::ok(2));
+    CHECK(pool.acquire() == b);
+    CHECK(second.connects == 2);
+    CHECK(pool.available() == 0);
+
+    pool.release(a);
+    pool.release(b);
+    pool.closeIdle();
+    CHECK(!first.connected() && !second.connected());
+    CHECK(first.pending() == 0 && second.pending() == 0);
+}
+
+static void scenario_login(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+
+    // Packets are read by length, login does not wait any socket timeout
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    server.respond(FakeServer::ok(2));
+    uint32_t start = millis();
+    CHECK(sql.connect("user", "password", "db"));
+    CHECK(millis() - start < 100);
+
+    // Scrambled password (offset 38 of auth packet), same with digests kept from first login
+    static const uint8_t scramble[20] = {
+        0x7d, 0x67, 0xbb, 0x18, 0xc0, 0xf1, 0xce, 0xb5, 0x95, 0x62,
+        0xb2, 0xf3, 0x64, 0x59, 0xb4, 0xb4, 0x89, 0x56, 0x72, 0x52
+    };
+    static const uint8_t scramble_other[20] = {
+        0x93, 0x72, 0x7d, 0xfe, 0x18, 0x4b, 0xcb, 0x87, 0xaa, 0xde,
+        0x3f, 0x07, 0x7d, 0xa5, 0xa5, 0xa5, 0x55, 0x68, 0xca, 0xb2
+    };
+    const Bytes &auth = server.lastPacket();
+    CHECK(auth.size() == 83 && auth[37] == 20 && memcmp(auth.data() + 38, scramble, 20) == 0);
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+    CHECK(memcmp(server.lastPacket().data() + 38, scramble, 20) == 0);
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "other", "db"));
+    CHECK(memcmp(server.lastPacket().data() + 38, scramble_other, 20) == 0);
+
+    // Empty password is an auth response of length 0
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "", "db"));
+    CHECK(server.lastPacket().size() == 63 && server.lastPacket()[37] == 0);
+    CHECK(strcmp((const char *)server.lastPacket().data() + 38, "db") == 0);
+
+    server.respond(FakeServer::err(2, 1045, "28000", "Access denied for user 'user'"));
+    CHECK(!sql.connect("user", "wrong", "db"));
+    CHECK(strcmp(sql.getLastSQLSTATE(), "28000") == 0);
+    CHECK(!server.connected());
+
+    // Server refusing the connection sends an ERR packet in place of handshake
+    server.greet(FakeServer::err(0, 1040, "08004", "Too many connections"));
+    CHECK(!sql.connect("user", "password", "db"));
+    CHECK(strcmp(sql.getLastSQLSTATE(), "08004") == 0);
+
+    // Handshake too short
+    Bytes greeting = FakeServer::handshake(SERVER_CAPS);
+    server.greet(FakeServer::packet(0, Bytes(greeting.begin() + 4, greeting.begin() + 30)));
+    CHECK(!sql.connect("user", "password", "db"));
+    CHECK(server.pending() == 0);
+}
+
+static void scenario_caching_sha2(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+
+    // SHA256(SHA256(SHA256(password)) + seed) XOR SHA256(password)
+    static const uint8_t scramble[32] = {
+        0xe4, 0xb4, 0xcf, 0xd4, 0x2b, 0xd8, 0x12, 0xf4, 0x0a, 0xc7, 0x3e, 0x7b, 0x36, 0x12, 0xe1, 0x18,
+        0xee, 0x21, 0x70, 0x10, 0xb7, 0xe8, 0x2f, 0x5d, 0x3f, 0xfb, 0xf4, 0x55, 0x77, 0xda, 0xa4, 0x00
+    };
+
+    // Fast auth: scramble in the first packet, server replies 0x03 and OK
+    Bytes reply = FakeServer::authMoreData(2, 0x03);
+    Bytes ok = FakeServer::ok(3);
+    reply.insert(reply.end(), ok.begin(), ok.end());
+    server.greet(FakeServer::handshake(SERVER_CAPS, "8.0.36-fake", "caching_sha2_password"));
+    server.respond(reply);
+    CHECK(sql.connect("user", "password", "db"));
+    const Bytes &auth = server.lastPacket();
+    CHECK(auth.size() == 38 + 32 + 3 + 22 && auth[37] == 32 && memcmp(auth.data() + 38, scramble, 32) == 0);
+    CHECK(strcmp((const char *)auth.data() + 38 + 32 + 3, "caching_sha2_password") == 0);
+    CHECK(server.packetsIn == 1);
+
+    // User not in server cache
+    server.respond(FakeServer::authMoreData(2, 0x04));
+    CHECK(!sql.connect("user", "password", "db"));
+    CHECK(strcmp(sql.getLastError(), "Full authentication needs TLS, not supported") == 0);
+
+    // Server default is native, account uses caching_sha2_password: one more round trip
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    server.respond(FakeServer::authSwitch(2, "caching_sha2_password"));
+    server.respond(FakeServer::ok(4));
+    CHECK(sql.connect("user", "password", "db"));
+    CHECK(server.packetsIn == 2);
+    CHECK(server.lastPacket().size() == 32 && memcmp(server.lastPacket().data(), scramble, 32) == 0);
+
+    server.respond(FakeServer::authSwitch(2, "sha256_password"));
+    CHECK(!sql.connect("user", "password", "db"));
+    CHECK(server.pending() == 0);
+
+    // Digests of an empty message and of a message of more blocks
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    SHA256Digest(nullptr, 0, digest);
+    CHECK(digest[0] == 0xe3 && digest[1] == 0xb0 && digest[31] == 0x55);
+    uint8_t text[200];
+    memset(text, 'a', sizeof(text));
+    SHA256Digest(text, sizeof(text), digest);
+    CHECK(digest[0] == 0xc2 && digest[1] == 0xa9 && digest[31] == 0xe5);
+}
+
+static void scenario_session_reuse(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3307);
+
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+    CHECK(server.lastPort == 3307);
+
+    server.respond(FakeServer::ok(1));
+    CHECK(sql.resetSession());
+    CHECK(server.lastPacket().size() == 1 && server.lastPacket()[0] == 0x1F);
+
+    // Same scramble of connect(), seed is the one of handshake
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.changeUser("other", "password", "db2"));
+    const Bytes &sent = server.lastPacket();
+    const char expected[] = "\x11other\0\x14";
+    CHECK(sent.size() == 1 + 6 + 1 + 20 + 4 + 2 + 22);
+    CHECK(memcmp(sent.data(), expected, sizeof(expected) - 1) == 0);
+    CHECK(strcmp((const char *)sent.data() + 28, "db2") == 0);
+    CHECK(strcmp((const char *)sent.data() + 34, "mysql_native_password") == 0);
+
+    // Server asks for another plugin, no database
+    server.respond(FakeServer::authSwitch(1, "caching_sha2_password"));
+    server.respond(FakeServer::ok(3));
+    CHECK(sql.changeUser("user", "password"));
+    CHECK(server.lastPacket().size() == 32);
+
+    // Digests are reused only for the same password
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.changeUser("other", "password", "db2"));
+    Bytes first = server.lastPacket();
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.changeUser("other", "passwore", "db2"));
+    CHECK(server.lastPacket() != first);
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.changeUser("other", "password", "db2"));
+    CHECK(server.lastPacket() == first);
+
+    server.respond(FakeServer::err(2, 1045, "28000", "Access denied for user 'other'"));
+    CHECK(!sql.changeUser("other", "wrong", "db"));
+    CHECK(server.connects == 1);
+    CHECK(server.pending() == 0);
+}
+
+static void scenario_busy(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+
+    // Commands are refused while the response of beginQuery() is not read
+    std::vector<FakeColumn_t> columns = {{"id", MYSQL_TYPE_LONG, 11, 0}};
+    server.respond(FakeServer::resultSet(1, columns, {{"1"}, {"2"}}));
+    DataQuery_t data;
+    CHECK(sql.beginQuery(data, "SELECT id FROM t", nullptr));
+    size_t packets = server.packetsIn;
+    CHECK(!sql.ping());
+    CHECK(!sql.resetSession());
+    CHECK(!sql.changeUser("other", "password"));
+    PreparedStatement stmt(&sql);
+    CHECK(!stmt.prepare("SELECT ?"));
+    CHECK(server.packetsIn == packets);
+    CHECK(sql.busy());
+
+    while (sql.poll()) {;}
+    CHECK(data.recordCount == 2);
+    server.respond(FakeServer::ok(1));
+    CHECK(sql.ping());
+    CHECK(server.pending() == 0);
+
+    // Result filled by beginQuery() is kept when query() is refused
+    server.setDrip(8);
+    server.respond(FakeServer::resultSet(1, columns, {{"1"}, {"2"}, {"3"}}));
+    AsyncResult_t result = {0, false, 0};
+    CHECK(sql.beginQuery(data, "SELECT id FROM t", on_done, &result));
+    while (sql.poll() && data.recordCount == 0) {;}
+    CHECK(sql.busy() && data.recordCount == 1);
+    CHECK(!sql.query(data, "SELECT id FROM u"));
+    CHECK(data.recordCount == 1);
+    while (sql.poll()) {;}
+    CHECK(result.calls == 1 && result.success);
+    CHECK(data.recordCount == 3);
+    server.setDrip(0);
+
+    // Query dropped by connect() is reported as failed
+    server.respond(FakeServer::resultSet(1, columns, {{"1"}}));
+    result = {0, false, 0};
+    CHECK(sql.beginQuery(data, "SELECT id FROM t", on_done, &result));
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+    CHECK(result.calls == 1 && !result.success);
+    CHECK(!sql.busy() && !sql.poll());
+    CHECK(result.calls == 1);
+    server.respond(FakeServer::ok(1));
+    CHECK(sql.ping());
+    CHECK(server.pending() == 0);
+}
+
+static void scenario_query_cache(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+    QueryCache cache(1024, 50);
+    sql.setQueryCache(&cache);
+
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+
+    std::vector<FakeColumn_t> columns = {{"id", MYSQL_TYPE_LONG, 11, 0}, {"name", MYSQL_TYPE_VAR_STRING, 16, 0}};
+    Bytes result = FakeServer::resultSet(1, columns, {{"1", "one"}, {"2", nullptr}});
+
+    // Second query is served from cache, nothing is sent
+    DataQuery_t data;
+    server.respond(result);
+    CHECK(sql.query(data, "SELECT * FROM t"));
+    size_t packets = server.packetsIn;
+    CHECK(sql.query(data, "SELECT * FROM t"));
+    CHECK(server.packetsIn == packets);
+    CHECK(cache.hits() == 1 && cache.misses() == 1);
+    CHECK(data.fieldCount == 2 && data.recordCount == 2);
+    CHECK(strcmp(data.getFieldName(1), "name") == 0);
+    CHECK(strcmp(data.getRowValue(0, "name"), "one") == 0);
+    CHECK(data.isNull(1, "name"));
+
+    // Formatted queries are looked up by their final text
+    server.respond(result);
+    CHECK(sql.queryf(data, "SELECT * FROM t WHERE id > %d", 0));
+    packets = server.packetsIn;
+    CHECK(sql.queryf(data, "SELECT * FROM t WHERE id > %d", 0));
+    CHECK(server.packetsIn == packets);
+    CHECK(data.getInt(1, "id") == 2);
+    CHECK(cache.count() == 2);
+
+    // A write on this connection drops all results
+    server.respond(FakeServer::ok(1, 1));
+    CHECK(sql.query(data, "INSERT INTO t VALUES (3, 'three')"));
+    CHECK(cache.count() == 0 && cache.used() == 0);
+    server.respond(result);
+    CHECK(sql.query(data, "SELECT * FROM t"));
+
+    // Results expire after ttl
+    delay(60);
+    server.respond(result);
+    CHECK(sql.query(data, "SELECT * FROM t"));
+    CHECK(cache.hits() == 2 && cache.misses() == 4);
+
+    // Failed queries are not stored
+    server.respond(FakeServer::err(1, 1146, "42S02", "Table 'db.nope' doesn't exist"));
+    CHECK(!sql.query(data, "SELECT * FROM nope"));
+    CHECK(cache.count() == 1);
+
+    // Budget for two results: the least recently used one is dropped
+    QueryCache small(2 * cache.used(), 0);
+    sql.setQueryCache(&small);
+    const char *const queries[] = {"SELECT * FROM a", "SELECT * FROM b", "SELECT * FROM a", "SELECT * FROM c", "SELECT * FROM a", "SELECT * FROM b"};
+    const bool sent[] = {true, true, false, true, false, true};
+    for (int i = 0; i < 6; i++) {
+        if (sent[i])
+            server.respond(result);
+        packets = server.packetsIn;
+        CHECK(sql.query(data, queries[i]));
+        CHECK((server.packetsIn != packets) == sent[i]);
+        CHECK(small.used() <= 2 * cache.used());
+    }
+    CHECK(small.count() == 2);
+
+    CHECK(QueryCache::isReadOnly(" (select 1)", 11));
+    CHECK(QueryCache::isReadOnly("SHOW TABLES; ", 13));
+    CHECK(QueryCache::isReadOnly("DESC t", 6));
+    CHECK(!QueryCache::isReadOnly("SELECT 1; DELETE FROM t", 23));
+    CHECK(!QueryCache::isReadOnly("SELECTED", 8));
+    CHECK(!QueryCache::isReadOnly("UPDATE t SET a = 1", 18));
+    CHECK(!QueryCache::isReadOnly("SELECT * FROM t WHERE id = 1 FOR UPDATE", 39));
+    CHECK(!QueryCache::isReadOnly("SELECT * FROM t LOCK IN SHARE MODE", 34));
+    CHECK(!QueryCache::isReadOnly("SELECT GET_LOCK('job', 10)", 26));
+    CHECK(!QueryCache::isReadOnly("SELECT a INTO @a FROM t", 23));
+    CHECK(QueryCache::isReadOnly("SELECT 'for update; into' FROM `into`", 37));
+    CHECK(QueryCache::isReadOnly("SELECT updated_at FROM t", 24));
+    CHECK(server.pending() == 0);
+}
+
+static void scenario_compressed(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+
+    server.setCompressed(true);
+    sql.setCompression(true);
+    server.greet(FakeServer::handshake(SERVER_CAPS | CLIENT_COMPRESS));
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+    CHECK(sql.compressed());
+
+    std::vector<FakeColumn_t> columns = {{"id", MYSQL_TYPE_LONG, 11, 0}};
+    std::vector<FakeRow_t> rows(100, FakeRow_t{"42"});
+    server.respond(FakeServer::compressedPacket(1, FakeServer::resultSet(1, columns, rows)));
+
+    DataQuery_t data;
+    CHECK(sql.query(data, "SELECT id FROM t"));
+    CHECK(data.recordCount == 100);
+    CHECK(data.getInt(99, 0) == 42);
+
+    // Reply to auth switch goes on with the compressed sequence of the command
+    server.respond(FakeServer::compressedPacket(1, FakeServer::authSwitch(1, "caching_sha2_password")));
+    server.respond(FakeServer::compressedPacket(3, FakeServer::ok(3)));
+    CHECK(sql.changeUser("other", "password", "db"));
+    CHECK(server.lastPacket().size() == 32);
+    CHECK(server.sequenceErrors == 0);
+
+    // Compressed packet too large: it is dropped with the rest of the response, next command works
+    Bytes head = FakeServer::resultSet(1, columns, {{"1"}});
+    head.resize(head.size() - 9);
+    std::string huge(MYSQL_MAX_COMPRESSED_SIZE, 'x');
+    Bytes big_row = FakeServer::packet(5, {0xFD, (uint8_t)huge.size(), (uint8_t)(huge.size() >> 8), (uint8_t)(huge.size() >> 16)});
+    big_row.insert(big_row.end(), huge.begin(), huge.end());
+    Bytes response = FakeServer::compressedPacket(1, head);
+    for (const Bytes &part : {FakeServer::compressedPacket(2, big_row), FakeServer::compressedPacket(3, FakeServer::packet(6, {0xFE, 0x00, 0x00, 0x02, 0x00}))})
+        response.insert(response.end(), part.begin(), part.end());
+    server.respond(response);
+    CHECK(!sql.query(data, "SELECT id FROM t"));
+    CHECK(strcmp(sql.getLastError(), "Packet larger than MYSQL_MAX_COMPRESSED_SIZE") == 0);
+    server.respond(FakeServer::compressedPacket(1, FakeServer::ok(1)));
+    CHECK(sql.ping());
+
+    // Deflate stream with a wrong Adler-32 is refused
+    Bytes ok = FakeServer::ok(1);
+    for (int corrupt = 0; corrupt < 2; corrupt++) {
+        Bytes stream = {0x78, 0x01, 0x01, (uint8_t)ok.size(), 0x00, (uint8_t)~ok.size(), 0xFF};
+        stream.insert(stream.end(), ok.begin(), ok.end());
+        uint32_t a = 1, b = 0;
+        for (uint8_t c : ok) {
+            a = (a + c) % 65521;
+            b = (b + a) % 65521;
+        }
+        uint32_t adler = ((b << 16) | a) + corrupt;
+        for (int shift = 24; shift >= 0; shift -= 8)
+            stream.push_back(adler >> shift);
+        Bytes frame = {(uint8_t)stream.size(), 0x00, 0x00, 0x01, (uint8_t)ok.size(), 0x00, 0x00};
+        frame.insert(frame.end(), stream.begin(), stream.end());
+        server.respond(frame);
+        CHECK(sql.ping() == !corrupt);
+    }
+    CHECK(strcmp(sql.getLastError(), "Compressed packet not valid") == 0);
+    server.respond(FakeServer::compressedPacket(1, FakeServer::ok(1)));
+    CHECK(sql.ping());
+    CHECK(server.sequenceErrors == 0);
+    CHECK(server.pending() == 0);
+}
+
+static void scenario_static_result(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+
+    std::vector<FakeColumn_t> columns = {{"id", MYSQL_TYPE_LONG, 11, 0}, {"name", MYSQL_TYPE_VAR_STRING, 16, 0}};
+    Bytes result = FakeServer::resultSet(1, columns, {{"1", "one"}, {"2", "two"}, {"3", "three"}});
+
+    // Fits: 3 rows, 14 chars of values plus terminators
+    StaticDataQuery_t<3, 2, 20> data;
+    server.respond(result);
+    CHECK(sql.query(data, "SELECT id, name FROM t"));
+    CHECK(!data.overflow());
+    CHECK(data.recordCount == 3);
+    CHECK(strcmp(data.getRowValue(2, "name"), "three") == 0);
+
+    // Third row is dropped, the copy keeps the same storage limits
+    StaticDataQuery_t<2, 2, 20> small;
+    server.respond(result);
+    CHECK(!sql.query(small, "SELECT id, name FROM t"));
+    CHECK(small.overflow());
+    CHECK(small.recordCount == 2);
+    StaticDataQuery_t<2, 2, 20> copy = small;
+    CHECK(copy.getInt(1, "id") == 2);
+
+#if MYSQL_STATIC_STORAGE
+    // Results with more than MYSQL_MAX_COLUMNS columns fail, session is still usable
+    std::vector<FakeColumn_t> wide;
+    FakeRow_t row;
+    for (int i = 0; i <= MYSQL_MAX_COLUMNS; i++) {
+        wide.push_back({"a_long_column_name", MYSQL_TYPE_LONG, 11, 0});
+        row.push_back("0");
+    }
+    server.respond(FakeServer::resultSet(1, wide, {row, row}));
+    DataQuery_t all;
+    CHECK(!sql.query(all, "SELECT * FROM wide"));
+    CHECK(all.recordCount == 0);
+    CHECK(strcmp(sql.getLastError(), "Result has too many columns") == 0);
+
+    // Names are truncated to MYSQL_MAX_NAME_LEN
+    wide.resize(1);
+    server.respond(FakeServer::resultSet(1, wide, {{"5"}}));
+    CHECK(sql.query(all, "SELECT * FROM wide"));
+    CHECK(strlen(all.getFieldName(0)) == MYSQL_MAX_NAME_LEN);
+    CHECK(all.getInt(0, 0) == 5);
+#endif
+    CHECK(server.pending() == 0);
+}
+
+#if MYSQL_STATS
+typedef struct {
+    uint32_t records;
+    uint32_t rows;
+} StatsCount_t;
+
+static void count_stats(MySQL *, const QueryStats_t &stats, void *userData)
+{
+    StatsCount_t *count = (StatsCount_t *)userData;
+    count->records++;
+    count->rows += stats.rows;
+}
+
+static void scenario_stats(void)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+    StatsCount_t count = {0, 0};
+
+    server.greet(FakeServer::handshake(SERVER_CAPS));
+    server.respond(FakeServer::ok(2));
+    CHECK(sql.connect("user", "password", "db"));
+    sql.setStatsCallback(count_stats, &count);
+
+    std::vector<FakeColumn_t> columns = {{"id", MYSQL_TYPE_LONG, 11, 0}};
+    Bytes result = FakeServer::resultSet(1, columns, {{"1"}, {"2"}, {"3"}});
+    server.respond(result);
+
+    DataQuery_t data;
+    CHECK(sql.query(data, "SELECT id FROM t"));
+    const QueryStats_t &stats = sql.getQueryStats();
+    CHECK(stats.success);
+    CHECK(stats.rows == 3);
+    CHECK(count.records == 1 && count.rows == 3);
+    CHECK(stats.packetsOut == 1);
+    CHECK(stats.packetsIn == 7);
+    CHECK(stats.bytesOut == 4 + 17);
+    CHECK(stats.bytesIn == result.size());
+    CHECK(stats.totalTime >= stats.sendTime + stats.recieveTime + stats.parseTime);
+
+    server.respond(FakeServer::err(1, 1064, "42000", "You have an error in your SQL syntax"));
+    CHECK(!sql.query(data, "SELEC"));
+    CHECK(!sql.getQueryStats().success);
+    CHECK(sql.getQueryStats().packetsIn == 1);
+
+    // Commands without rows have a record each
+    server.respond(FakeServer::ok(1));
+    CHECK(sql.ping());
+    CHECK(count.records == 3);
+    CHECK(stats.success && stats.packetsOut == 1 && stats.packetsIn == 1);
+    server.respond(FakeServer::err(1, 1045, "28000", "Access denied"));
+    CHECK(!sql.changeUser("other", "password"));
+    CHECK(count.records == 4 && !stats.success);
+    server.respond(FakeServer::ok(1));
+    CHECK(sql.changeUser("user", "password"));
+    CHECK(count.records == 5 && stats.success);
+
+    // Prepared statement: record of execute() ends with its last row
+    PreparedStatement stmt(&sql);
+    server.respond(FakeServer::prepareOk(1, 3, columns, 0));
+    CHECK(stmt.prepare("SELECT id FROM t"));
+    CHECK(count.records == 6 && stats.success);
+    server.respond(FakeServer::binaryResultSet(1, columns, {{"1"}, {"2"}}));
+    CHECK(stmt.execute());
+    CHECK(count.records == 6);
+    while (stmt.next()) {;}
+    CHECK(count.records == 7 && stats.success && stats.rows == 2);
+
+    // Rows not read are dropped by next command, their record ends first
+    server.respond(FakeServer::binaryResultSet(1, columns, {{"1"}, {"2"}}));
+    CHECK(stmt.execute());
+    CHECK(stmt.next());
+    server.respond(FakeServer::ok(1));
+    CHECK(sql.ping());
+    CHECK(count.records == 9 && stats.success && stats.rows == 0);
+    CHECK(stmt.close());
+    CHECK(count.records == 10);
+    CHECK(server.pending() == 0);
+}
+#endif
+
+static int replay(int argc, char **argv)
+{
+    FakeServer server;
+    MySQL sql(&server, "127.0.0.1", 3306);
+
+    int arg = 1;
+    if (strcmp(argv[arg], "-z") == 0) {
+        server.setCompressed(true);
+        sql.setCompression(true);
+        arg++;
+    }
+    if (arg >= argc || !server.loadCapture(argv[arg])) {
+        printf("Capture file not valid\n");
+        return 1;
+    }
+
+    if (!sql.connect("user", "password", "db"))
+        return 1;
+
+    int ret = 0;
+    for (arg++; arg < argc; arg++) {
+        DataQuery_t data;
+        printf("%s\n", argv[arg]);
+        if (!sql.query(data, argv[arg])) {
+            ret = 1;
+            continue;
+        }
+        if (data.fieldCount)
+            sql.printResult(data, Serial);
+        else
+            printf("OK, affected rows %llu\n", (unsigned long long)sql.getAffectedRows());
+    }
+    printf("Bytes from server %zu, to server %zu\n", server.bytesOut, server.bytesIn);
+    return ret;
+}
+
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        return replay(argc, argv);
+
+    scenario_lenenc();
+    scenario_query();
+    scenario_large_packet();
+    scenario_prepared();
+    scenario_async();
+    scenario_batch();
+    scenario_bulk_insert();
+    scenario_pool();
+    scenario_login();
+    scenario_caching_sha2();
+    scenario_session_reuse();
+    scenario_busy();
+    scenario_query_cache();
+    scenario_compressed();
+    scenario_static_result();
+#if MYSQL_STATS
+    scenario_stats();
+#endif
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
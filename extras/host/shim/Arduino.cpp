@@ -0,0 +1,120 @@
+#include "Arduino.h"
+
+#include <chrono>
+#include <thread>
+
+HostSerial Serial;
+
+static const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+unsigned long millis(void)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+unsigned long micros(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield(void)
+{
+    std::this_thread::yield();
+}
+
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--) {
+        if (write(*buffer++) == 0)
+            break;
+        n++;
+    }
+    return n;
+}
+
+size_t Print::print(long value)
+{
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%ld", value);
+    return print(buf);
+}
+
+size_t Print::print(unsigned long value)
+{
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%lu", value);
+    return print(buf);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", digits, value);
+    return print(buf);
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0)
+        return 0;
+    if ((size_t)len >= sizeof(buf)) {
+        std::string text(len + 1, '\0');
+        va_start(args, format);
+        vsnprintf(&text[0], text.size(), format, args);
+        va_end(args);
+        return write((const uint8_t *)text.c_str(), len);
+    }
+    return write((const uint8_t *)buf, len);
+}
+
+
+int Stream::timedRead(void)
+{
+    unsigned long start = millis();
+    do {
+        int c = read();
+        if (c >= 0)
+            return c;
+    } while (millis() - start < _timeout);
+    return -1;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length) {
+        int c = timedRead();
+        if (c < 0)
+            break;
+        *buffer++ = (char)c;
+        count++;
+    }
+    return count;
+}
+
+
+size_t HostSerial::write(uint8_t c)
+{
+    if (!muted)
+        fputc(c, stdout);
+    return 1;
+}
+
+size_t HostSerial::write(const uint8_t *buffer, size_t size)
+{
+    if (!muted)
+        fwrite(buffer, 1, size, stdout);
+    return size;
+}
@@ -0,0 +1,152 @@
+/**
+ * @file Arduino.h
+ * @brief Minimal Arduino core for building the library on a host (Linux)
+ *
+ * Only what the library and its host tools use is provided.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+#define PROGMEM
+#define F(str) (str)
+
+typedef uint8_t byte;
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void yield(void);
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+
+    size_t write(const char *str) {
+        return write((const uint8_t *)str, strlen(str));
+    }
+    size_t print(const char *str) {
+        return write(str);
+    }
+    size_t print(const std::string &str) {
+        return write((const uint8_t *)str.c_str(), str.length());
+    }
+    size_t print(char c) {
+        return write((uint8_t)c);
+    }
+    size_t print(long value);
+    size_t print(unsigned long value);
+    size_t print(int value) {
+        return print((long)value);
+    }
+    size_t print(unsigned int value) {
+        return print((unsigned long)value);
+    }
+    size_t print(double value, int digits = 2);
+    size_t println(void) {
+        return write("\n");
+    }
+    template <typename T>
+    size_t println(const T &value) {
+        return print(value) + println();
+    }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) {
+        _timeout = timeout;
+    }
+    unsigned long getTimeout(void) {
+        return _timeout;
+    }
+
+    // Wait for each byte until timeout, as the Arduino core does
+    virtual size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) {
+        return readBytes((char *)buffer, length);
+    }
+
+protected:
+    unsigned long _timeout = 1000;
+    int timedRead(void);
+};
+
+/**
+ * @brief Arduino String on top of std::string
+ */
+class String
+{
+public:
+    String(const char *str = "") : s(str ? str : "") {}
+    String(const std::string &str) : s(str) {}
+    String(char c) : s(1, c) {}
+    String(int value) : s(std::to_string(value)) {}
+    String(long value) : s(std::to_string(value)) {}
+    String(unsigned int value) : s(std::to_string(value)) {}
+    String(unsigned long value) : s(std::to_string(value)) {}
+
+    const char *c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.length(); }
+    bool reserve(unsigned int size) { s.reserve(size); return true; }
+    bool isEmpty() const { return s.empty(); }
+    char charAt(unsigned int index) const { return index < s.length() ? s[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    int toInt() const { return atoi(s.c_str()); }
+    bool equals(const String &other) const { return s == other.s; }
+
+    String &operator+=(const String &other) { s += other.s; return *this; }
+    String &operator+=(const char *str) { s += str; return *this; }
+    String &operator+=(char c) { s += c; return *this; }
+    bool operator==(const String &other) const { return s == other.s; }
+    bool operator==(const char *str) const { return s == str; }
+    bool operator!=(const String &other) const { return s != other.s; }
+
+    friend String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+
+private:
+    std::string s;
+};
+
+/**
+ * @brief Serial port, printed text goes to stdout
+ *
+ * Output can be muted to keep library logs out of benchmarks.
+ */
+class HostSerial : public Stream
+{
+public:
+    void begin(unsigned long) {}
+    void mute(bool enable) { muted = enable; }
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    operator bool() { return true; }
+
+private:
+    bool muted = false;
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,164 @@
+#include "MySQL.h"
+
+#define COM_QUERY 0x03
+
+// Payload starts after packet header (4 bytes)
+#define PAYLOAD_OFFSET 4
+
+
+bool BulkInserter::begin(const char *prefix)
+{
+    this->prefix = nullptr;
+    this->totalRows = 0;
+    this->affectedRows = 0;
+    this->statementCount = 0;
+    this->error = false;
+
+    if (prefix == nullptr || sql->busy())
+        return false;
+
+    this->prefixLen = strlen(prefix);
+    this->prefix = prefix;
+    if (1 + this->prefixLen >= this->capacity()) {
+        this->prefix = nullptr;
+        return false;
+    }
+
+    // Results of previous query not read yet, then buffer is used to build the statement
+    sql->drain_results();
+    sql->rx_reset();
+    this->restart();
+    return true;
+}
+
+
+bool BulkInserter::end(void)
+{
+    if (this->prefix == nullptr)
+        return false;
+
+    this->flush();
+    this->prefix = nullptr;
+    return !this->error;
+}
+
+
+/**
+ * @brief Max payload length of each statement
+ *
+ */
+size_t BulkInserter::capacity(void)
+{
+    size_t max_len = BUFF_SIZE - PAYLOAD_OFFSET;
+    if (this->maxPacket && this->maxPacket < max_len)
+        max_len = this->maxPacket;
+    return max_len;
+}
+
+
+/**
+ * @brief Write command byte and prefix at the start of a new statement
+ *
+ */
+void BulkInserter::restart(void)
+{
+    sql->tcp_socket_buffer[PAYLOAD_OFFSET] = COM_QUERY;
+    memcpy(sql->tcp_socket_buffer + PAYLOAD_OFFSET + 1, this->prefix, this->prefixLen);
+    this->payloadLen = 1 + this->prefixLen;
+    this->rowCount = 0;
+}
+
+
+/**
+ * @brief Make room for a row of len chars, sending the statement if needed
+ *
+ */
+bool BulkInserter::reserve(size_t len)
+{
+    // Rows are separated by a comma
+    size_t needed = this->rowCount ? len + 1 : len;
+
+    if (this->payloadLen + needed > this->capacity()) {
+        // Row too large also for an empty statement
+        if (this->rowCount == 0 || 1 + this->prefixLen + len > this->capacity())
+            return false;
+
+        if (!this->flush())
+            return false;
+    }
+
+    if (this->rowCount)
+        this->put(',');
+    return true;
+}
+
+
+/**
+ * @brief Send the statement with the rows collected and read the server response
+ *
+ * @return bool false if sending failed or server returned an error
+ */
+bool BulkInserter::flush(void)
+{
+    if (this->rowCount == 0)
+        return true;
+
+    uint8_t *buffer = sql->tcp_socket_buffer;
+    store_int(buffer, this->payloadLen, 3);
+    buffer[3] = 0;
+
+    sql->clear_status();
+    sql->cache_sent((const char *)buffer + PAYLOAD_OFFSET + 1, this->payloadLen - 1);
+    MYSQL_STATS_DO(sql->stats_begin(); sql->mStats.packetsOut++);
+    size_t packet_len = PAYLOAD_OFFSET + this->payloadLen;
+    bool ret = sql->write((const char *)buffer, packet_len) == packet_len;
+
+    // Response is recieved in the same buffer, prefix is written again after it
+    if (ret)
+        ret = sql->read_result(&sql->mStreamFields, nullptr, nullptr);
+    sql->drain_results();
+    sql->rx_reset();
+
+    this->statementCount++;
+    this->affectedRows += sql->getAffectedRows();
+    this->error = this->error || !ret;
+    this->restart();
+    return ret;
+}
+
+
+void BulkInserter::put(char ch)
+{
+    sql->tcp_socket_buffer[PAYLOAD_OFFSET + this->payloadLen++] = ch;
+}
+
+void BulkInserter::put(const char *text, size_t len)
+{
+    memcpy(sql->tcp_socket_buffer + PAYLOAD_OFFSET + this->payloadLen, text, len);
+    this->payloadLen += len;
+}
+
+
+/**
+ * @brief Length of a string value, quoted and escaped (NULL for nullptr)
+ *
+ */
+size_t BulkInserter::valueLength(const char *value)
+{
+    if (value == nullptr)
+        return 4;
+    return 2 + escapedLength(value, strlen(value));
+}
+
+void BulkInserter::putValue(const char *value)
+{
+    if (value == nullptr) {
+        this->put("NULL", 4);
+        return;
+    }
+    char *dest = (char *)sql->tcp_socket_buffer + PAYLOAD_OFFSET + this->payloadLen;
+    *dest = '\'';
+    uint32_t len = escapeString(dest + 1, value, strlen(value));
+    dest[len + 1] = '\'';
+    this->payloadLen += len + 2;
+}
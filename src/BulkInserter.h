@@ -0,0 +1,232 @@
+/**
+ * @file BulkInserter.h
+ * @brief Multi-row INSERT built directly in the socket buffer
+ */
+
+#ifndef BULK_INSERTER_H
+#define BULK_INSERTER_H
+
+#include <Arduino.h>
+#include "SQLVarTypes.h"
+
+class MySQL;
+
+/**
+ * @brief Append rows to an INSERT statement and send it when the packet is full.
+ *
+ * Statement is written straight into MySQL tcp_socket_buffer, so no memory
+ * is allocated whatever the number of rows: when the next row does not fit,
+ * the rows collected so far are sent as one INSERT and a new one is started
+ * with the same prefix. Each statement is then bounded by the socket buffer
+ * (BUFF_SIZE), not by server max_allowed_packet: packet length is sent
+ * before the payload and rows already written are not kept elsewhere.
+ *
+ *   BulkInserter insert(&sql);
+ *   insert.begin("INSERT INTO gpios (gpio, type, state, label) VALUES ");
+ *   for (Gpio_t &gpio : gpios)
+ *     insert.addRow(gpio.pin, gpio.type, gpio.state, gpio.label);
+ *   insert.end();
+ *
+ * Values are written by type: numbers as they are, strings quoted and
+ * escaped, nullptr as NULL. The prefix is not copied and must stay valid
+ * until end(). No other command can be sent on the same MySQL object
+ * between begin() and end().
+ */
+class BulkInserter
+{
+public:
+    BulkInserter(MySQL *pSQL) : sql(pSQL) {;}
+
+    /**
+     * @brief Start a new statement
+     *
+     * @param prefix Statement before rows, e.g. "INSERT INTO t (a, b) VALUES "
+     * @return true Ready to add rows
+     * @return false Prefix too long or a query is running
+     */
+    bool begin(const char *prefix);
+
+    /**
+     * @brief Add a row, rows collected so far are sent if it does not fit
+     *
+     * @param args Value of each column
+     * @return true Row added
+     * @return false Row larger than a packet or previous rows could not be sent
+     */
+    template <typename... Args>
+    bool addRow(const Args&... args) {
+        if (this->prefix == nullptr)
+            return false;
+
+        // Parenthesis, values and commas between them
+        size_t len = 2 + (sizeof...(args) ? sizeof...(args) - 1 : 0) + this->measure(args...);
+        if (!this->reserve(len))
+            return false;
+
+        this->put('(');
+        this->putValues(args...);
+        this->put(')');
+        this->rowCount++;
+        this->totalRows++;
+        return true;
+    }
+
+    /**
+     * @brief Send the remaining rows
+     *
+     * @return true All statements succeeded
+     * @return false One or more statements failed (see MySQL::getLastError())
+     */
+    bool end(void);
+
+    /**
+     * @brief Limit the length of each statement (default and max is tcp_socket_buffer size)
+     *
+     * Longer statements need a larger BUFF_SIZE.
+     *
+     * @param len Max packet payload length, should not exceed server max_allowed_packet
+     */
+    void setMaxPacket(size_t len) {
+        maxPacket = len;
+    }
+
+    // Rows added since begin()
+    uint32_t getRowCount() const {
+        return totalRows;
+    }
+
+    // Rows inserted by all statements sent since begin()
+    uint64_t getAffectedRows() const {
+        return affectedRows;
+    }
+
+    // INSERT statements sent since begin()
+    uint16_t getStatementCount() const {
+        return statementCount;
+    }
+
+private:
+    MySQL *sql;
+
+    const char *prefix = nullptr;
+    size_t prefixLen = 0;
+    size_t maxPacket = 0;
+
+    // Payload written in tcp_socket_buffer (command byte included)
+    size_t payloadLen = 0;
+    uint32_t rowCount = 0;
+
+    uint32_t totalRows = 0;
+    uint64_t affectedRows = 0;
+    uint16_t statementCount = 0;
+    bool error = false;
+
+    bool flush(void);
+    bool reserve(size_t len);
+    void restart(void);
+    size_t capacity(void);
+    void put(char ch);
+    void put(const char *text, size_t len);
+
+    // Length of each value written as SQL text
+    size_t measure() {
+        return 0;
+    }
+
+    template <typename T, typename... Args>
+    size_t measure(const T &value, const Args&... args) {
+        return this->valueLength(value) + this->measure(args...);
+    }
+
+    void putValues() {;}
+
+    template <typename T, typename... Args>
+    void putValues(const T &value, const Args&... args) {
+        this->putValue(value);
+        if (sizeof...(args))
+            this->put(',');
+        this->putValues(args...);
+    }
+
+    size_t valueLength(const char *value);
+    size_t valueLength(const String &value) {
+        return valueLength(value.c_str());
+    }
+    size_t valueLength(decltype(nullptr)) {
+        return 4;
+    }
+    size_t valueLength(bool) {
+        return 1;
+    }
+    size_t valueLength(long long value) {
+        char buf[NUMBER_TEXT_SIZE];
+        return formatInt(buf, value);
+    }
+    size_t valueLength(unsigned long long value) {
+        char buf[NUMBER_TEXT_SIZE];
+        return formatUInt(buf, value);
+    }
+    size_t valueLength(double value) {
+        char buf[NUMBER_TEXT_SIZE];
+        int len = formatDouble(buf, value);
+        return len ? len : 4;
+    }
+    size_t valueLength(float value) {
+        char buf[NUMBER_TEXT_SIZE];
+        int len = formatFloat(buf, value);
+        return len ? len : 4;
+    }
+    size_t valueLength(signed char value)       { return valueLength((long long)value); }
+    size_t valueLength(unsigned char value)     { return valueLength((unsigned long long)value); }
+    size_t valueLength(short value)             { return valueLength((long long)value); }
+    size_t valueLength(unsigned short value)    { return valueLength((unsigned long long)value); }
+    size_t valueLength(int value)               { return valueLength((long long)value); }
+    size_t valueLength(unsigned int value)      { return valueLength((unsigned long long)value); }
+    size_t valueLength(long value)              { return valueLength((long long)value); }
+    size_t valueLength(unsigned long value)     { return valueLength((unsigned long long)value); }
+
+    void putValue(const char *value);
+    void putValue(const String &value) {
+        putValue(value.c_str());
+    }
+    void putValue(decltype(nullptr)) {
+        put("NULL", 4);
+    }
+    void putValue(bool value) {
+        put(value ? '1' : '0');
+    }
+    void putValue(long long value) {
+        char buf[NUMBER_TEXT_SIZE];
+        put(buf, formatInt(buf, value));
+    }
+    void putValue(unsigned long long value) {
+        char buf[NUMBER_TEXT_SIZE];
+        put(buf, formatUInt(buf, value));
+    }
+    void putValue(double value) {
+        char buf[NUMBER_TEXT_SIZE];
+        int len = formatDouble(buf, value);
+        if (len)
+            put(buf, len);
+        else
+            put("NULL", 4);
+    }
+    void putValue(float value) {
+        char buf[NUMBER_TEXT_SIZE];
+        int len = formatFloat(buf, value);
+        if (len)
+            put(buf, len);
+        else
+            put("NULL", 4);
+    }
+    void putValue(signed char value)        { putValue((long long)value); }
+    void putValue(unsigned char value)      { putValue((unsigned long long)value); }
+    void putValue(short value)              { putValue((long long)value); }
+    void putValue(unsigned short value)     { putValue((unsigned long long)value); }
+    void putValue(int value)                { putValue((long long)value); }
+    void putValue(unsigned int value)       { putValue((unsigned long long)value); }
+    void putValue(long value)               { putValue((long long)value); }
+    void putValue(unsigned long value)      { putValue((unsigned long long)value); }
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include "DataQuery.h"
+
+// Minimum size of a new allocation, avoids many small reallocations on first rows
+#define DATAQUERY_MIN_BUFFER 128
+#define DATAQUERY_MIN_CELLS  16
+#define DATAQUERY_MIN_INDEX  8
+
+
+DataQuery_t& DataQuery_t::operator=(const DataQuery_t &other)
+{
+    if (this == &other)
+        return *this;
+
+    this->clear();
+    this->fields = other.fields;
+    if (this->growBuffer(other.bufferUsed) && this->growCells(other.cellsUsed)) {
+        if (other.bufferUsed)
+            memcpy(this->buffer, other.buffer, other.bufferUsed);
+        if (other.cellsUsed)
+            memcpy(this->cells, other.cells, other.cellsUsed * sizeof(Cell_t));
+        this->bufferUsed = other.bufferUsed;
+        this->cellsUsed = other.cellsUsed;
+        this->fieldCount = other.fieldCount;
+        this->recordCount = other.recordCount;
+        this->error = other.error;
+    }
+    else {
+        this->error = true;
+    }
+    return *this;
+}
+
+/**
+ * @brief Grow the values buffer to hold at least size bytes
+ *
+ */
+bool DataQuery_t::growBuffer(uint32_t size)
+{
+    if (size <= this->bufferSize)
+        return true;
+    if (this->fixed)
+        return false;
+
+    // Double the capacity so the number of reallocations grows with log(n)
+    uint32_t new_size = this->bufferSize ? this->bufferSize : DATAQUERY_MIN_BUFFER;
+    while (new_size < size)
+        new_size *= 2;
+
+    char *new_buffer = (char *)realloc(this->buffer, new_size);
+    if (new_buffer == nullptr)
+        return false;
+
+    this->buffer = new_buffer;
+    this->bufferSize = new_size;
+    return true;
+}
+
+/**
+ * @brief Grow the cells table to hold at least count cells
+ *
+ */
+bool DataQuery_t::growCells(uint32_t count)
+{
+    if (count <= this->cellsSize)
+        return true;
+    if (this->fixed)
+        return false;
+
+    uint32_t new_size = this->cellsSize ? this->cellsSize : DATAQUERY_MIN_CELLS;
+    while (new_size < count)
+        new_size *= 2;
+
+    Cell_t *new_cells = (Cell_t *)realloc(this->cells, new_size * sizeof(Cell_t));
+    if (new_cells == nullptr)
+        return false;
+
+    this->cells = new_cells;
+    this->cellsSize = new_size;
+    return true;
+}
+
+
+bool DataQuery_t::reserve(uint32_t bytes, uint32_t rows)
+{
+    uint16_t columns = this->fieldCount ? this->fieldCount : this->fields.size();
+    return this->growBuffer(bytes + rows * columns) && this->growCells(rows * columns);
+}
+
+
+bool DataQuery_t::addRow(const Row_t &row)
+{
+    uint16_t columns = row.count();
+
+    // First row of a new result set
+    if (this->recordCount == 0)
+        this->fieldCount = columns;
+
+    if (columns != this->fieldCount) {
+        this->error = true;
+        return false;
+    }
+
+    // One byte more for each value, they are stored null-terminated
+    uint32_t row_size = columns;
+    for (int col = 0; col < columns; col++)
+        row_size += row.getLength(col);
+
+    if (!this->growBuffer(this->bufferUsed + row_size) || !this->growCells(this->cellsUsed + columns)) {
+        this->error = true;
+        return false;
+    }
+
+    for (int col = 0; col < columns; col++) {
+        Cell_t *cell = &this->cells[this->cellsUsed++];
+        uint32_t length = row.getLength(col);
+        cell->offset = this->bufferUsed;
+        cell->length = row.isNull(col) ? CELL_NULL : length;
+        if (length)
+            memcpy(this->buffer + this->bufferUsed, row.getValue(col), length);
+        this->bufferUsed += length;
+        this->buffer[this->bufferUsed++] = '\0';
+    }
+
+    this->recordCount++;
+    return true;
+}
+
+
+int64_t DataQuery_t::getInt(int row, int col)
+{
+    const Cell_t *cell = this->getCell(row, col);
+    if (cell == nullptr || cell->length == CELL_NULL)
+        return 0;
+
+    const char *value = this->buffer + cell->offset;
+
+    // BIT values are sent as big-endian binary also in text result sets
+    if (this->fields.at(col).type == MYSQL_TYPE_BIT) {
+        uint64_t bits = 0;
+        for (uint32_t i = 0; i < cell->length; i++)
+            bits = (bits << 8) | (uint8_t)value[i];
+        return (int64_t)bits;
+    }
+    return readTextInt(value, cell->length);
+}
+
+double DataQuery_t::getDouble(int row, int col)
+{
+    const Cell_t *cell = this->getCell(row, col);
+    if (cell == nullptr || cell->length == CELL_NULL)
+        return 0;
+
+    if (this->fields.at(col).type == MYSQL_TYPE_BIT)
+        return (double)this->getInt(row, col);
+
+    // Values are stored null-terminated, no copy needed
+    return strtod(this->buffer + cell->offset, nullptr);
+}
+
+const uint8_t* DataQuery_t::getBlob(int row, int col, uint32_t *length)
+{
+    const Cell_t *cell = this->getCell(row, col);
+    if (cell == nullptr || cell->length == CELL_NULL) {
+        if (length)
+            *length = 0;
+        return nullptr;
+    }
+    if (length)
+        *length = cell->length;
+    return (const uint8_t *)(this->buffer + cell->offset);
+}
+
+
+#if MYSQL_STATIC_STORAGE
+/**
+ * @brief Columns are a few, a linear search avoids the lookup table allocation
+ *
+ */
+int DataQuery_t::getFieldIndex(const char* fieldName)
+{
+    if (fieldName == nullptr)
+        return -1;
+
+    for (uint16_t col = 0; col < this->fields.size(); col++) {
+        if (this->fields.at(col).name.equals(fieldName))
+            return col;
+    }
+    return -1;
+}
+
+#else
+/**
+ * @brief Build the field name lookup table for current fields
+ *
+ * Table size is a power of two at least twice the number of fields,
+ * so probe sequences stay short.
+ */
+bool DataQuery_t::buildIndex()
+{
+    uint16_t count = this->fields.size();
+    uint16_t size = DATAQUERY_MIN_INDEX;
+    while (size < count * 2)
+        size *= 2;
+
+    if (size > this->indexSize) {
+        uint16_t *new_index = (uint16_t *)realloc(this->index, size * sizeof(uint16_t));
+        if (new_index == nullptr)
+            return false;
+        this->index = new_index;
+        this->indexSize = size;
+    }
+    memset(this->index, 0, this->indexSize * sizeof(uint16_t));
+
+    uint16_t mask = this->indexSize - 1;
+    for (uint16_t col = 0; col < count; col++) {
+        const FieldName &name = this->fields.at(col).name;
+        uint16_t slot = hashString(name.c_str(), name.length()) & mask;
+        while (this->index[slot] != 0)
+            slot = (slot + 1) & mask;
+        this->index[slot] = col + 1;
+    }
+    this->indexCount = count;
+    return true;
+}
+
+
+int DataQuery_t::getFieldIndex(const char* fieldName)
+{
+    if (fieldName == nullptr || this->fields.size() == 0)
+        return -1;
+
+    if (this->indexCount != this->fields.size() && !this->buildIndex())
+        return -1;
+
+    uint16_t mask = this->indexSize - 1;
+    uint16_t slot = hashString(fieldName, strlen(fieldName)) & mask;
+    while (this->index[slot] != 0) {
+        int col = this->index[slot] - 1;
+        if (strcmp(this->fields.at(col).name.c_str(), fieldName) == 0)
+            return col;
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+#endif
@@ -1,81 +1,372 @@
 
-#if defined(__AVR__)
- #include <ArduinoSTL.h>
-#else
-#include <cstdint>
-#include <vector>
-#endif
-
 #ifndef DATAQUERY_H
 #define DATAQUERY_H
 
+#include <Arduino.h>
+#include "PacketsTypes.h"
+#include "FixedVector.h"
+
+#if MYSQL_STATIC_STORAGE
+typedef FixedString<MYSQL_MAX_NAME_LEN> FieldName;
+#else
+typedef String FieldName;
+#endif
+
 typedef struct {
-    String name;
+    FieldName   name;
     uint32_t    size;
+    uint8_t     type;
+    uint16_t    flags;
+    uint8_t     decimals;
 } Field_t;
 
+// Column definitions of a result set
+#if MYSQL_STATIC_STORAGE
+typedef FixedVector<Field_t, MYSQL_MAX_COLUMNS> FieldList;
+#else
+typedef std::vector<Field_t> FieldList;
+#endif
+
+/**
+ * @brief Position of a single column value inside a row packet payload
+ */
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+    bool     null;
+} Column_t;
+
+/**
+ * @brief Zero-copy view of one text result row.
+ *
+ * Values point straight into the recieved packet and are NOT null-terminated:
+ * the view is valid only while the RowHandler is running.
+ */
+class Row_t {
+    public:
+        Row_t(const uint8_t *payload, const Column_t *columns, const FieldList *fields) :
+            payload(payload), columns(columns), fields(fields) {;}
+
+        uint16_t count() const {
+            return fields->size();
+        }
+
+        const char* getFieldName(int col) const {
+            if (col < 0 || col >= count())
+                return nullptr;
+            return fields->at(col).name.c_str();
+        }
+
+        int getFieldIndex(const char* fieldName) const {
+            for (int col = 0; col < count(); col++) {
+                if (fields->at(col).name.equals(fieldName))
+                    return col;
+            }
+            return -1;
+        }
+
+        const char* getValue(int col) const {
+            if (col < 0 || col >= count() || columns[col].null)
+                return nullptr;
+            return (const char*)(payload + columns[col].offset);
+        }
+
+        uint32_t getLength(int col) const {
+            if (col < 0 || col >= count())
+                return 0;
+            return columns[col].length;
+        }
+
+        bool isNull(int col) const {
+            if (col < 0 || col >= count())
+                return true;
+            return columns[col].null;
+        }
+
+        // Numeric values decoded from text, without copies
+        int64_t getInt(int col) const {
+            const char* value = getValue(col);
+            return value ? readTextInt(value, getLength(col)) : 0;
+        }
+
+        double getDouble(int col) const {
+            char buf[32];
+            copyValue(col, buf, sizeof(buf));
+            return strtod(buf, nullptr);
+        }
+
+        float getFloat(int col) const {
+            return (float)getDouble(col);
+        }
+
+        // Copy a value into a null-terminated buffer, returns the number of chars copied
+        size_t copyValue(int col, char* dest, size_t size) const {
+            if (size == 0)
+                return 0;
+            const char* value = getValue(col);
+            size_t len = value ? getLength(col) : 0;
+            if (len > size - 1)
+                len = size - 1;
+            if (len)
+                memcpy(dest, value, len);
+            dest[len] = '\0';
+            return len;
+        }
+
+    private:
+        const uint8_t *payload;
+        const Column_t *columns;
+        const FieldList *fields;
+};
+
+/**
+ * @brief Callback invoked once for each row as soon as it has been recieved
+ */
+typedef void (*RowHandler)(const Row_t &row, void *userData);
+
+/**
+ * @brief Position of a single value inside the DataQuery_t buffer
+ */
 typedef struct {
-    std::vector<String> record;
-} Record_t;
+    uint32_t offset;
+    uint32_t length;
+} Cell_t;
 
+// Cell_t length of NULL values
+#define CELL_NULL 0xFFFFFFFF
+
+/**
+ * @brief Result of a query.
+ *
+ * All values are stored null-terminated one after the other in a single
+ * buffer, and a table of Cell_t (fieldCount cells for each row) keeps their
+ * position, so storing a row costs at most one reallocation and not one per value.
+ * Buffer and table grow on heap as needed, see StaticDataQuery_t for a
+ * result with fixed storage.
+ */
 class DataQuery_t {
     public:
         DataQuery_t() {;}
-        ~DataQuery_t() {;}
+        ~DataQuery_t() {
+            if (!this->fixed) {
+                free(this->buffer);
+                free(this->cells);
+            }
+#if !MYSQL_STATIC_STORAGE
+            free(this->index);
+#endif
+        }
+
+        DataQuery_t(const DataQuery_t &other) {
+            *this = other;
+        }
+
+        DataQuery_t& operator=(const DataQuery_t &other);
 
         void clear() {
             if (this->fields.size() > 0){
                 this->fields.clear();
             }
-            if (this->records.size() > 0){
-                this->records.clear();
-            }
+            this->bufferUsed = 0;
+            this->cellsUsed = 0;
             this->fieldCount = 0;
             this->recordCount = 0;
+            this->error = false;
+#if !MYSQL_STATIC_STORAGE
+            this->indexCount = 0;
+#endif
+        }
+
+        /**
+         * @brief Pre-allocate memory when the result size is known in advance
+         *
+         * @param bytes Total length of all values
+         * @param rows Number of rows
+         * @return true Memory available
+         */
+        bool reserve(uint32_t bytes, uint32_t rows);
+
+        /**
+         * @brief Copy a recieved row at the end of the result
+         *
+         * @return true Row stored
+         * @return false Out of memory, the row has been dropped
+         */
+        bool addRow(const Row_t &row);
+
+        // True if one or more rows could not be stored
+        bool overflow() const {
+            return this->error;
         }
 
+        /**
+         * @brief Column index of a field, -1 if not found
+         *
+         * The lookup table is built on first call for each result, so when
+         * reading many rows it's better to resolve the index once and then use
+         * the getters that take a column number:
+         *
+         *   int col = data.getFieldIndex("gpio");
+         *   for (uint32_t row = 0; row < data.recordCount; row++)
+         *     data.getInt(row, col);
+         */
+        int getFieldIndex(const char* fieldName);
+
         const char* getRowValue(int row, const char* fieldName) {
-            int index = 0;
-            for (Field_t field : fields) {
-                if (field.name.equals(fieldName)) {
-                    if (records.at(row).record.at(index).length())
-                        return records.at(row).record.at(index).c_str();
-                    else
-                        return "\0";
-                }
-                index++;
-            }
-            return nullptr;
+            return getRowValue(row, getFieldIndex(fieldName));
         }
 
+        // NULL values are returned as empty strings (see isNull())
         const char* getRowValue(int row, int col) {
-            if (row <= recordCount && col <= fieldCount) {
-                if (records.at(row).record.at(col).length())
-                    return records.at(row).record.at(col).c_str();
-                else
-                    return "\0";
-            }
-            return nullptr;
+            const Cell_t *cell = getCell(row, col);
+            return cell ? this->buffer + cell->offset : nullptr;
+        }
+
+        uint32_t getValueLength(int row, int col) {
+            const Cell_t *cell = getCell(row, col);
+            return (cell && cell->length != CELL_NULL) ? cell->length : 0;
+        }
+
+        bool isNull(int row, int col) {
+            const Cell_t *cell = getCell(row, col);
+            return cell ? cell->length == CELL_NULL : true;
+        }
+
+        bool isNull(int row, const char* fieldName) {
+            return isNull(row, getFieldIndex(fieldName));
+        }
+
+        /**
+         * @brief Typed values, decoded directly from the recieved representation
+         *
+         * NULL values and out of range row or col are returned as 0
+         */
+        int64_t getInt(int row, int col);
+        double getDouble(int row, int col);
+        float getFloat(int row, int col) {
+            return (float)getDouble(row, col);
+        }
+        const uint8_t* getBlob(int row, int col, uint32_t *length = nullptr);
+
+        int64_t getInt(int row, const char* fieldName) {
+            return getInt(row, getFieldIndex(fieldName));
+        }
+
+        double getDouble(int row, const char* fieldName) {
+            return getDouble(row, getFieldIndex(fieldName));
+        }
+
+        float getFloat(int row, const char* fieldName) {
+            return getFloat(row, getFieldIndex(fieldName));
+        }
+
+        const uint8_t* getBlob(int row, const char* fieldName, uint32_t *length = nullptr) {
+            return getBlob(row, getFieldIndex(fieldName), length);
         }
 
         const char* getFieldName(int col) {
-            int index = 0;
-            for (Field_t field : fields) {
-                if (index == col)
-                    return field.name.c_str();
-                index++;
-            }
-            return nullptr;
+            if (col < 0 || col >= (int)fields.size())
+                return nullptr;
+            return fields.at(col).name.c_str();
         }
 
         uint16_t fieldCount = 0;
-        uint16_t recordCount = 0;
-        std::vector<Field_t> fields;
-        std::vector<Record_t> records;
+        uint32_t recordCount = 0;
+        FieldList fields;
+
+        FieldList* getFields() {return &fields;}
 
-        std::vector<Field_t>* getFields() {return &fields;}
-        std::vector<Record_t>* getRecords() {return &records;}
+    protected:
+        /**
+         * @brief Store values in memory owned by caller instead of heap
+         *
+         * Rows that don't fit are dropped and reported with overflow().
+         */
+        void useStorage(char *values, uint32_t size, Cell_t *table, uint32_t count) {
+            this->buffer = values;
+            this->bufferSize = size;
+            this->cells = table;
+            this->cellsSize = count;
+            this->fixed = true;
+        }
+
+    private:
+        // Results are copied to and from QueryCache
+        friend class QueryCache;
+
+        // Values buffer
+        char *buffer = nullptr;
+        uint32_t bufferSize = 0;
+        uint32_t bufferUsed = 0;
+
+        // Values position, fieldCount cells for each row
+        Cell_t *cells = nullptr;
+        uint32_t cellsSize = 0;
+        uint32_t cellsUsed = 0;
+
+        bool error = false;
+        bool fixed = false;
+
+#if !MYSQL_STATIC_STORAGE
+        // Open addressing table of (column index + 1) by field name hash, 0 is an empty slot
+        uint16_t *index = nullptr;
+        uint16_t indexSize = 0;
+        uint16_t indexCount = 0;
+#endif
+
+        const Cell_t* getCell(int row, int col) {
+            if (row >= 0 && (uint32_t)row < recordCount && col >= 0 && col < fieldCount)
+                return &this->cells[(uint32_t)row * fieldCount + col];
+            return nullptr;
+        }
+
+        bool growBuffer(uint32_t size);
+        bool growCells(uint32_t count);
+#if !MYSQL_STATIC_STORAGE
+        bool buildIndex();
+#endif
+};
+
+
+/**
+ * @brief Result of a query stored in a buffer of Bytes chars and a table of Rows x Cols values
+ *
+ * No heap is used for values, so RAM needed is known at build time. Each value
+ * takes its length plus 1 byte of Bytes. Rows beyond capacity are dropped
+ * and overflow() is set:
+ *
+ *   StaticDataQuery_t<10, 4, 256> data;
+ *   if (sql.query(data, "SELECT * FROM gpios LIMIT 10") && !data.overflow())
+ *     ...
+ */
+template <uint16_t Rows, uint16_t Cols, uint32_t Bytes>
+class StaticDataQuery_t : public DataQuery_t {
+    public:
+        StaticDataQuery_t() {
+            this->useStorage(mValues, Bytes, mTable, (uint32_t)Rows * Cols);
+        }
+
+        StaticDataQuery_t(const DataQuery_t &other) : StaticDataQuery_t() {
+            DataQuery_t::operator=(other);
+        }
+
+        StaticDataQuery_t(const StaticDataQuery_t &other) : StaticDataQuery_t() {
+            DataQuery_t::operator=(other);
+        }
+
+        StaticDataQuery_t& operator=(const DataQuery_t &other) {
+            DataQuery_t::operator=(other);
+            return *this;
+        }
+
+        StaticDataQuery_t& operator=(const StaticDataQuery_t &other) {
+            DataQuery_t::operator=(other);
+            return *this;
+        }
 
+    private:
+        char mValues[Bytes];
+        Cell_t mTable[(uint32_t)Rows * Cols];
 };
 
 #endif
\ No newline at end of file
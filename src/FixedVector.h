@@ -0,0 +1,179 @@
+/**
+ * @file FixedVector.h
+ * @brief Fixed-capacity containers used instead of std::vector on small MCUs
+ *
+ * With MYSQL_STATIC_STORAGE set (default on AVR) column definitions and
+ * pool sessions are stored in arrays sized at compile time, so the library
+ * does not need ArduinoSTL and RAM used for them is known at build time.
+ * Elements beyond capacity are not stored and reported as overflow.
+ *
+ * Like MYSQL_STATS, these macros must have the same value when the library
+ * is compiled (build flags), defining them in the sketch is not enough.
+ */
+
+#ifndef FIXED_VECTOR_H
+#define FIXED_VECTOR_H
+
+#include <Arduino.h>
+
+#ifndef MYSQL_STATIC_STORAGE
+ #if defined(__AVR__)
+  #define MYSQL_STATIC_STORAGE 1
+ #else
+  #define MYSQL_STATIC_STORAGE 0
+ #endif
+#endif
+
+#if MYSQL_STATIC_STORAGE
+// Max number of columns of a result set, larger results fail
+#ifndef MYSQL_MAX_COLUMNS
+#define MYSQL_MAX_COLUMNS 8
+#endif
+// Max length of column names, longer names are truncated
+#ifndef MYSQL_MAX_NAME_LEN
+#define MYSQL_MAX_NAME_LEN 15
+#endif
+// Max number of sessions of a MySQLPool
+#ifndef MYSQL_POOL_SIZE
+#define MYSQL_POOL_SIZE 2
+#endif
+#else
+#include <vector>
+// MySQL limit of columns for a table
+#ifndef MYSQL_MAX_COLUMNS
+#define MYSQL_MAX_COLUMNS 4096
+#endif
+#endif
+
+
+/**
+ * @brief Subset of std::vector stored in an array of N elements
+ *
+ * push_back() on a full vector drops the element and sets overflow(),
+ * at() and operator[] do not check the index.
+ */
+template <typename T, uint16_t N>
+class FixedVector {
+    public:
+        uint16_t size() const {
+            return mCount;
+        }
+
+        uint16_t capacity() const {
+            return N;
+        }
+
+        bool empty() const {
+            return mCount == 0;
+        }
+
+        bool overflow() const {
+            return mOverflow;
+        }
+
+        void clear() {
+            mCount = 0;
+            mOverflow = false;
+        }
+
+        // Nothing to allocate, false if count elements can't fit
+        bool reserve(uint16_t count) const {
+            return count <= N;
+        }
+
+        bool push_back(const T &item) {
+            if (mCount == N) {
+                mOverflow = true;
+                return false;
+            }
+            mItems[mCount++] = item;
+            return true;
+        }
+
+        T& at(uint16_t i) {
+            return mItems[i];
+        }
+
+        const T& at(uint16_t i) const {
+            return mItems[i];
+        }
+
+        T& operator[](uint16_t i) {
+            return mItems[i];
+        }
+
+        const T& operator[](uint16_t i) const {
+            return mItems[i];
+        }
+
+        T* begin() {
+            return mItems;
+        }
+
+        T* end() {
+            return mItems + mCount;
+        }
+
+        const T* begin() const {
+            return mItems;
+        }
+
+        const T* end() const {
+            return mItems + mCount;
+        }
+
+    private:
+        T mItems[N];
+        uint16_t mCount = 0;
+        bool mOverflow = false;
+};
+
+
+/**
+ * @brief Null-terminated string of at most N chars, with the String methods used for field names
+ *
+ */
+template <uint16_t N>
+class FixedString {
+    public:
+        FixedString() {
+            mText[0] = '\0';
+        }
+
+        FixedString& operator=(const char *text) {
+            this->assign(text, text ? strlen(text) : 0);
+            return *this;
+        }
+
+        // Copy len chars of text, the rest is truncated
+        void assign(const char *text, size_t len) {
+            if (len > N)
+                len = N;
+            if (len)
+                memcpy(mText, text, len);
+            mText[len] = '\0';
+            mLength = len;
+        }
+
+        const char* c_str() const {
+            return mText;
+        }
+
+        unsigned int length() const {
+            return mLength;
+        }
+
+        bool equals(const char *text) const {
+            return text != nullptr && strcmp(mText, text) == 0;
+        }
+
+        operator const char*() const {
+            return mText;
+        }
+
+    private:
+        char mText[N + 1];
+        uint16_t mLength = 0;
+};
+
+#endif
@@ -0,0 +1,320 @@
+#include "Inflate.h"
+
+// Huffman tree, symbols are sorted by code length and then by value
+typedef struct {
+    uint16_t counts[16];
+    uint16_t symbols[288];
+} InflateTree_t;
+
+typedef struct {
+    const uint8_t *src;
+    const uint8_t *srcEnd;
+    uint32_t bits;
+    uint8_t bitCount;
+    uint8_t *dest;
+    uint32_t destLen;
+    uint32_t out;
+    bool error;
+} InflateState_t;
+
+// Base values and extra bits of length (257..285) and distance codes
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_bits[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_bits[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// Order of code length codes in a dynamic block header
+static const uint8_t clc_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+
+static uint32_t get_bits(InflateState_t *s, uint8_t count)
+{
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (s->bitCount == 0) {
+            if (s->src == s->srcEnd) {
+                s->error = true;
+                return 0;
+            }
+            s->bits = *s->src++;
+            s->bitCount = 8;
+        }
+        value |= (s->bits & 1) << i;
+        s->bits >>= 1;
+        s->bitCount--;
+    }
+    return value;
+}
+
+/**
+ * @brief Build a Huffman tree from the code length of each symbol
+ *
+ * @return bool false if lengths are over-subscribed
+ */
+static bool build_tree(InflateTree_t *tree, const uint8_t *lengths, uint16_t count)
+{
+    uint16_t offsets[16];
+
+    memset(tree->counts, 0, sizeof(tree->counts));
+    for (uint16_t i = 0; i < count; i++)
+        tree->counts[lengths[i]]++;
+    tree->counts[0] = 0;
+
+    int32_t left = 1;
+    uint16_t sum = 0;
+    for (uint8_t len = 0; len < 16; len++) {
+        if (len) {
+            left = (left << 1) - tree->counts[len];
+            if (left < 0)
+                return false;
+        }
+        offsets[len] = sum;
+        sum += tree->counts[len];
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        if (lengths[i])
+            tree->symbols[offsets[lengths[i]]++] = i;
+    }
+    return true;
+}
+
+static uint16_t decode_symbol(InflateState_t *s, const InflateTree_t *tree)
+{
+    int32_t sum = 0, cur = 0;
+    uint8_t len = 0;
+
+    do {
+        cur = 2 * cur + get_bits(s, 1);
+        if (++len == 16 || s->error) {
+            s->error = true;
+            return 0;
+        }
+        sum += tree->counts[len];
+        cur -= tree->counts[len];
+    } while (cur >= 0);
+
+    return tree->symbols[sum + cur];
+}
+
+static void build_fixed_trees(InflateTree_t *lt, InflateTree_t *dt)
+{
+    uint8_t lengths[288];
+
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 112);
+    memset(lengths + 256, 7, 24);
+    memset(lengths + 280, 8, 8);
+    build_tree(lt, lengths, 288);
+
+    memset(lengths, 5, 30);
+    build_tree(dt, lengths, 30);
+}
+
+static bool decode_trees(InflateState_t *s, InflateTree_t *lt, InflateTree_t *dt)
+{
+    uint8_t lengths[288 + 32];
+
+    uint16_t hlit = get_bits(s, 5) + 257;
+    uint16_t hdist = get_bits(s, 5) + 1;
+    uint8_t hclen = get_bits(s, 4) + 4;
+    if (hlit > 286 || hdist > 30)
+        return false;
+
+    // Code lengths of code length alphabet, lt is used as temporary tree
+    memset(lengths, 0, 19);
+    for (uint8_t i = 0; i < hclen; i++)
+        lengths[clc_order[i]] = get_bits(s, 3);
+    if (!build_tree(lt, lengths, 19))
+        return false;
+
+    uint16_t num = 0;
+    while (num < hlit + hdist) {
+        uint16_t sym = decode_symbol(s, lt);
+        uint8_t value = 0;
+        uint16_t repeat;
+        if (s->error)
+            return false;
+
+        if (sym < 16) {
+            lengths[num++] = sym;
+            continue;
+        }
+        switch (sym) {
+            case 16:
+                if (num == 0)
+                    return false;
+                value = lengths[num - 1];
+                repeat = 3 + get_bits(s, 2);
+                break;
+            case 17:
+                repeat = 3 + get_bits(s, 3);
+                break;
+            default:
+                repeat = 11 + get_bits(s, 7);
+                break;
+        }
+        if (num + repeat > hlit + hdist)
+            return false;
+        memset(lengths + num, value, repeat);
+        num += repeat;
+    }
+
+    // End of block code is required
+    if (lengths[256] == 0)
+        return false;
+
+    return build_tree(lt, lengths, hlit) && build_tree(dt, lengths + hlit, hdist);
+}
+
+static bool inflate_block(InflateState_t *s, const InflateTree_t *lt, const InflateTree_t *dt)
+{
+    while (true) {
+        uint16_t sym = decode_symbol(s, lt);
+        if (s->error)
+            return false;
+
+        if (sym < 256) {
+            if (s->out == s->destLen)
+                return false;
+            s->dest[s->out++] = sym;
+            continue;
+        }
+        if (sym == 256)
+            return true;
+
+        sym -= 257;
+        if (sym >= 29)
+            return false;
+        uint32_t len = length_base[sym] + get_bits(s, length_bits[sym]);
+
+        uint16_t dsym = decode_symbol(s, dt);
+        if (s->error || dsym >= 30)
+            return false;
+        uint32_t dist = dist_base[dsym] + get_bits(s, dist_bits[dsym]);
+
+        if (s->error || dist > s->out || s->out + len > s->destLen)
+            return false;
+
+        // Source and destination can overlap
+        const uint8_t *from = s->dest + s->out - dist;
+        for (uint32_t i = 0; i < len; i++)
+            s->dest[s->out + i] = from[i];
+        s->out += len;
+    }
+}
+
+static bool inflate_stored(InflateState_t *s)
+{
+    // Skip remaining bits of current byte
+    s->bitCount = 0;
+
+    if (s->srcEnd - s->src < 4)
+        return false;
+    uint16_t len = s->src[0] | (s->src[1] << 8);
+    uint16_t nlen = s->src[2] | (s->src[3] << 8);
+    s->src += 4;
+    if (len != (uint16_t)~nlen)
+        return false;
+
+    if ((uint32_t)(s->srcEnd - s->src) < len || s->out + len > s->destLen)
+        return false;
+    memcpy(s->dest + s->out, s->src, len);
+    s->src += len;
+    s->out += len;
+    return true;
+}
+
+
+/**
+ * @brief Adler-32 checksum (RFC 1950)
+ *
+ */
+static uint32_t adler32(const uint8_t *data, uint32_t len)
+{
+    uint32_t a = 1, b = 0;
+    while (len) {
+        // Sums can't overflow 32 bits before 5552 bytes
+        uint32_t block = (len < 5552) ? len : 5552;
+        len -= block;
+        while (block--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+/**
+ * @brief Decompress a zlib stream (2 bytes header, deflate blocks, adler32)
+ *
+ */
+int32_t zlibInflate(uint8_t *dest, uint32_t destLen, const uint8_t *source, uint32_t sourceLen)
+{
+    InflateTree_t lt, dt;
+    InflateState_t s;
+
+    // Compression method 8 (deflate), no preset dictionary
+    if (sourceLen < 6)
+        return -1;
+    if ((source[0] & 0x0F) != 8 || ((source[0] << 8) | source[1]) % 31 || (source[1] & 0x20))
+        return -1;
+
+    s.src = source + 2;
+    s.srcEnd = source + sourceLen;
+    s.bits = 0;
+    s.bitCount = 0;
+    s.dest = dest;
+    s.destLen = destLen;
+    s.out = 0;
+    s.error = false;
+
+    uint32_t final;
+    do {
+        final = get_bits(&s, 1);
+        uint32_t type = get_bits(&s, 2);
+        bool ok;
+
+        switch (type) {
+            case 0:
+                ok = inflate_stored(&s);
+                break;
+            case 1:
+                build_fixed_trees(&lt, &dt);
+                ok = inflate_block(&s, &lt, &dt);
+                break;
+            case 2:
+                ok = decode_trees(&s, &lt, &dt) && inflate_block(&s, &lt, &dt);
+                break;
+            default:
+                ok = false;
+                break;
+        }
+        if (!ok || s.error)
+            return -1;
+    } while (!final);
+
+    // Adler-32 of output follows the last block (big endian), from next byte
+    if (s.srcEnd - s.src < 4)
+        return -1;
+    uint32_t checksum = ((uint32_t)s.src[0] << 24) | ((uint32_t)s.src[1] << 16) | ((uint32_t)s.src[2] << 8) | s.src[3];
+    if (adler32(dest, s.out) != checksum)
+        return -1;
+    return s.out;
+}
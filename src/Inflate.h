@@ -0,0 +1,20 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Decompress a zlib stream (RFC 1950 / RFC 1951)
+ *
+ * The whole output is kept in dest and used as window, so no other buffer
+ * is needed: decoding tables are built on the stack (about 1.3KB).
+ *
+ * @param dest Destination buffer
+ * @param destLen Size of destination buffer
+ * @param source zlib stream
+ * @param sourceLen Length of zlib stream
+ * @return int32_t Number of bytes written in dest, -1 if stream is not valid (Adler-32 too) or dest too small
+ */
+int32_t zlibInflate(uint8_t *dest, uint32_t destLen, const uint8_t *source, uint32_t sourceLen);
+
+#endif
@@ -1,5 +1,32 @@
 #include "MySQL.h"
 
+#define COM_QUIT  0x01
+#define COM_QUERY 0x03
+#define COM_PING  0x0E
+#define COM_CHANGE_USER       0x11
+#define COM_RESET_CONNECTION  0x1F
+
+// Authentication plugins supported
+static const char NATIVE_PASSWORD[] = "mysql_native_password";
+static const char CACHING_SHA2_PASSWORD[] = "caching_sha2_password";
+
+/**
+ * @brief Authentication plugin from its name (len chars, not null-terminated)
+ *
+ */
+static uint8_t auth_plugin(const char *name, size_t len)
+{
+    if (len == sizeof(NATIVE_PASSWORD) - 1 && memcmp(name, NATIVE_PASSWORD, len) == 0)
+        return MySQL::AUTH_NATIVE_PASSWORD;
+    if (len == sizeof(CACHING_SHA2_PASSWORD) - 1 && memcmp(name, CACHING_SHA2_PASSWORD, len) == 0)
+        return MySQL::AUTH_CACHING_SHA2;
+    return MySQL::AUTH_NONE;
+}
+
+static const char* auth_plugin_name(uint8_t plugin)
+{
+    return (plugin == MySQL::AUTH_CACHING_SHA2) ? CACHING_SHA2_PASSWORD : NATIVE_PASSWORD;
+}
 
 
 /**
@@ -12,7 +39,6 @@ MySQL::MySQL(Client *pClient, const char *server_ip, uint16_t port) : mServerIP(
 {
     mPort = port;
     client = pClient;
-    packet  = new MySQL_Packet();
 }
 
 /**
@@ -23,7 +49,16 @@ MySQL::~MySQL(void)
 {
     //Close MySQL Session
     this->disconnect();
-    this->free_recieved_packets();
+    this->rx_reset();
+    this->z_reset();
+#if !MYSQL_STATIC_STORAGE
+    free(mColumns);
+#endif
+    free(server_version);
+
+    // Password digests are as good as the password to login
+    memset(mPwdStage1, 0, sizeof(mPwdStage1));
+    memset(mPwdStage2, 0, sizeof(mPwdStage2));
 }
 
 
@@ -65,12 +100,39 @@ bool MySQL::connect(const char *user, const char *password, const char* db)
 {
     if (client == nullptr)
         return false;
+
+    // Drop any query left running on previous connection
+    QueryCallback dropped = (mState != QUERY_IDLE) ? mOnDone : nullptr;
+    finish_query();
+    mMoreResults = false;
+    mResult = nullptr;
+    mOnDone = nullptr;
+    if (mStatement != nullptr)
+        mStatement->drain(false, false);
+
+    bool ret = this->open_session(user, password, db);
+
+    // Reported once the session is set up, the callback may start a new query
+    if (dropped != nullptr) {
+        if (ret)
+            error_message = "Query dropped by connect()";
+        dropped(this, false, mDoneUserData);
+    }
+    return ret;
+}
+
+
+/**
+ * @brief Open connection and log in, used by connect()
+ */
+bool MySQL::open_session(const char *user, const char *password, const char* db)
+{
     bool connected = false;
 
     int retries = 5;
     // Retry up to MAX_CONNECT_ATTEMPTS times.
     while (retries--) {
-        connected = client->connect(mServerIP, 3306);
+        connected = client->connect(mServerIP, mPort);
         if (connected ) {
             break;
         }
@@ -81,22 +143,35 @@ bool MySQL::connect(const char *user, const char *password, const char* db)
     if (!connected )
         return false;
 
-    //Set socket Timeout
-    client->setTimeout(1000);
+    // Handshake and authentication are never compressed
+    mCompress = false;
+    z_reset();
+    rx_reset();
+
+    // Cached results may be of another server or database
+    if (mCache != nullptr)
+        mCache->invalidate();
 
-    //Read hadshake packet
-    flush_packet();
+    // Read and parse handshake packet, then send authentification to server
+    connected = recieve() && parse_handshake_packet(&packet);
+    if (connected) {
+        rx_reset();
+        connected = send_authentication_packet(user, password, db) && read_auth_result(password);
+    }
 
-    //Parse packet
-    parse_handshake_packet();
+    if (!connected) {
+        rx_reset();
+        client->stop();
+        return false;
+    }
 
-    //Send authentification to server
-    connected = (send_authentication_packet(user, password, db) > 0) ? true : false;
+    // Packets following authentication are compressed, if negotiated
+    mCompress = (mCapabilities & CLIENT_COMPRESS);
 
     Serial.print(CONNECTED);
     Serial.print(server_version);
     Serial.print("\n");
-    return connected;
+    return true;
 }
 
 
@@ -108,13 +183,111 @@ bool MySQL::connect(const char *user, const char *password, const char* db)
  */
 bool MySQL::disconnect()
 {
-    uint8_t COM_QUIT[] = {0x01, 0x00, 0x00, 0x00, 0x01};
+    //Send COM_QUIT packet (Payload : 0x01), server does not reply
+    bool ret = this->send_command(COM_QUIT, nullptr, 0);
+    MYSQL_STATS_DO(if (ret) this->stats_end(true));
+    return ret;
+}
 
-    //Send COM_QUIT packet (Payload : 0x01)
-    if (this->write((char *)COM_QUIT, 5) > 0)
-        return true;
+/**
+ * @brief Check if the session is still alive (COM_PING)
+ *
+ * @return true Server replied OK
+ * @return false Connection lost or server error
+ */
+bool MySQL::ping()
+{
+    return this->command_ok(COM_PING);
+}
 
-    return false;
+/**
+ * @brief Reset the session state without closing the connection (COM_RESET_CONNECTION)
+ *
+ * @return true Server replied OK
+ * @return false Connection lost or server error (MySQL older than 5.7.3)
+ */
+bool MySQL::resetSession()
+{
+    // Results may depend on user variables and temporary tables
+    if (mCache != nullptr)
+        mCache->invalidate();
+    return this->command_ok(COM_RESET_CONNECTION);
+}
+
+/**
+ * @brief Send a command without arguments, answered with OK or ERR
+ *
+ * @return true Server replied OK
+ */
+bool MySQL::command_ok(uint8_t command)
+{
+    if (client == nullptr || !client->connected() || mState != QUERY_IDLE)
+        return false;
+
+    if (!this->send_command(command, nullptr, 0))
+        return false;
+
+    bool ret = this->recieve();
+    if (ret && packet.getPacketType() == PACKET_ERR) {
+        this->parse_error_packet(&packet, packet.getPacketLength());
+        ret = false;
+    }
+    else if (ret && packet.getPacketType() != PACKET_OK) {
+        ret = false;
+    }
+    else if (ret) {
+        this->parse_ok_packet(&packet);
+    }
+    MYSQL_STATS_DO(this->stats_end(ret));
+    return ret;
+}
+
+/**
+ * @brief Authenticate again on the open connection as another user (COM_CHANGE_USER)
+ *
+ * Password is scrambled with the seed of connection handshake, the server
+ * can ask for another one (auth switch) as in connect().
+ *
+ * @return true Session is now of user, on db
+ * @return false Login failed (server may close the connection) or connection lost
+ */
+bool MySQL::changeUser(const char *user, const char *password, const char *db)
+{
+    if (client == nullptr || !client->connected() || mState != QUERY_IDLE)
+        return false;
+
+    this->drain_results();
+    this->clear_status();
+    this->rx_reset();
+    if (mCache != nullptr)
+        mCache->invalidate();
+    MYSQL_STATS_DO(this->stats_begin());
+
+    uint8_t auth[SHA256_DIGEST_SIZE];
+    uint8_t auth_len = this->scramble_password(password, mSeed, auth);
+
+    // Command, user, auth response, database (empty for none), charset and plugin name
+    uint8_t command = COM_CHANGE_USER;
+    uint8_t charset[2] = {0x08, 0x00};
+    size_t user_len = strlen(user) + 1;
+    if (db == nullptr)
+        db = "";
+    size_t db_len = strlen(db) + 1;
+    const char *plugin = auth_plugin_name(mAuthPlugin);
+    size_t plugin_len = (mCapabilities & CLIENT_PLUGIN_AUTH) ? strlen(plugin) + 1 : 0;
+
+    bool sent = this->tx_packet(1 + user_len + 1 + auth_len + db_len + sizeof(charset) + plugin_len, 0)
+        && this->tx_append(&command, 1)
+        && this->tx_append(user, user_len)
+        && this->tx_append(&auth_len, 1)
+        && this->tx_append(auth, auth_len)
+        && this->tx_append(db, db_len)
+        && this->tx_append(charset, sizeof(charset))
+        && this->tx_append(plugin, plugin_len)
+        && this->tx_flush();
+    bool ret = sent && this->read_auth_result(password);
+    MYSQL_STATS_DO(this->stats_end(ret));
+    return ret;
 }
 
 /**
@@ -130,16 +303,26 @@ bool MySQL::connected() {
 /**
  * @brief Recieve MySQL packet over TCP socket
  *
- * @return true recieved and stores MySQL packet
+ * The packet is parsed in place: this->packet points to the payload inside
+ * tcp_socket_buffer and it's valid until next call (see MySQL_Packet::keep()).
+ *
+ * Without wait only the bytes already available on socket are read, and false
+ * is returned until the whole packet has been recieved (the bytes are kept).
+ * Packets larger than tcp_socket_buffer are always read blocking.
+ *
+ * @param wait Block until packet is complete or timeout
+ * @return true recieved MySQL packet
  * @return false nothing to read or MySQL packet corrupted
  */
-bool MySQL::recieve(void) {
+bool MySQL::recieve(bool wait) {
 
-    // Number of bytes recieved over TCP socket
-    int recv_len = 0;
+    // Release the packet returned by previous call
+    this->rx_consume();
+    mRxSkipped = false;
 
     // Setup TCP Socket
-    this->client->setTimeout(5000);
+    this->client->setTimeout(mTimeout);
+
     /**
      * Recieve packet header.
      *
@@ -147,604 +330,1834 @@ bool MySQL::recieve(void) {
      * - The payload length (encoded int<3>)
      * - The sequence ID    (encoded int<1>)
      */
-    recv_len = this->client->readBytes(tcp_socket_buffer, 4);
+    if (!this->rx_require(4, wait))
+        return false;
 
-    if (recv_len == 4) {
-        // Class containing packet header and payload
-        MySQL_Packet *packet  = new MySQL_Packet();
+    const uint8_t *header = tcp_socket_buffer + mRxHead;
 
-        // First 3 bytes are the payload lenth
-        packet->mPayloadLength = readFixedLengthInt(tcp_socket_buffer, 0, 3);
+    // First 3 bytes are the payload lenth
+    uint32_t payload_len = readFixedLengthInt(header, 0, 3);
 
-        // Fourth byte is the sequence ID
-        packet->mPacketNumber = readFixedLengthInt(tcp_socket_buffer, 3, 1);
+    // Fourth byte is the sequence ID
+    uint32_t sequence_id = readFixedLengthInt(header, 3, 1);
 
-        // Serial.printf("Packet #%d, length %d bytes\n", packet->mPacketNumber, packet->mPayloadLength);
+    /**
+     * The following bytes are the actual
+     * payload, we must match the payload
+     * size once we recieved the 4 bytes.
+     */
+    if (payload_len + 4 > BUFF_SIZE || payload_len == MAX_PACKET_PAYLOAD)
+        return this->recieve_large(payload_len, sequence_id);
 
-        if (packet->mPayloadLength <= BUFF_SIZE) {
-            memset(tcp_socket_buffer, 0, BUFF_SIZE);
+    if (!this->rx_require(payload_len + 4, wait))
+        return false;
 
-            /**
-             * The following bytes are the actual
-             * payload, we must match the payload
-             * size once we recieved the 4 bytes.
-             */
-            recv_len = this->client->readBytes(tcp_socket_buffer, packet->mPayloadLength);
+    packet.attach(tcp_socket_buffer + mRxHead + 4, payload_len, sequence_id);
+    mRxPacketSize = payload_len + 4;
+    MYSQL_STATS_DO(mStats.packetsIn++);
+    return true;
+}
 
-            if (recv_len == (int)(packet->mPayloadLength)) {
-                packet->mPayload = (uint8_t *)calloc((size_t)(packet->mPayloadLength), sizeof(uint8_t));
-                memcpy(packet->mPayload, tcp_socket_buffer, (size_t)(packet->mPayloadLength));
-                this->mPacketsRecieved.push_back(packet);
-                return true;
+/**
+ * @brief Recieve a packet that does not fit in tcp_socket_buffer
+ *
+ * Payload is joined with the following packets when its length is 0xFFFFFF
+ * (payload of 16MB or more), and stored in a buffer allocated only for
+ * this packet: it is released as soon as next packet is recieved.
+ *
+ * Payloads larger than MYSQL_MAX_PACKET_SIZE, or that can't be allocated,
+ * are read and dropped so that next packets can be recieved: false is
+ * returned with mRxSkipped set.
+ *
+ * @param payload_len Length of first packet payload
+ * @param sequence_id Sequence ID of first packet
+ * @return true recieved MySQL packet
+ * @return false packet dropped or timeout
+ */
+bool MySQL::recieve_large(uint32_t payload_len, uint32_t sequence_id) {
+
+    // Skip header of first packet
+    mRxHead += 4;
+    uint32_t total_len = 0;
+    bool skip = false;
+
+    while (true) {
+        if (!skip) {
+            uint8_t *spill = nullptr;
+            bool fits = (uint64_t)total_len + payload_len <= MYSQL_MAX_PACKET_SIZE;
+            if (fits)
+                spill = (uint8_t *)realloc(mSpill, total_len + payload_len + 1);
+            if (spill == nullptr) {
+                error_message = fits ? "Out of memory for a large packet" : "Packet larger than MYSQL_MAX_PACKET_SIZE";
+                free(mSpill);
+                mSpill = nullptr;
+                skip = true;
+            }
+            else {
+                mSpill = spill;
+            }
+        }
+
+        if (skip) {
+            if (!this->rx_skip(payload_len)) {
+                this->rx_reset();
+                return false;
+            }
+        }
+        else {
+            // Payload bytes already recieved, the rest is read directly from socket
+            size_t buffered = mRxTail - mRxHead;
+            if (buffered > payload_len)
+                buffered = payload_len;
+            memcpy(mSpill + total_len, tcp_socket_buffer + mRxHead, buffered);
+            mRxHead += buffered;
+            if (mRxHead == mRxTail)
+                mRxHead = mRxTail = 0;
+
+            size_t missing = payload_len - buffered;
+            if (missing && this->net_read_bytes(mSpill + total_len + buffered, missing) != missing) {
+                this->rx_reset();
+                return false;
             }
+            total_len += payload_len;
+        }
+
+        if (payload_len < MAX_PACKET_PAYLOAD)
+            break;
+
+        // Next packet carries the rest of payload
+        if (!this->rx_require(4)) {
+            this->rx_reset();
+            return false;
         }
+        payload_len = readFixedLengthInt(tcp_socket_buffer + mRxHead, 0, 3);
+        sequence_id = readFixedLengthInt(tcp_socket_buffer + mRxHead, 3, 1);
+        mRxHead += 4;
     }
-    return false;
+
+    if (skip) {
+        mRxSkipped = true;
+        return false;
+    }
+
+    packet.attach(mSpill, total_len, sequence_id);
+    mRxPacketSize = 0;
+    MYSQL_STATS_DO(mStats.packetsIn++);
+    return true;
 }
 
 /**
- * @brief Send bytes over TCP socket to MySQL server
+ * @brief Read and drop len bytes of payload, buffered ones first
  *
- * @param message
- * @param len
- * @return int
+ * @return false timeout
  */
-uint16_t MySQL::write(char *message, uint16_t len) {
-    //Send raw data to socket
-    return client->write((const uint8_t *)message, len);
+bool MySQL::rx_skip(uint32_t len) {
+    size_t buffered = mRxTail - mRxHead;
+    if (buffered > len)
+        buffered = len;
+    mRxHead += buffered;
+    len -= buffered;
+    if (mRxHead == mRxTail)
+        mRxHead = mRxTail = 0;
+
+    // The whole buffer is free, it's used to read the rest
+    while (len) {
+        size_t chunk = (len < BUFF_SIZE) ? len : BUFF_SIZE;
+        if (this->net_read_bytes(tcp_socket_buffer, chunk) != chunk)
+            return false;
+        len -= chunk;
+    }
+    return true;
 }
 
 /**
- * @brief Send a simple query and expect Table as result
- * @param Database Database structure to store results
- * @param pQuery Query
- * @return bool state
+ * @brief Make at least len bytes available in tcp_socket_buffer from mRxHead
+ *
+ * Bytes already waiting on the socket are read in one call even if they
+ * belong to next packets, so small packets (rows) do not cost one read each.
+ *
+ * @param len Number of bytes needed
+ * @param wait Block until bytes are recieved, otherwise read only available bytes
+ * @return true bytes available
+ * @return false timeout (or not yet recieved) or len bigger than buffer
  */
-bool MySQL::query(DataQuery_t & dataquery, const char *pQuery) {
-
-    uint16_t tcp_socket_write_size = 0;
-    memset(tcp_socket_buffer, 0, BUFF_SIZE);
-
-    // Free recieved packets
-    this->free_recieved_packets();
-
-    // packet_len without header
-    int payload_len = strlen(pQuery) + 1;
-
-    // payload_len + 4
-    int packet_len = payload_len + 4;
-
-    // Check if query is sendable over TCP socket by checking final size
-    if (packet_len <= BUFF_SIZE) {
-        /**
-         * Now that we are sure user did not sent
-         * a query too big for TCP socket we can
-         * prepare the query packet before sending
-         * it.
-         *
-         * Packet layout :
-         * int<3>	    payload_length
-         * int<1>	    sequence_id
-         * string<var>	payload
-         *
-         * Source : https://dev.mysql.com/doc/internals/en/mysql-packet.html
-         */
-
-        // Payload length
-        store_int((uint8_t *)tcp_socket_buffer, payload_len, 3);
-
-        // Sequence ID to 0 : initiator
-        tcp_socket_buffer[3] = 0;
-
-        // Query type to 0x03 (COM_QUERY)
-        tcp_socket_buffer[4] = 0x03;
-
-        // Copy request into payload skipping first byte which is the COM type
-        memcpy(tcp_socket_buffer + 5, pQuery, payload_len - 1);
-
-        // Write data over TCP socket
-        tcp_socket_write_size = this->write((char *)tcp_socket_buffer, packet_len);
-
-        // Check if TCP socket managed to send packet
-        if (tcp_socket_write_size == packet_len) {
-            /**
-             * Query completely sent over TCP
-             * socket to server, we now have to :
-             * - Recieve server response
-             * - Parse server response into packets
-             * - Notify user on com status
-             *
-             * After a query, there is multiple
-             * server response possible :
-             * - ERR : Error packet containing a string
-             * - OK : Query completed without expecting further information/data
-             * - Table response
-             *      - Field count (length encoded int)
-             *      - [n] Fields
-             *      - EOF
-             *      - [?] ROW (Until following EOF or ERR)
-             *      - EOF or ERR
-             *
-             * Source : https://dev.mysql.com/doc/internals/en/com-query-response.html
-             */
-
-            // Used to track recieve function return
-            bool tcp_packet_status = false;
-
-            // MySQL packet type
-            Packet_Type type = PACKET_UNKNOWN;
-
-            // Recieve one packet
-            tcp_packet_status = this->recieve();
-
-            if (tcp_packet_status) {
-                /**
-                 * Packet has been recieved entirely.
-                 * we must check if first byte of
-                 * payload is 0xFE.
-                 * In that case it may either be :
-                 * - Length encoded integer (Payload > 8 bytes)
-                 * - EOF packet
-                 */
-                type = this->mPacketsRecieved.at(0)->getPacketType();
-
-                if (type == PACKET_TEXTRESULTSET) {
-                    /**
-                     * We must follow the TextResultSet pattern
-                     * Source : https://dev.mysql.com/doc/internals/en/com-query-response.html#packet-ProtocolText::Resultset
-                     */
-
-                    // Fields
-                    while (tcp_packet_status && (type != PACKET_EOF)) {
-                        // Recieve one MySQL packet over TCP socket
-                        tcp_packet_status = this->recieve();
-
-                        if (tcp_packet_status) {
-                            // Get the last packet type
-                            type = this->mPacketsRecieved.at(this->mPacketsRecieved.size() - 1)->getPacketType();
-                        }
-                    }
+bool MySQL::rx_require(size_t len, bool wait) {
+    if (mRxTail - mRxHead >= len)
+        return true;
 
-                    // Reset type to loop for rows
-                    type = PACKET_UNKNOWN;
+    if (len > BUFF_SIZE)
+        return false;
 
-                    // Rows
-                    while (tcp_packet_status && (type != PACKET_EOF) && (type != PACKET_ERR)) {
-                        // Recieve one MySQL packet over TCP socket
-                        tcp_packet_status = this->recieve();
+    // Move unread bytes at buffer start, so the packet will be contiguous
+    if (mRxHead + len > BUFF_SIZE) {
+        memmove(tcp_socket_buffer, tcp_socket_buffer + mRxHead, mRxTail - mRxHead);
+        mRxTail -= mRxHead;
+        mRxHead = 0;
+    }
 
-                        if (tcp_packet_status) {
-                            // Get the last packet type
-                            type = this->mPacketsRecieved.at(this->mPacketsRecieved.size() - 1)->getPacketType();
-                        }
-                    }
+    while (mRxTail - mRxHead < len) {
+        size_t missing = len - (mRxTail - mRxHead);
+        size_t room = BUFF_SIZE - mRxTail;
+        size_t avail = this->net_available();
 
-                    if (tcp_packet_status) {
-                        return this->parse_textresultset(&dataquery);
-                    }
-                    this->free_recieved_packets();
-                    return false;
-                }
-                else if (type == PACKET_ERR) {
-                    this->parse_error_packet(
-                        this->mPacketsRecieved.at(this->mPacketsRecieved.size() - 1),
-                        this->mPacketsRecieved.at(this->mPacketsRecieved.size() - 1)->getPacketLength()
-                    );
-                    this->free_recieved_packets();
-                    return false;
-                }
-                this->free_recieved_packets();
-                return true;
-            }
+        if (!wait) {
+            if (avail == 0)
+                return false;
+            if (avail > room)
+                avail = room;
+            int recv_len = this->net_read(tcp_socket_buffer + mRxTail, avail);
+            if (recv_len <= 0)
+                return false;
+            mRxTail += recv_len;
+            continue;
         }
+
+        // Read all available bytes, or block only for the missing ones
+        size_t read_len = (avail > missing) ? avail : missing;
+        if (read_len > room)
+            read_len = room;
+
+        int recv_len = this->net_read_bytes(tcp_socket_buffer + mRxTail, read_len);
+        if (recv_len <= 0)
+            return false;
+        mRxTail += recv_len;
     }
-    this->free_recieved_packets();
-    return false;
+    return true;
 }
 
 /**
- * @brief Free packets vector content and empties it
+ * @brief Release the last recieved packet from tcp_socket_buffer
  *
  */
-void MySQL::free_recieved_packets(void)
-{
-    if (this->mPacketsRecieved.size() > 0) {
-        for (size_t i = 0; i < this->mPacketsRecieved.size(); i++)  {
-            delete this->mPacketsRecieved.at(i);
-        }
-        this->mPacketsRecieved.clear();
-    }
+void MySQL::rx_consume(void) {
+    mRxHead += mRxPacketSize;
+    mRxPacketSize = 0;
+    if (mRxHead == mRxTail)
+        mRxHead = mRxTail = 0;
+    packet.attach(nullptr, 0, 0);
+    free(mSpill);
+    mSpill = nullptr;
 }
 
-
 /**
- * @brief Parses recieved packets considered as a table result
+ * @brief Discard any recieved byte, buffer can be used to send a new command
  *
- * @return true Table parsed
- * @return false Unable to parse table
  */
-bool MySQL::parse_textresultset(DataQuery_t* database)
-{
-    // Used to keep track of the actual packet
-    int packet_offset = 0;
-    Packet_Type packet_type = PACKET_OK;
-    const uint8_t *packet = nullptr;
-
-    packet = this->mPacketsRecieved.at(packet_offset)->mPayload;
-    packet_type = this->mPacketsRecieved.at(packet_offset)->getPacketType();
-
-    //Store the column count into the table structure
-    database->fieldCount = readFixedLengthInt(packet, 0, 1);
-
-    for (int i = 0; packet_type != PACKET_EOF; i++) {
-        //Check the next packet type to exit the for loop if needed
-        packet_offset++;
-        packet = this->mPacketsRecieved.at(packet_offset)->mPayload;
-        packet_type = this->mPacketsRecieved.at(packet_offset)->getPacketType();
-        #if DEBUG
-            printRawBytes(packet, this->mPacketsRecieved.at(packet_offset)->getPacketLength());
-        #endif
-
-        if (packet_type == PACKET_EOF)
-            break;
-
-        int offset = 0;
-        int str_len = readLenEncInt(packet, offset);    // def
-        offset += str_len + 1;
-
-        // Skip database name and table name (we know in advance, no need to parse it)
-        for (int i =0; i<3; i++) {
-            offset += readLenEncInt(packet, offset) + 1 ;
-        }
-
-        // Allocate enougth memory and get field name (this can be an alias)
-        str_len = readLenEncInt(packet, offset);
-        char * field_name = (char*)malloc((str_len + 1) * sizeof(char));
-        offset += 1 + readLenEncString(field_name, packet, offset);
+void MySQL::rx_reset(void) {
+    this->rx_discard();
+
+    // Compressed packets left of a response that could not be decoded
+    if (mZDrop) {
+        if (mCompress && client->connected())
+            this->z_drop();
+        mZDrop = (mZHeaderLen != 0);
+    }
 
-        // Create new Field_t field in order to add to std::vector
-        Field_t field;
-        field.name = field_name;
-        #if DEBUG
-            this->printf_n(Serial, 64, "next offset %02X, field %s\n", offset, field.name.c_str());
-        #endif
+    // Next command starts a new compressed sequence
+    mZSequence = 0;
+}
 
-        //  Reallocate enougth memory and get the real name of field (NO alias)
-        str_len = readLenEncInt(packet, offset);
-        field_name = (char*)realloc(field_name, (str_len + 1) * sizeof(char));
-        offset += 1 + readLenEncString(field_name, packet, offset);
+/**
+ * @brief Discard any recieved byte in the middle of an exchange (reply to auth switch)
+ *
+ * Unlike rx_reset(), the compressed sequence goes on.
+ */
+void MySQL::rx_discard(void) {
+    mRxHead = mRxTail = mRxPacketSize = 0;
+    packet.attach(nullptr, 0, 0);
+    free(mSpill);
+    mSpill = nullptr;
+
+    // Decompressed bytes too
+    mZOutPos = mZOutLen;
+}
 
-        // Offset for field size (field name length + 3)
-        field.size = readFixedLengthInt(packet, offset + 3, 4);
+/**
+ * @brief Send bytes over TCP socket to MySQL server
+ *
+ * @param message
+ * @param len
+ * @return int
+ */
+size_t MySQL::write(const char *message, size_t len) {
+    size_t ret;
+#if MYSQL_STATS
+    uint32_t start = micros();
+#endif
 
-        free(field_name);    // Free memory
-        database->fields.push_back(field);
+    //Send raw data to socket
+    if (!mCompress) {
+        ret = client->write((const uint8_t *)message, len);
+    }
+    else {
+        // Compressed protocol: data is sent as is (uncompressed length 0)
+        uint8_t header[7];
+        store_int(header, len, 3);
+        header[3] = mZSequence++;
+        store_int(header + 4, 0, 3);
+        ret = 0;
+        if (client->write(header, sizeof(header)) == sizeof(header))
+            ret = client->write((const uint8_t *)message, len);
+        MYSQL_STATS_DO(mStats.bytesOut += sizeof(header));
     }
 
-    packet_offset++;
-    packet = this->mPacketsRecieved.at(packet_offset)->mPayload;
-    packet_type = this->mPacketsRecieved.at(packet_offset)->getPacketType();
-    #if DEBUG
-        printRawBytes(packet, this->mPacketsRecieved.at(packet_offset)->getPacketLength());
-    #endif
+    MYSQL_STATS_DO(
+        mStatsSent = micros();
+        mStats.sendTime += mStatsSent - start;
+        mStats.bytesOut += ret
+    );
+    return ret;
+}
 
-    // Row parsing : if the recieved packet is not an EOF or ERR packet
-    if (packet_type == PACKET_TEXTRESULTSET) {
-
-        for (int row = 0; packet_type != PACKET_EOF; row++) {
-            int str_offset = 0;
-
-            // Increment number of rows
-            database->recordCount = row + 1;
-
-            // Get row values
-            Record_t newRecord;
-            for (int col = 0; col < database->fieldCount; col++) {
-                int str_size = readLenEncInt(packet, str_offset);               // Get string length
-                char * value = (char*)malloc((str_size + 2) * sizeof(char));    // Allocate enougth memory
-                str_offset += 1 + readLenEncString(value, packet, str_offset);  // Get te text
-                #if DEBUG
-                    this->printf_n(Serial, 128, "Field value: %s, length %d\n", str_offset, value, str_size);
-                #endif
-                newRecord.record.push_back(value);
-                free(value);    // Free memory
-            }
-            database->records.push_back(newRecord);
-
-            // Increment offset
-            packet_offset++;
-            packet = this->mPacketsRecieved.at(packet_offset)->mPayload;
-            packet_type = this->mPacketsRecieved.at(packet_offset)->getPacketType();
-            #if DEBUG
-                printRawBytes(packet, this->mPacketsRecieved.at(packet_offset)->getPacketLength());
-            #endif
-        }
+/**
+ * @brief Number of bytes that can be read without waiting
+ *
+ * With compressed protocol these are the decompressed bytes,
+ * a new compressed packet is inflated when it's completely recieved.
+ */
+size_t MySQL::net_available(void) {
+    if (!mCompress)
+        return client->available();
 
+    if (mZOutPos == mZOutLen)
+        this->z_recieve(false);
+    return mZOutLen - mZOutPos;
+}
 
-        this->free_recieved_packets();
-        return true;
+/**
+ * @brief Read bytes already recieved, never blocks
+ *
+ * @return int Number of bytes read, 0 or less if nothing to read
+ */
+int MySQL::net_read(uint8_t *buf, size_t len) {
+    if (!mCompress) {
+        int ret = client->read(buf, len);
+        MYSQL_STATS_DO(this->stats_bytes_in(ret));
+        return ret;
     }
-    this->free_recieved_packets();
-    return false;
-}
 
-/*
-  parse_error_packet - Display the error returned from the server
+    size_t avail = this->net_available();
+    if (len > avail)
+        len = avail;
+    memcpy(buf, mZOut + mZOutPos, len);
+    mZOutPos += len;
+    return len;
+}
 
-  This method parses an error packet from the server and displays the
-  error code and text via Serial.print. The error packet is defined
-  as follows.
+/**
+ * @brief Read len bytes, blocking until they are recieved or timeout
+ *
+ * @return size_t Number of bytes read
+ */
+size_t MySQL::net_read_bytes(uint8_t *buf, size_t len) {
+    if (!mCompress) {
+        size_t ret = client->readBytes(buf, len);
+        MYSQL_STATS_DO(this->stats_bytes_in(ret));
+        return ret;
+    }
 
-  Bytes                       Name
-  -----                       ----
-  1                           field_count, always = 0xff
-  2                           errno
-  1                           (sqlstate marker), always '#'
-  5                           sqlstate (5 characters)
-  n                           message
-*/
-void MySQL::parse_error_packet(const MySQL_Packet *packet, uint16_t packet_len )
-{
+    size_t done = 0;
+    while (done < len) {
+        if (mZOutPos == mZOutLen && !this->z_recieve(true))
+            break;
 
-    Serial.print("************** SQL Error *****************\n");
-    memcpy(SQL_state, packet->mPayload + 4, 5);
-    SQL_state[5] = '\0';
-    Serial.print("SQLSTATE = ");
-    Serial.print(SQL_state);
-    Serial.print("\n");
-    error_message = "";
-    for (int i = 9; i < packet_len-4; i++) {
-        char ch = (char)packet->mPayload[i];
-        if (ch != '\0') {
-            Serial.print(ch);
-            error_message += ch;
-        }
-         else
-            continue;
+        size_t copy_len = mZOutLen - mZOutPos;
+        if (copy_len > len - done)
+            copy_len = len - done;
+        memcpy(buf + done, mZOut + mZOutPos, copy_len);
+        mZOutPos += copy_len;
+        done += copy_len;
     }
-    
-    Serial.print("\n******************************************\n\n");
-    // printRawBytes(packet->mPayload, packet_len);
+    return done;
 }
 
-
 /**
- * @brief Hash password using server seed
+ * @brief Recieve a compressed packet and inflate its payload in mZOut
  *
- * @param password MySQL session password
- * @param pwd_hash server seed
- * @return int (0 : Error | 1 : OK)
+ * A compressed packet can carry more MySQL packets, or only a part of one.
+ * Without wait only the bytes already available are read and false is
+ * returned until the whole compressed packet has been recieved.
+ *
+ * @param wait Block until packet is complete or timeout
+ * @return true decompressed bytes available in mZOut
+ * @return false nothing recieved yet, timeout or packet not valid
  */
-int MySQL::scramble_password(const char *password, uint8_t *pwd_hash)
-{
-    SHA1Context sha;
-    int word = 0, shift = 24, count = 3;
-    uint8_t hash1[20];
-    uint8_t hash2[20];
-    uint8_t hash3[20];
-    uint8_t pwd_buffer[40];
-
-    if (strlen(password) == 0)
-        return 0;
+bool MySQL::z_recieve(bool wait) {
 
-    // hash1
-    SHA1Reset(&sha);
-    SHA1Input(&sha, (const unsigned char *)password, strlen(password));
-    SHA1Result(&sha);
-    for (int i = 0; i < 20; i++) {
-        hash1[i] = (sha.Message_Digest[word] >> shift);
-        shift = shift - 8;
-        if (i == count) {
-            shift = 24;
-            word++;
-            count += 4;
-        }
-    }
-    word = 0;
-    shift = 24;
-    count = 3;
-
-    // hash2
-    SHA1Reset(&sha);
-    SHA1Input(&sha, (const unsigned char *)hash1, 20);
-    SHA1Result(&sha);
-    for (int i = 0; i < 20; i++) {
-        hash2[i] = (sha.Message_Digest[word] >> shift);
-        shift = shift - 8;
-        if (i == count) {
-            shift = 24;
-            word++;
-            count += 4;
-        }
+    if (mZDrop) {
+        this->z_drop();
+        return false;
     }
-    word = 0;
-    shift = 24;
-    count = 3;
-
-    // hash3 of seed + hash2
-    SHA1Reset(&sha);
-    memcpy(pwd_buffer, &mSeed, 20);
-    memcpy(pwd_buffer + 20, hash2, 20);
-    SHA1Input(&sha, (const unsigned char *)pwd_buffer, 40);
-    SHA1Result(&sha);
-    for (int i = 0; i < 20; i++) {
-        hash3[i] = (sha.Message_Digest[word] >> shift);
-        shift = shift - 8;
-        if (i == count) {
-            shift = 24;
-            word++;
-            count += 4;
+
+    while (mZHeaderLen < sizeof(mZHeader)) {
+        int recv_len = this->z_read(mZHeader + mZHeaderLen, sizeof(mZHeader) - mZHeaderLen, wait);
+        if (recv_len <= 0)
+            return false;
+        mZHeaderLen += recv_len;
+
+        if (mZHeaderLen == sizeof(mZHeader)) {
+            mZInLen = readFixedLengthInt(mZHeader, 0, 3);
+            mZInRecv = 0;
+            if (mZInLen > MYSQL_MAX_COMPRESSED_SIZE || readFixedLengthInt(mZHeader, 4, 3) > MYSQL_MAX_COMPRESSED_SIZE) {
+                error_message = "Packet larger than MYSQL_MAX_COMPRESSED_SIZE";
+                this->z_drop();
+                return false;
+            }
+            if (mZInLen > mZInSize) {
+                uint8_t *buf = (uint8_t *)realloc(mZIn, mZInLen);
+                if (buf == nullptr) {
+                    error_message = "Out of memory for a compressed packet";
+                    this->z_drop();
+                    return false;
+                }
+                mZIn = buf;
+                mZInSize = mZInLen;
+            }
         }
     }
-    word = 0;
-    shift = 24;
-    count = 3;
 
-    // XOR for hash4
-    for (int i = 0; i < 20; i++)
-        pwd_hash[i] = hash1[i] ^ hash3[i];
+    while (mZInRecv < mZInLen) {
+        int recv_len = this->z_read(mZIn + mZInRecv, mZInLen - mZInRecv, wait);
+        if (recv_len <= 0)
+            return false;
+        mZInRecv += recv_len;
+    }
 
-    return 1;
-}
+    mZHeaderLen = 0;
+    mZSequence = mZHeader[3] + 1;
+    uint32_t plain_len = readFixedLengthInt(mZHeader, 4, 3);
+
+    // Small payloads are sent uncompressed (uncompressed length 0)
+    if (plain_len == 0) {
+        uint8_t *buf = mZOut;
+        uint32_t size = mZOutSize;
+        mZOut = mZIn;
+        mZOutSize = mZInSize;
+        mZIn = buf;
+        mZInSize = size;
+        mZOutLen = mZInLen;
+        mZOutPos = 0;
+        return true;
+    }
 
+    if (plain_len > mZOutSize) {
+        uint8_t *buf = (uint8_t *)realloc(mZOut, plain_len);
+        if (buf == nullptr) {
+            error_message = "Out of memory for a compressed packet";
+            this->z_drop();
+            return false;
+        }
+        mZOut = buf;
+        mZOutSize = plain_len;
+    }
 
+    if (zlibInflate(mZOut, plain_len, mZIn, mZInLen) != (int32_t)plain_len) {
+        error_message = "Compressed packet not valid";
+        this->z_drop();
+        return false;
+    }
+    mZOutLen = plain_len;
+    mZOutPos = 0;
+    return true;
+}
 
 /**
- * @brief Responds to the server handshake sequence by logging in using User and Password
+ * @brief Read raw bytes of a compressed packet from TCP socket
  *
- * @param user MySQL user
- * @param password MySQL session password
- * @return int Bytes sent through TCP socket
- */
-
-int MySQL::send_authentication_packet(const char *user, const char *password, const char *db) {
-
-    int size_send = 4;
-    memset(tcp_socket_buffer, 0, BUFF_SIZE);
-
-    // client flags
-    tcp_socket_buffer[size_send] = byte(0x0D);
-    tcp_socket_buffer[size_send + 1] = byte(0xa6);
-    tcp_socket_buffer[size_send + 2] = byte(0x03);
-    tcp_socket_buffer[size_send + 3] = byte(0x00);
-    size_send += 4;
-
-    // max_allowed_packet
-    tcp_socket_buffer[size_send] = 0;
-    tcp_socket_buffer[size_send + 1] = 0;
-    tcp_socket_buffer[size_send + 2] = 0;
-    tcp_socket_buffer[size_send + 3] = 1;
-    size_send += 4;
-
-    // charset - default is 8
-    tcp_socket_buffer[size_send] = byte(0x08);
-    size_send += 1;
-    for (int i = 0; i < 24; i++)
-        tcp_socket_buffer[size_send + i] = 0x00;
-    size_send += 23;
-
-    // user name
-    memcpy((char *)&tcp_socket_buffer[size_send], user, strlen(user));
-    size_send += strlen(user) + 1;
-    tcp_socket_buffer[size_send - 1] = 0x00;
-
-    // password - see scramble password
-    if (scramble_password(password, mSeed)) {
-        tcp_socket_buffer[size_send] = 0x14;
-        size_send += 1;
-        for (int i = 0; i < 20; i++)
-        tcp_socket_buffer[i + size_send] = mSeed[i];
-        size_send += 20;
-        tcp_socket_buffer[size_send] = 0x00;
-    }
-
-    if (db) {
-        memcpy((char *)&tcp_socket_buffer[size_send], db, strlen(db));
-        size_send += strlen(db) + 1;
-        tcp_socket_buffer[size_send - 1] = 0x00;
+ * @return int Number of bytes read, 0 or less if nothing recieved
+ */
+int MySQL::z_read(uint8_t *buf, size_t len, bool wait) {
+    int ret = 0;
+    if (wait) {
+        ret = client->readBytes(buf, len);
     }
     else {
-        tcp_socket_buffer[size_send + 1] = 0x00;
-        size_send += 1;
+        size_t avail = client->available();
+        if (avail)
+            ret = client->read(buf, (avail < len) ? avail : len);
     }
-
-    // Write packet size
-    int p_size = size_send - 4;
-    store_int(&tcp_socket_buffer[0], p_size, 3);
-    tcp_socket_buffer[3] = byte(0x01);
-
-    // Write the packet
-    size_t ret = write((char *)tcp_socket_buffer, size_send);
-    flush_packet();
+    MYSQL_STATS_DO(this->stats_bytes_in(ret));
     return ret;
 }
 
-
 /**
- * @brief Cleans TCP socket
+ * @brief Drop the compressed packet being recieved, and the following ones already available
  *
+ * MySQL packets carried by a dropped compressed packet are lost, so the rest
+ * of the response can't be decoded: compressed packets are dropped until
+ * next command is sent (see rx_reset()), and only that response fails.
  */
-void MySQL::flush_packet()
-{
-    uint8_t *data_rec = nullptr;
-    int packet_len = 0;
-
-    data_rec = (uint8_t *)malloc(BUFF_SIZE);
-    packet_len = client->readBytes(data_rec, BUFF_SIZE);
-    packet_len -= 4;
-
-    // Check for valid packet.
-    if (packet_len < 0)
-        packet_len = 0;
+void MySQL::z_drop(void) {
+    mZDrop = true;
+    mZOutLen = mZOutPos = 0;
+
+    uint8_t chunk[64];
+    while (true) {
+        // Payload of current compressed packet
+        if (mZHeaderLen == sizeof(mZHeader)) {
+            while (mZInRecv < mZInLen) {
+                uint32_t len = mZInLen - mZInRecv;
+                int recv_len = this->z_read(chunk, (len < sizeof(chunk)) ? len : sizeof(chunk), true);
+                if (recv_len <= 0)
+                    return;
+                mZInRecv += recv_len;
+            }
+            mZHeaderLen = 0;
+        }
 
-    for (int i = 4; i < packet_len + 4; i++)
-        tcp_socket_buffer[i] = data_rec[i];
+        if (mZHeaderLen == 0 && client->available() <= 0)
+            return;
+        while (mZHeaderLen < sizeof(mZHeader)) {
+            int recv_len = this->z_read(mZHeader + mZHeaderLen, sizeof(mZHeader) - mZHeaderLen, true);
+            if (recv_len <= 0)
+                return;
+            mZHeaderLen += recv_len;
+        }
+        mZInLen = readFixedLengthInt(mZHeader, 0, 3);
+        mZInRecv = 0;
+    }
+}
+
+/**
+ * @brief Release compressed protocol buffers and discard partial packets
+ *
+ */
+void MySQL::z_reset(void) {
+    free(mZIn);
+    free(mZOut);
+    mZIn = mZOut = nullptr;
+    mZInSize = mZInLen = mZInRecv = 0;
+    mZOutSize = mZOutLen = mZOutPos = 0;
+    mZHeaderLen = 0;
+    mZSequence = 0;
+    mZDrop = false;
+}
+
+/**
+ * @brief Send a simple query and expect Table as result
+ * @param Database Database structure to store results
+ * @param pQuery Query
+ * @return bool state
+ */
+bool MySQL::query(DataQuery_t & dataquery, const char *pQuery) {
+    // dataquery may be the result of the running query
+    if (mState != QUERY_IDLE)
+        return false;
+
+    // Result still valid in cache, nothing to send
+    if (mCache != nullptr && mCache->lookup(dataquery, pQuery, strlen(pQuery))) {
+        this->drain_results();
+        this->clear_status();
+        return true;
+    }
+
+    bool ret = this->run_query(pQuery, dataquery.fields, MySQL::store_row, &dataquery);
+    dataquery.fieldCount = dataquery.fields.size();
+    ret = ret && !dataquery.overflow();
+    if (mCache != nullptr)
+        mCache->store(ret ? &dataquery : nullptr);
+    return ret;
+}
+
+/**
+ * @brief Send a query and hand each row to the handler as soon as it is recieved
+ * @param pQuery Query
+ * @param handler Callback invoked with a zero-copy view of every row
+ * @param userData Opaque pointer passed back to the handler
+ * @return bool state
+ */
+bool MySQL::queryStream(const char *pQuery, RowHandler handler, void *userData) {
+    return this->run_query(pQuery, mStreamFields, handler, userData);
+}
+
+/**
+ * @brief Format and send a query, then store results in dataquery
+ * @param Database Database structure to store results
+ * @param fmt Query format (see MySQL.h)
+ * @return bool state
+ */
+bool MySQL::queryf(DataQuery_t & dataquery, const char *fmt, ...) {
+    if (mState != QUERY_IDLE)
+        return false;
+
+    size_t len;
+    va_list args;
+    va_start(args, fmt);
+    bool ready = this->prepare_formatted(len, fmt, args);
+    va_end(args);
+    if (!ready)
+        return false;
+
+    // Query text is looked up where it has been formatted, before sending it
+    if (mCache != nullptr && mCache->lookup(dataquery, (const char *)tcp_socket_buffer + 5, len))
+        return true;
+
+    if (!this->write_formatted(len)) {
+        if (mCache != nullptr)
+            mCache->store(nullptr);
+        return false;
+    }
+
+    bool ret = this->read_result(&dataquery.fields, MySQL::store_row, &dataquery);
+    dataquery.fieldCount = dataquery.fields.size();
+    ret = ret && !dataquery.overflow();
+    if (mCache != nullptr)
+        mCache->store(ret ? &dataquery : nullptr);
+    return ret;
+}
+
+/**
+ * @brief Format and send a query, then hand each row to the handler
+ * @param handler Callback invoked with a zero-copy view of every row
+ * @param userData Opaque pointer passed back to the handler
+ * @param fmt Query format (see MySQL.h)
+ * @return bool state
+ */
+bool MySQL::queryStreamf(RowHandler handler, void *userData, const char *fmt, ...) {
+    if (mState != QUERY_IDLE)
+        return false;
+
+    va_list args;
+    va_start(args, fmt);
+    bool sent = this->send_formatted(fmt, args);
+    va_end(args);
+    if (!sent)
+        return false;
+
+    return this->read_result(&mStreamFields, handler, userData);
+}
+
+/**
+ * @brief RowHandler used by query() to append each row to the DataQuery_t buffer
+ *
+ */
+void MySQL::store_row(const Row_t &row, void *userData)
+{
+    DataQuery_t *dataquery = (DataQuery_t *)userData;
+    dataquery->addRow(row);
+}
+
+/**
+ * @brief Send COM_QUERY packet with the query text
+ * @param pQuery Query
+ * @return bool true if the whole packet has been written to TCP socket
+ */
+bool MySQL::send_query(const char *pQuery) {
+    return this->send_command(COM_QUERY, (const uint8_t *)pQuery, strlen(pQuery));
+}
+
+/**
+ * @brief Drop cached results when a statement that is not a read is sent
+ *
+ */
+void MySQL::cache_sent(const char *sql, size_t len) {
+    if (mCache != nullptr && !QueryCache::isReadOnly(sql, len))
+        mCache->invalidate();
+}
+
+/**
+ * @brief Send COM_QUERY packet with the query formatted directly in tcp_socket_buffer
+ *
+ * @param fmt Query format (see queryf())
+ * @param args Format arguments
+ * @return bool false if format is not valid, query too long or TCP socket write failed
+ */
+bool MySQL::send_formatted(const char *fmt, va_list args) {
+    size_t len;
+    return this->prepare_formatted(len, fmt, args) && this->write_formatted(len);
+}
+
+/**
+ * @brief Format the query in tcp_socket_buffer, without sending it
+ *
+ * @param len Set to length of query
+ * @return bool false if format is not valid or query too long
+ */
+bool MySQL::prepare_formatted(size_t &len, const char *fmt, va_list args) {
+
+    // Results of previous query not read yet
+    this->drain_results();
+    this->clear_status();
+
+    // Buffer is shared with recieved packets
+    this->rx_reset();
+
+    if (!this->format_query(len, fmt, args)) {
+        error_message = "Query format not valid or query too long";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Send COM_QUERY packet with the query formatted by prepare_formatted()
+ *
+ * @return bool true if the whole packet has been written to TCP socket
+ */
+bool MySQL::write_formatted(size_t len) {
+    this->cache_sent((const char *)tcp_socket_buffer + 5, len);
+
+    // Header and command byte
+    store_int(tcp_socket_buffer, len + 1, 3);
+    tcp_socket_buffer[3] = 0;
+    tcp_socket_buffer[4] = COM_QUERY;
+    MYSQL_STATS_DO(this->stats_begin(); mStats.packetsOut++);
+    return this->write((char *)tcp_socket_buffer, len + 5) == len + 5;
+}
+
+/**
+ * @brief Write query text in tcp_socket_buffer after header and command byte
+ *
+ * Strings and identifiers are escaped while they are copied,
+ * so no intermediate buffer is needed.
+ *
+ * @param len Set to length of query
+ * @param fmt Query format (see queryf())
+ * @param args Format arguments
+ * @return bool false if format is not valid or query does not fit in buffer
+ */
+bool MySQL::format_query(size_t &len, const char *fmt, va_list args) {
+    char *query = (char *)tcp_socket_buffer + 5;
+    const size_t room = BUFF_SIZE - 5;
+    char number[NUMBER_TEXT_SIZE];
+    len = 0;
+
+    while (*fmt) {
+        if (*fmt != '%') {
+            if (len == room)
+                return false;
+            query[len++] = *fmt++;
+            continue;
+        }
+        fmt++;
+
+        // Length modifiers
+        int longs = 0;
+        while (*fmt == 'l' && longs < 2) {
+            longs++;
+            fmt++;
+        }
+
+        const char *text = number;
+        size_t text_len = 0;
+        switch (*fmt) {
+            case 'd':
+            case 'i': {
+                int64_t value = (longs == 0) ? va_arg(args, int) : (longs == 1) ? va_arg(args, long) : va_arg(args, long long);
+                text_len = formatInt(number, value);
+                break;
+            }
+            case 'u': {
+                uint64_t value = (longs == 0) ? va_arg(args, unsigned int) : (longs == 1) ? va_arg(args, unsigned long) : va_arg(args, unsigned long long);
+                text_len = formatUInt(number, value);
+                break;
+            }
+            case 'f': {
+                text_len = formatDouble(number, va_arg(args, double));
+                if (text_len == 0) {
+                    text = "NULL";
+                    text_len = 4;
+                }
+                break;
+            }
+            case '%':
+                text = "%";
+                text_len = 1;
+                break;
+
+            // Quoted string, special chars escaped
+            case 's': {
+                const char *value = va_arg(args, const char *);
+                if (value == nullptr) {
+                    text = "NULL";
+                    text_len = 4;
+                    break;
+                }
+                size_t value_len = strlen(value);
+                if (len + 2 + escapedLength(value, value_len) > room)
+                    return false;
+                query[len++] = '\'';
+                len += escapeString(query + len, value, value_len);
+                query[len++] = '\'';
+                fmt++;
+                continue;
+            }
+
+            // Identifier, backticks inside the name are doubled
+            case 'I': {
+                const char *value = va_arg(args, const char *);
+                if (value == nullptr)
+                    return false;
+                if (len == room)
+                    return false;
+                query[len++] = '`';
+                for (; *value; value++) {
+                    if (len + (*value == '`' ? 2 : 1) > room)
+                        return false;
+                    if (*value == '`')
+                        query[len++] = '`';
+                    query[len++] = *value;
+                }
+                if (len == room)
+                    return false;
+                query[len++] = '`';
+                fmt++;
+                continue;
+            }
+
+            default:
+                return false;
+        }
+
+        if (len + text_len > room)
+            return false;
+        memcpy(query + len, text, text_len);
+        len += text_len;
+        fmt++;
+    }
+    return true;
+}
+
+/**
+ * @brief Send a command packet, split in more packets if larger than 16MB
+ *
+ * Packet layout :
+ * int<3>	    payload_length
+ * int<1>	    sequence_id
+ * string<var>	payload
+ *
+ * A payload of 0xFFFFFF bytes or more is sent as a sequence of packets of
+ * 0xFFFFFF bytes, terminated by a shorter (even empty) packet.
+ * Source : https://dev.mysql.com/doc/internals/en/sending-more-than-16mbyte.html
+ *
+ * Data that does not fit in tcp_socket_buffer together with the header
+ * is written directly from the source, without any allocation.
+ *
+ * @param command Command type (first byte of payload)
+ * @param data Command arguments
+ * @param len Length of arguments
+ * @return bool true if all packets have been written to TCP socket
+ */
+bool MySQL::send_command(uint8_t command, const uint8_t *data, size_t len) {
+
+    // Response of a query started with beginQuery() still to be read
+    if (mState != QUERY_IDLE)
+        return false;
+
+    // Results of previous query not read yet
+    this->drain_results();
+    this->clear_status();
+
+    // Buffer is shared with recieved packets
+    this->rx_reset();
+
+    MYSQL_STATS_DO(this->stats_begin());
+    bool ret = this->tx_command(command, data, len) && this->tx_flush();
+
+    // Callers end the record when the response is read
+    MYSQL_STATS_DO(if (!ret) this->stats_end(false));
+    return ret;
+}
+
+/**
+ * @brief Add a command packet to the data to be sent, see send_command()
+ *
+ * Commands are sent when tcp_socket_buffer is full or with tx_flush(),
+ * so more commands can be written with a single TCP segment.
+ *
+ * @return bool false if TCP socket write failed
+ */
+bool MySQL::tx_command(uint8_t command, const uint8_t *data, size_t len) {
+
+    if (command == COM_QUERY)
+        this->cache_sent((const char *)data, len);
+
+    // Command byte + arguments
+    size_t payload_left = len + 1;
+    uint8_t sequence_id = 0;
+    bool first = true;
+    size_t packet_len;
+
+    do {
+        packet_len = (payload_left < MAX_PACKET_PAYLOAD) ? payload_left : MAX_PACKET_PAYLOAD;
+        payload_left -= packet_len;
+        size_t data_len = packet_len;
+
+        // Payload length and sequence ID (0 for initiator)
+        if (!this->tx_packet(packet_len, sequence_id++))
+            return false;
+
+        if (first) {
+            this->tx_append(&command, 1);
+            data_len--;
+            first = false;
+        }
+
+        if (!this->tx_append(data, data_len))
+            return false;
+        data += data_len;
+    } while (packet_len == MAX_PACKET_PAYLOAD);
+
+    return true;
+}
+
+/**
+ * @brief Add a packet header to the data to be sent
+ *
+ * @param payload_len Length of payload that will follow
+ * @param sequence_id Packet sequence ID
+ * @return bool false if TCP socket write failed
+ */
+bool MySQL::tx_packet(size_t payload_len, uint8_t sequence_id) {
+    if (mTxLen + 4 > BUFF_SIZE && !this->tx_flush())
+        return false;
+
+    store_int(tcp_socket_buffer + mTxLen, payload_len, 3);
+    tcp_socket_buffer[mTxLen + 3] = sequence_id;
+    mTxLen += 4;
+    MYSQL_STATS_DO(mStats.packetsOut++);
+    return true;
+}
+
+/**
+ * @brief Add data to be sent at the end of tcp_socket_buffer
+ *
+ * When data does not fit, the buffer is filled and sent, and what remains
+ * is written straight from source (if larger than buffer) or copied.
+ *
+ * @param data Source data
+ * @param len Length of data
+ * @return bool false if TCP socket write failed
+ */
+bool MySQL::tx_append(const void *data, size_t len) {
+    const uint8_t *src = (const uint8_t *)data;
+
+    if (mTxLen + len > BUFF_SIZE) {
+        size_t copy_len = BUFF_SIZE - mTxLen;
+        memcpy(tcp_socket_buffer + mTxLen, src, copy_len);
+        mTxLen = BUFF_SIZE;
+        src += copy_len;
+        len -= copy_len;
+        if (!this->tx_flush())
+            return false;
+
+        while (len >= BUFF_SIZE) {
+            if (this->write((const char *)src, BUFF_SIZE) != BUFF_SIZE)
+                return false;
+            src += BUFF_SIZE;
+            len -= BUFF_SIZE;
+        }
+    }
+
+    if (len)
+        memcpy(tcp_socket_buffer + mTxLen, src, len);
+    mTxLen += len;
+    return true;
+}
+
+/**
+ * @brief Write over TCP socket the data collected in tcp_socket_buffer
+ *
+ * @return bool false if TCP socket write failed
+ */
+bool MySQL::tx_flush(void) {
+    size_t len = mTxLen;
+    mTxLen = 0;
+    if (len == 0)
+        return true;
+    return this->write((char *)tcp_socket_buffer, len) == len;
+}
+
+/**
+ * @brief Send a query and read the server response one packet at a time
+ *
+ * Each packet is decoded and released as soon as it has been recieved,
+ * so memory usage is bounded by a single packet and not by the result size.
+ *
+ * @param pQuery Query
+ * @param fields Vector filled with the column definitions
+ * @param handler Callback invoked for every row
+ * @param userData Opaque pointer passed back to the handler
+ * @return bool state
+ */
+bool MySQL::run_query(const char *pQuery, FieldList &fields, RowHandler handler, void *userData) {
+
+    if (!this->start_query(pQuery, &fields, handler, userData))
+        return false;
+
+    while (!this->query_step(true)) {;}
+    return this->finish_query();
+}
+
+/**
+ * @brief Send query and prepare the response state machine
+ *
+ * @return bool false if a query is already running or TCP socket write failed
+ */
+bool MySQL::start_query(const char *pQuery, FieldList *fields, RowHandler handler, void *userData) {
+    if (mState != QUERY_IDLE)
+        return false;
+
+    if (!this->send_query(pQuery))
+        return false;
+
+    this->expect_response(fields, handler, userData);
+    return true;
+}
+
+/**
+ * @brief Prepare the state machine for the response of a query already sent
+ *
+ */
+void MySQL::expect_response(FieldList *fields, RowHandler handler, void *userData) {
+    this->clear_status();
+
+    // Previous results are cleared only once the command has been sent
+    if (handler == MySQL::store_row)
+        ((DataQuery_t *)userData)->clear();
+
+    // Only response is read (next result or query of a batch)
+    MYSQL_STATS_DO(if (!mStatsActive) this->stats_begin());
+    mFields = fields;
+    mRowHandler = handler;
+    mRowUserData = userData;
+    mQueryOk = false;
+    mState = QUERY_RESPONSE;
+    mLastRecieved = millis();
+}
+
+/**
+ * @brief Advance the query state machine with recieved packets
+ *
+ * Query Response can be :
+ * - ERR : Error packet containing a string
+ * - OK : Query completed without expecting further information/data
+ * - Table response
+ *      - Field count (length encoded int)
+ *      - [n] Fields
+ *      - EOF
+ *      - [?] ROW (Until following EOF or ERR)
+ *      - EOF or ERR
+ *
+ * Source : https://dev.mysql.com/doc/internals/en/com-query-response.html
+ *
+ * @param wait Block on each packet, otherwise use only bytes already available
+ * @return true Query completed (see mQueryOk)
+ * @return false Waiting for more data
+ */
+bool MySQL::query_step(bool wait) {
+
+    while (mState != QUERY_DONE) {
+#if MYSQL_STATS
+        uint32_t start = micros();
+#endif
+        bool recieved = this->recieve(wait);
+        MYSQL_STATS_DO(mStats.recieveTime += micros() - start; start = micros());
+
+        if (!recieved) {
+            // A row too large has been dropped: the result is failed, next rows are still read
+            if (mRxSkipped && mState == QUERY_ROWS) {
+                mFieldsOverflow = true;
+                continue;
+            }
+            if (wait || mZDrop || !this->client->connected()) {
+                mState = QUERY_DONE;
+                break;
+            }
+            if (millis() - mLastRecieved > mTimeout) {
+                error_message = "Timeout";
+                mState = QUERY_DONE;
+                break;
+            }
+            return false;
+        }
+        mLastRecieved = millis();
+
+        switch (mState) {
+            case QUERY_RESPONSE: {
+                Packet_Type type = packet.getPacketType();
+                if (type == PACKET_ERR) {
+                    this->parse_error_packet(&packet, packet.getPacketLength());
+                    mState = QUERY_DONE;
+                    break;
+                }
+                if (type != PACKET_TEXTRESULTSET) {
+                    this->parse_ok_packet(&packet);
+                    mQueryOk = true;
+                    mState = QUERY_DONE;
+                    break;
+                }
+
+                /**
+                 * We must follow the TextResultSet pattern
+                 * Source : https://dev.mysql.com/doc/internals/en/com-query-response.html#packet-ProtocolText::Resultset
+                 */
+                uint32_t field_count = readLenEncInt(packet.mPayload, 0);
+                mFields->clear();
+                mFieldsOverflow = (field_count > MYSQL_MAX_COLUMNS);
+                if (mFieldsOverflow)
+                    error_message = "Result has too many columns";
+                else
+                    mFields->reserve(field_count);
+                mState = QUERY_FIELDS;
+                break;
+            }
+
+            // Column definitions, followed by an EOF packet
+            case QUERY_FIELDS: {
+                if (packet.getPacketType() != PACKET_EOF) {
+                    if (!mFieldsOverflow) {
+                        Field_t field;
+                        if (this->parse_column_definition(&packet, field)) {
+                            mFields->push_back(field);
+                        }
+                        else {
+                            error_message = "Column definition not valid";
+                            mFieldsOverflow = true;
+                        }
+                    }
+                    break;
+                }
+
+                // Rows of a result with too many columns (or not valid) are read and dropped
+                if (mFieldsOverflow) {
+                    mFields->clear();
+                    mRowHandler = nullptr;
+                }
+
+                // Column positions are shared by all rows
+#if MYSQL_STATIC_STORAGE
+                mState = QUERY_ROWS;
+#else
+                mColumns = (Column_t *)malloc(sizeof(Column_t) * (mFields->size() ? mFields->size() : 1));
+                mState = (mColumns != nullptr) ? QUERY_ROWS : QUERY_DONE;
+#endif
+                break;
+            }
+
+            // Rows, until the final EOF or ERR
+            case QUERY_ROWS: {
+                uint8_t header = packet.mPayload[0];
+
+                if (header == 0xFE && packet.mPayloadLength < 9) {
+                    this->parse_eof_packet(&packet);
+                    mQueryOk = !mFieldsOverflow;
+                    mState = QUERY_DONE;
+                    break;
+                }
+                if (header == 0xFF) {
+                    this->parse_error_packet(&packet, packet.getPacketLength());
+                    mState = QUERY_DONE;
+                    break;
+                }
+
+                // A row not valid fails the result, next rows are read and dropped
+                if (!this->parse_text_row(&packet, mColumns, mFields->size())) {
+                    error_message = "Row not valid";
+                    mFieldsOverflow = true;
+                    mRowHandler = nullptr;
+                    break;
+                }
+                if (mRowHandler != nullptr) {
+                    Row_t row(packet.mPayload, mColumns, mFields);
+                    mRowHandler(row, mRowUserData);
+                }
+                MYSQL_STATS_DO(mStats.rows++);
+                break;
+            }
+
+            default:
+                mState = QUERY_DONE;
+                break;
+        }
+        MYSQL_STATS_DO(mStats.parseTime += micros() - start);
+    }
+    return true;
+}
+
+/**
+ * @brief Release query resources, a new command can be sent
+ *
+ * @return bool query state
+ */
+bool MySQL::finish_query(void) {
+#if !MYSQL_STATIC_STORAGE
+    free(mColumns);
+    mColumns = nullptr;
+#endif
+
+    // Nothing to record if no query was running (connect)
+    MYSQL_STATS_DO(if (mState != QUERY_IDLE) this->stats_end(mQueryOk));
+    mState = QUERY_IDLE;
+
+    // Server sends next result right after this one, ERR ends the sequence
+    mMoreResults = mQueryOk && (mServerStatus & SERVER_MORE_RESULTS_EXISTS);
+    return mQueryOk;
+}
+
+#if MYSQL_STATS
+/**
+ * @brief Free heap, where the platform can tell it
+ *
+ */
+static uint32_t free_heap(void) {
+#if defined(ESP32) || defined(ESP8266)
+    return ESP.getFreeHeap();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Start a new statistics record, before the command is sent
+ *
+ */
+void MySQL::stats_begin(void) {
+    memset(&mStats, 0, sizeof(mStats));
+    mStatsActive = true;
+    mStatsStart = micros();
+    mStatsSent = mStatsStart;
+    mStatsHeap = free_heap();
+}
+
+/**
+ * @brief Complete the record of a query and hand it to the callback
+ *
+ */
+void MySQL::stats_end(bool success) {
+    mStats.totalTime = micros() - mStatsStart;
+    mStats.heapUsed = (int32_t)(mStatsHeap - free_heap());
+    mStats.success = success;
+    mStatsActive = false;
+    if (mStatsCallback != nullptr)
+        mStatsCallback(this, mStats, mStatsUserData);
+}
+
+/**
+ * @brief Count bytes read from TCP socket
+ *
+ */
+void MySQL::stats_bytes_in(int len) {
+    if (len <= 0)
+        return;
+    if (mStats.bytesIn == 0)
+        mStats.firstByteTime = micros() - mStatsSent;
+    mStats.bytesIn += len;
+}
+#endif
+
+/**
+ * @brief Read one result of a query already sent, blocking
+ *
+ */
+bool MySQL::read_result(FieldList *fields, RowHandler handler, void *userData) {
+    this->expect_response(fields, handler, userData);
+    while (!this->query_step(true)) {;}
+    return this->finish_query();
+}
+
+/**
+ * @brief Read next result of a query with multiple statements
+ *
+ */
+bool MySQL::nextResult(DataQuery_t & dataquery) {
+    if (!mMoreResults || mState != QUERY_IDLE)
+        return false;
+
+    bool ret = this->read_result(&dataquery.fields, MySQL::store_row, &dataquery);
+    dataquery.fieldCount = dataquery.fields.size();
+    return ret && !dataquery.overflow();
+}
+
+bool MySQL::nextResult(RowHandler handler, void *userData) {
+    if (!mMoreResults || mState != QUERY_IDLE)
+        return false;
+
+    return this->read_result(&mStreamFields, handler, userData);
+}
+
+/**
+ * @brief Read and discard results (and statement rows) not read by user, so next command will get its own response
+ *
+ */
+void MySQL::drain_results(void) {
+    if (mStatement != nullptr)
+        mStatement->drain(true, true);
+    while (mMoreResults && mState == QUERY_IDLE)
+        this->read_result(&mStreamFields, nullptr, nullptr);
+}
+
+/**
+ * @brief Send all queries back-to-back, then read the responses in the same order
+ *
+ * Server executes each COM_QUERY as soon as it's recieved, so a batch
+ * costs about one round-trip instead of one for each query.
+ *
+ * @param batch Queries, with destination of results and state of each one
+ * @param count Number of queries
+ * @return true All queries succeeded
+ * @return false One or more queries failed (see BatchQuery_t::success)
+ */
+bool MySQL::queryBatch(BatchQuery_t *batch, uint8_t count) {
+    if (mState != QUERY_IDLE)
+        return false;
+
+    // Results of previous query not read yet
+    this->drain_results();
+
+    // Buffer is shared with recieved packets
+    this->rx_reset();
+
+    MYSQL_STATS_DO(this->stats_begin());
+    bool sent = true;
+    for (uint8_t i = 0; i < count && sent; i++) {
+        batch[i].success = false;
+        sent = this->tx_command(COM_QUERY, (const uint8_t *)batch[i].query, strlen(batch[i].query));
+    }
+    if (!sent || !this->tx_flush())
+        return false;
+
+    bool ret = true;
+    for (uint8_t i = 0; i < count; i++) {
+        DataQuery_t *result = batch[i].result;
+        if (result != nullptr) {
+            this->expect_response(&result->fields, MySQL::store_row, result);
+        }
+        else {
+            this->expect_response(&mStreamFields, batch[i].handler, batch[i].userData);
+        }
+
+        while (!this->query_step(true)) {;}
+        batch[i].success = this->finish_query();
+        batch[i].affectedRows = mAffectedRows;
+        batch[i].lastInsertId = mLastInsertId;
+
+        if (result != nullptr) {
+            result->fieldCount = result->fields.size();
+            batch[i].success = batch[i].success && !result->overflow();
+        }
+        ret = ret && batch[i].success;
+
+        // Only first result of a query with multiple statements is kept
+        this->drain_results();
+    }
+    return ret;
+}
+
+/**
+ * @brief Send all queries back-to-back, results are stored in the results array
+ *
+ * @param queries Array of count queries
+ * @param results Array of count DataQuery_t
+ * @param count Number of queries
+ * @return true All queries succeeded
+ */
+bool MySQL::queryBatch(const char *const queries[], DataQuery_t results[], uint8_t count) {
+    BatchQuery_t *batch = (BatchQuery_t *)malloc(count * sizeof(BatchQuery_t));
+    if (batch == nullptr)
+        return false;
+
+    for (uint8_t i = 0; i < count; i++) {
+        batch[i].query = queries[i];
+        batch[i].result = &results[i];
+        batch[i].handler = nullptr;
+        batch[i].userData = nullptr;
+    }
+    bool ret = this->queryBatch(batch, count);
+    free(batch);
+    return ret;
+}
+
+/**
+ * @brief Start a query without waiting for response, results are stored in dataquery
+ *
+ * @param dataquery Result, it must be valid until onDone is called
+ * @param pQuery Query
+ * @param onDone Callback invoked when query is completed
+ * @param userData Opaque pointer passed back to onDone
+ * @return bool false if a query is already running or TCP socket write failed
+ */
+bool MySQL::beginQuery(DataQuery_t &dataquery, const char *pQuery, QueryCallback onDone, void *userData) {
+    if (mState != QUERY_IDLE)
+        return false;
+
+    mResult = &dataquery;
+    mOnDone = onDone;
+    mDoneUserData = userData;
+    return this->start_query(pQuery, &dataquery.fields, MySQL::store_row, &dataquery);
+}
+
+/**
+ * @brief Start a query without waiting for response, rows are handed to the handler
+ *
+ * @param pQuery Query
+ * @param handler Callback invoked for each row
+ * @param onDone Callback invoked when query is completed
+ * @param userData Opaque pointer passed back to both callbacks
+ * @return bool false if a query is already running or TCP socket write failed
+ */
+bool MySQL::beginQuery(const char *pQuery, RowHandler handler, QueryCallback onDone, void *userData) {
+    if (mState != QUERY_IDLE)
+        return false;
+
+    mResult = nullptr;
+    mOnDone = onDone;
+    mDoneUserData = userData;
+    return this->start_query(pQuery, &mStreamFields, handler, userData);
+}
+
+/**
+ * @brief Process the bytes recieved for the running query, never blocks
+ *
+ * @return true Query still running
+ * @return false No query running (completion callback already invoked)
+ */
+bool MySQL::poll() {
+    if (mState == QUERY_IDLE)
+        return false;
+
+    if (!this->query_step(false))
+        return true;
 
-    delete data_rec;
+    bool ret = this->finish_query();
+    if (mResult != nullptr) {
+        mResult->fieldCount = mResult->fields.size();
+        ret = ret && !mResult->overflow();
+        mResult = nullptr;
+    }
+
+    // Callback can start a new query
+    if (mOnDone != nullptr)
+        mOnDone(this, ret, mDoneUserData);
+    return false;
 }
 
+/**
+ * @brief Parses a column definition packet
+ *
+ * @param packet Column definition packet
+ * @param field Field_t filled with column name, size and type
+ * @return false Packet is malformed (lengths past its end)
+ */
+bool MySQL::parse_column_definition(const MySQL_Packet *packet, Field_t &field)
+{
+    const uint8_t *payload = packet->mPayload;
+    uint32_t payload_len = packet->mPayloadLength;
+    #if DEBUG
+        printRawBytes(payload, packet->getPacketLength());
+    #endif
+
+    // Skip catalog, database name, table name and original table name
+    uint32_t offset = 0;
+    for (int i = 0; i < 4; i++) {
+        if (offset >= payload_len)
+            return false;
+        offset += skipLenEncString(payload, offset);
+    }
+    if (offset >= payload_len)
+        return false;
+
+    // Field name (this can be an alias), never NULL
+    uint8_t header_size;
+    uint64_t str_len = readLenEncInt(payload, offset, &header_size);
+    if (str_len == LENENC_NULL || str_len > payload_len - offset - header_size)
+        return false;
+#if MYSQL_STATIC_STORAGE
+    // Copied directly, truncated to MYSQL_MAX_NAME_LEN
+    field.name.assign((const char *)payload + offset + header_size, str_len);
+#else
+    // Allocate enougth memory and get field name
+    char * field_name = (char*)malloc(str_len + 1);
+    if (field_name == nullptr)
+        return false;
+    readLenEncString(field_name, payload, offset);
+    field.name = field_name;
+    free(field_name);    // Free memory
+#endif
+    offset += header_size + str_len;
+    #if DEBUG
+        this->printf_n(Serial, 64, "next offset %02X, field %s\n", offset, field.name.c_str());
+    #endif
+
+    // Skip the real name of field (NO alias)
+    if (offset >= payload_len)
+        return false;
+    offset += skipLenEncString(payload, offset);
+
+    // Skip fixed fields length and character set, then 8 bytes used below
+    offset += 3;
+    if (offset + 8 > payload_len)
+        return false;
+
+    // Column length, type, flags and decimals
+    field.size = readFixedLengthInt(payload, offset, 4);
+    field.type = payload[offset + 4];
+    field.flags = readFixedLengthInt(payload, offset + 5, 2);
+    field.decimals = payload[offset + 7];
+    return true;
+}
 
 /**
- * @brief Parse handshake sent by server
+ * @brief Find the position of each column value inside a text row packet
  *
+ * @param packet Row packet
+ * @param columns Array of column_count elements to fill
+ * @param column_count Number of columns of current result set
+ * @return true Row parsed
+ * @return false Row packet is malformed (lengths past its end)
+ */
+bool MySQL::parse_text_row(const MySQL_Packet *packet, Column_t *columns, uint16_t column_count)
+{
+    const uint8_t *payload = packet->mPayload;
+    uint32_t offset = 0;
+
+    for (uint16_t col = 0; col < column_count; col++) {
+        if (offset >= packet->mPayloadLength)
+            return false;
+
+        uint8_t header_size;
+        uint64_t str_len = readLenEncInt(payload, offset, &header_size);
+        offset += header_size;
+        if (offset > packet->mPayloadLength)
+            return false;
+
+        // 0xFB is the NULL value marker
+        columns[col].null = (str_len == LENENC_NULL);
+        if (columns[col].null)
+            str_len = 0;
+        else if (str_len > packet->mPayloadLength - offset)
+            return false;
+        columns[col].offset = offset;
+        columns[col].length = str_len;
+        offset += str_len;
+    }
+    return true;
+}
+
+/*
+  parse_error_packet - Display the error returned from the server
+
+  This method parses an error packet from the server and displays the
+  error code and text via Serial.print. The error packet is defined
+  as follows.
+
+  Bytes                       Name
+  -----                       ----
+  1                           field_count, always = 0xff
+  2                           errno
+  1                           (sqlstate marker), always '#'
+  5                           sqlstate (5 characters)
+  n                           message
 */
-void MySQL::parse_handshake_packet()
+void MySQL::parse_error_packet(const MySQL_Packet *packet, uint16_t packet_len )
 {
-    int i = 5;
-    do {
-        i++;
-    } while (tcp_socket_buffer[i - 1] != 0x00);
 
-    server_version = (char *)malloc(i - 5);
-    strncpy(server_version, (char *)&tcp_socket_buffer[5], i - 5);
+    Serial.print("************** SQL Error *****************\n");
+    memcpy(SQL_state, packet->mPayload + 4, 5);
+    SQL_state[5] = '\0';
+    Serial.print("SQLSTATE = ");
+    Serial.print(SQL_state);
+    Serial.print("\n");
+    error_message = "";
+    for (int i = 9; i < packet_len-4; i++) {
+        char ch = (char)packet->mPayload[i];
+        if (ch != '\0') {
+            Serial.print(ch);
+            error_message += ch;
+        }
+         else
+            continue;
+    }
+    
+    Serial.print("\n******************************************\n\n");
+    // printRawBytes(packet->mPayload, packet_len);
+}
 
-    // Capture the first 8 characters of seed
-    i += 4; // Skip thread id
-    for (int j = 0; j < 8; j++)
-        mSeed[j] = tcp_socket_buffer[i + j];
+/*
+  parse_ok_packet - Store the result of a command completed without rows
 
-    // Capture rest of seed
-    i += 27; // skip ahead
-    for (int j = 0; j < 12; j++)
-        mSeed[j + 8] = tcp_socket_buffer[i + j];
+  Bytes                       Name
+  -----                       ----
+  1                           header, always = 0x00
+  1-9 (length encoded int)    affected_rows
+  1-9 (length encoded int)    last_insert_id
+  2                           status_flags
+  2                           warnings
+*/
+void MySQL::parse_ok_packet(const MySQL_Packet *packet)
+{
+    uint8_t size;
+    uint32_t offset = 1;
+
+    mAffectedRows = readLenEncInt(packet->mPayload, offset, &size);
+    offset += size;
+    mLastInsertId = readLenEncInt(packet->mPayload, offset, &size);
+    offset += size;
+    if (packet->mPayloadLength >= offset + 4) {
+        mServerStatus = readFixedLengthInt(packet->mPayload, offset, 2);
+        mWarnings = readFixedLengthInt(packet->mPayload, offset + 2, 2);
+    }
 }
 
+/*
+  parse_eof_packet - Store status at the end of a result set
 
+  Bytes                       Name
+  -----                       ----
+  1                           header, always = 0xfe
+  2                           warnings
+  2                           status_flags
+*/
+void MySQL::parse_eof_packet(const MySQL_Packet *packet)
+{
+    if (packet->mPayloadLength >= 5) {
+        mWarnings = readFixedLengthInt(packet->mPayload, 1, 2);
+        mServerStatus = readFixedLengthInt(packet->mPayload, 3, 2);
+    }
+}
 
-#if DEBUG
-void MySQL::print_packets_types(void)
+/**
+ * @brief Forget the result of previous command
+ *
+ */
+void MySQL::clear_status(void)
 {
-    // Parse recieved tables
-    for (int i = 0; i < (int)(this->mPacketsRecieved.size()); i++)
-    {
-        MySQL_Packet *packet = this->mPacketsRecieved.at(i);
-        uint32_t packet_number = packet->mPacketNumber;
-        Packet_Type packet_type = packet->getPacketType();
-        String type;
-
-        switch (packet_type)
-        {
-        case PACKET_OK:
-            type = "OK";
-            break;
+    mAffectedRows = 0;
+    mLastInsertId = 0;
+    mServerStatus = 0;
+    mWarnings = 0;
+}
 
-        case PACKET_UNKNOWN:
-            type = "UNKNOWN";
-            break;
 
-        case PACKET_TEXTRESULTSET:
-            type = "TEXTRESULTSET";
-            break;
+/**
+ * @brief Hash password using server seed, for the authentication plugin of session
+ *
+ * mysql_native_password: SHA1(password) XOR SHA1(seed + SHA1(SHA1(password)))
+ * caching_sha2_password: SHA256(password) XOR SHA256(SHA256(SHA256(password)) + seed)
+ *
+ * The first two digests depend only on password, they are computed once and
+ * kept for next logins, so each login costs a single hash.
+ *
+ * @param password MySQL session password
+ * @param seed 20 bytes sent by server
+ * @param out Scrambled password, up to SHA256_DIGEST_SIZE bytes
+ * @return uint8_t length of scrambled password, 0 for empty password
+ */
+uint8_t MySQL::scramble_password(const char *password, const uint8_t *seed, uint8_t *out)
+{
+    uint32_t len = strlen(password);
+    if (len == 0)
+        return 0;
+
+    bool sha2 = (mAuthPlugin == AUTH_CACHING_SHA2);
+    uint8_t size = sha2 ? SHA256_DIGEST_SIZE : 20;
+
+    // Stage 2 is kept for the password whose stage 1 is the same
+    uint8_t stage1[SHA256_DIGEST_SIZE];
+    if (sha2)
+        SHA256Digest((const uint8_t *)password, len, stage1);
+    else
+        SHA1Digest((const unsigned char *)password, len, stage1);
+
+    if (mPwdPlugin != mAuthPlugin || memcmp(stage1, mPwdStage1, size) != 0) {
+        memcpy(mPwdStage1, stage1, size);
+        if (sha2)
+            SHA256Digest(mPwdStage1, SHA256_DIGEST_SIZE, mPwdStage2);
+        else
+            SHA1Digest(mPwdStage1, 20, mPwdStage2);
+        mPwdPlugin = mAuthPlugin;
+    }
+    memset(stage1, 0, sizeof(stage1));
+
+    uint8_t hash[SHA256_DIGEST_SIZE];
+    if (sha2) {
+        SHA256Context sha;
+        SHA256Reset(&sha);
+        SHA256Input(&sha, mPwdStage2, SHA256_DIGEST_SIZE);
+        SHA256Input(&sha, seed, 20);
+        SHA256ResultBytes(&sha, hash);
+    }
+    else {
+        SHA1Context sha;
+        SHA1Reset(&sha);
+        SHA1Input(&sha, seed, 20);
+        SHA1Input(&sha, mPwdStage2, 20);
+        if (!SHA1ResultBytes(&sha, hash))
+            return 0;
+    }
+
+    for (uint8_t i = 0; i < size; i++)
+        out[i] = mPwdStage1[i] ^ hash[i];
+    return size;
+}
+
+
+
+/**
+ * @brief Responds to the server handshake sequence by logging in using User and Password
+ *
+ * Password is scrambled for the plugin announced in handshake, so servers
+ * using caching_sha2_password accept it without an auth switch.
+ *
+ * @param user MySQL user
+ * @param password MySQL session password
+ * @param db Default database, nullptr for none
+ * @return bool false if TCP socket write failed
+ */
+bool MySQL::send_authentication_packet(const char *user, const char *password, const char *db) {
+
+    uint8_t auth[SHA256_DIGEST_SIZE];
+    uint8_t auth_len = this->scramble_password(password, mSeed, auth);
+
+    // client flags, max_allowed_packet (16MB), charset (8) and 23 bytes filler
+    uint8_t head[32] = {0};
+    uint32_t client_flags = mCapabilities;
+    if (db)
+        client_flags |= CLIENT_CONNECT_WITH_DB;
+    store_int(head, client_flags, 4);
+    store_int(head + 4, 0x01000000, 4);
+    head[8] = 0x08;
+
+    // Null-terminated strings, auth response is prefixed by its length
+    size_t user_len = strlen(user) + 1;
+    size_t db_len = db ? strlen(db) + 1 : 0;
+    const char *plugin = auth_plugin_name(mAuthPlugin);
+    size_t plugin_len = (mCapabilities & CLIENT_PLUGIN_AUTH) ? strlen(plugin) + 1 : 0;
+
+    return this->tx_packet(sizeof(head) + user_len + 1 + auth_len + db_len + plugin_len, 1)
+        && this->tx_append(head, sizeof(head))
+        && this->tx_append(user, user_len)
+        && this->tx_append(&auth_len, 1)
+        && this->tx_append(auth, auth_len)
+        && this->tx_append(db, db_len)
+        && this->tx_append(plugin, plugin_len)
+        && this->tx_flush();
+}
 
-        case PACKET_EOF:
-            type = "EOF";
-            break;
 
-        case PACKET_ERR:
-            type = "ERR";
+/**
+ * @brief Read the server replies to the authentication packet
+ *
+ * Besides OK and ERR the server can send an auth switch request (answered
+ * with password scrambled for the new plugin and seed) or, with
+ * caching_sha2_password, a fast auth result followed by OK. Full
+ * authentication (user not cached by server yet) needs TLS or RSA and
+ * is not supported.
+ *
+ * @param password MySQL session password
+ * @return true OK packet, session is open
+ * @return false ERR packet (wrong user or password), timeout or unsupported authentication method
+ */
+bool MySQL::read_auth_result(const char *password)
+{
+    while (this->recieve()) {
+        const uint8_t *payload = packet.mPayload;
+        uint32_t len = packet.mPayloadLength;
+        if (len == 0)
             break;
+
+        switch (payload[0]) {
+            case 0x00:
+                this->parse_ok_packet(&packet);
+                return true;
+
+            case 0xFF:
+                this->parse_error_packet(&packet, packet.getPacketLength());
+                return false;
+
+            // Auth switch request: plugin name and a new seed
+            case 0xFE: {
+                const char *name = (const char *)payload + 1;
+                size_t name_len = strnlen(name, len - 1);
+                uint8_t plugin = auth_plugin(name, name_len);
+                if (plugin == AUTH_NONE || len < name_len + 2 + 20) {
+                    error_message = "Authentication method not supported";
+                    return false;
+                }
+                mAuthPlugin = plugin;
+                memcpy(mSeed, payload + name_len + 2, 20);
+
+                uint8_t auth[SHA256_DIGEST_SIZE];
+                uint8_t auth_len = this->scramble_password(password, mSeed, auth);
+                uint8_t sequence_id = packet.mPacketNumber + 1;
+                this->rx_discard();
+                if (!this->tx_packet(auth_len, sequence_id) || !this->tx_append(auth, auth_len) || !this->tx_flush())
+                    return false;
+                break;
+            }
+
+            // caching_sha2_password: 0x03 fast auth succeeded (OK follows), 0x04 full auth needed
+            case 0x01:
+                if (len == 2 && payload[1] == 0x03)
+                    break;
+                error_message = "Full authentication needs TLS, not supported";
+                return false;
+
+            default:
+                error_message = "Authentication method not supported";
+                return false;
         }
-        // Serial.printf("Packet %d is a %s packet\r\n", packet_number, type.c_str());
     }
+    return false;
+}
+
+
+/**
+ * @brief Parse handshake sent by server (protocol version 10)
+ *
+ * @param packet Handshake packet
+ * @return true Handshake parsed
+ * @return false ERR packet (e.g. too many connections) or packet not valid
+ */
+bool MySQL::parse_handshake_packet(const MySQL_Packet *packet)
+{
+    const uint8_t *payload = packet->mPayload;
+    uint32_t len = packet->mPayloadLength;
+
+    if (len > 0 && payload[0] == 0xFF) {
+        this->parse_error_packet(packet, packet->getPacketLength());
+        return false;
+    }
+
+    // Server version, null-terminated
+    uint32_t i = 1;
+    while (i < len && payload[i] != 0x00)
+        i++;
+
+    // Thread id, seed, filler, capabilities, charset, status, capabilities, seed length, reserved and seed
+    if (len < 1 || payload[0] != 0x0A || i + 1 + 4 + 8 + 1 + 2 + 1 + 2 + 2 + 1 + 10 + 12 > len) {
+        error_message = "Handshake packet not valid";
+        return false;
+    }
+
+    // A session can be opened again with the same object
+    free(server_version);
+    server_version = (char *)malloc(i);
+    if (server_version != nullptr)
+        memcpy(server_version, payload + 1, i);
+
+    // Capture the first 8 characters of seed
+    i += 5; // Skip terminator and thread id
+    memcpy(mSeed, payload + i, 8);
+
+    // Server capabilities: lower 2 bytes after filler, upper 2 bytes after charset and status
+    uint32_t server_caps = readFixedLengthInt(payload, i + 9, 2);
+    server_caps |= readFixedLengthInt(payload, i + 14, 2) << 16;
+    mCapabilities = CLIENT_FLAGS & server_caps;
+    if (mCompressRequested)
+        mCapabilities |= CLIENT_COMPRESS & server_caps;
+
+    // Capture rest of seed
+    i += 27; // skip ahead
+    memcpy(mSeed + 8, payload + i, 12);
+
+    // Plugin of the account is unknown yet, the one of server default is used first
+    mAuthPlugin = AUTH_NATIVE_PASSWORD;
+    i += 13; // seed and terminator
+    if ((mCapabilities & CLIENT_PLUGIN_AUTH) && i < len) {
+        size_t name_len = strnlen((const char *)payload + i, len - i);
+        if (auth_plugin((const char *)payload + i, name_len) == AUTH_CACHING_SHA2)
+            mAuthPlugin = AUTH_CACHING_SHA2;
+    }
+    return true;
 }
-#endif
\ No newline at end of file
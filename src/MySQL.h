@@ -14,38 +14,134 @@
 #include <Client.h>
 
 #include "SHA1.h"
+#include "SHA256.h"
+#include "Inflate.h"
 #include "PacketsTypes.h"
 #include "SQLVarTypes.h"
 #include "DataQuery.h"
-
-
-#if defined(__AVR__)
- #include <ArduinoSTL.h>
-#else
-#include <cstdint>
-#include <vector>
-#endif
+#include "QueryCache.h"
+#include "PreparedStatement.h"
+#include "BulkInserter.h"
 
 
 #define DEBUG 0
 #define MAX_PRINT_LEN 32
 
+// Per-query statistics (see getQueryStats()), set to 1 here or with build flags to enable.
+// The library must be compiled with the same value, defining it in the sketch is not enough.
+#ifndef MYSQL_STATS
+#define MYSQL_STATS 0
+#endif
+
+#if MYSQL_STATS
+#define MYSQL_STATS_DO(...) do { __VA_ARGS__; } while (0)
+#else
+#define MYSQL_STATS_DO(...) do {} while (0)
+#endif
+
 const char CONNECTED[] PROGMEM = "Connected to MySQL server version ";
 const char DISCONNECTED[] PROGMEM = "Disconnected.";
 
 /**
  * @brief Used to send data over TCP socket.
  */
+#ifndef BUFF_SIZE
 #if defined(ESP32)
 #define  BUFF_SIZE (2 * CONFIG_LWIP_TCP_MSS)
 #else
 #define  BUFF_SIZE (1024)
 #endif
+#endif
+
+// Larger payloads are split in more packets
+#define MAX_PACKET_PAYLOAD 0xFFFFFF
+
+// Max payload of a recieved packet. A row that does not fit in BUFF_SIZE (e.g.
+// with a BLOB) is copied whole in a heap buffer, it is not streamed: larger
+// packets are read and dropped and the query fails.
+#ifndef MYSQL_MAX_PACKET_SIZE
+#if MYSQL_STATIC_STORAGE
+#define MYSQL_MAX_PACKET_SIZE (2UL * BUFF_SIZE)
+#else
+#define MYSQL_MAX_PACKET_SIZE (4UL * BUFF_SIZE)
+#endif
+#endif
+
+// Max size of a compressed packet (compressed and uncompressed). Server fills
+// them up to net_buffer_length (16KB), or with a single larger MySQL packet.
+#ifndef MYSQL_MAX_COMPRESSED_SIZE
+#define MYSQL_MAX_COMPRESSED_SIZE (MYSQL_MAX_PACKET_SIZE + 16384UL)
+#endif
+
+// Default max time to wait for server response (ms)
+#define QUERY_TIMEOUT 5000
+
+// Capabilities requested to server, the session uses those supported by both
+#define CLIENT_FLAGS (CLIENT_LONG_PASSWORD | CLIENT_LONG_FLAG | CLIENT_PROTOCOL_41 | \
+                      CLIENT_INTERACTIVE | CLIENT_TRANSACTIONS | CLIENT_SECURE_CONNECTION | \
+                      CLIENT_MULTI_STATEMENTS | CLIENT_MULTI_RESULTS | CLIENT_PLUGIN_AUTH)
+
+class MySQL;
+
+/**
+ * @brief Callback invoked when a query started with beginQuery() is completed
+ */
+typedef void (*QueryCallback)(MySQL *sql, bool success, void *userData);
+
+#if MYSQL_STATS
+/**
+ * @brief Where the time of a query went (times are in microseconds)
+ *
+ * Bytes are counted on the wire, so they are the compressed ones with
+ * compressed protocol. Heap is measured only on ESP32 and ESP8266.
+ */
+typedef struct {
+    uint32_t sendTime;          // Writing the command to TCP socket
+    uint32_t firstByteTime;     // From end of sending to first byte of response
+    uint32_t recieveTime;       // Waiting and reading response packets
+    uint32_t parseTime;         // Decoding packets and running the row handler
+    uint32_t totalTime;         // From start of command to end of result
+    uint32_t packetsOut;
+    uint32_t packetsIn;
+    uint32_t bytesOut;
+    uint32_t bytesIn;
+    uint32_t rows;
+    int32_t  heapUsed;          // Free heap at start less free heap at end
+    bool     success;
+} QueryStats_t;
+
+/**
+ * @brief Callback invoked with the statistics of each completed query
+ */
+typedef void (*QueryStatsCallback)(MySQL *sql, const QueryStats_t &stats, void *userData);
+#endif
+
+/**
+ * @brief One query of a pipelined batch (see MySQL::queryBatch())
+ *
+ * Rows are stored in result, or handed to handler if result is nullptr.
+ */
+typedef struct {
+    const char  *query;
+    DataQuery_t *result;
+    RowHandler  handler;
+    void        *userData;
+    bool        success;
+    uint64_t    affectedRows;
+    uint64_t    lastInsertId;
+} BatchQuery_t;
 
 
 class MySQL
 {
 public:
+    // Authentication plugins supported
+    enum {
+        AUTH_NONE,
+        AUTH_NATIVE_PASSWORD,       // mysql_native_password
+        AUTH_CACHING_SHA2           // caching_sha2_password (MySQL 8 default)
+    };
+
     /**
      * @brief Creates a MySQL object
      *
@@ -61,6 +157,9 @@ public:
     /**
      * @brief Connect to MySQL under specific session
      *
+     * A query started by beginQuery() is dropped, its onDone is called with
+     * false once the new session is set up.
+     *
      * @param user Username
      * @param password Password
      * @return true Connection established and session opened
@@ -81,6 +180,36 @@ public:
      * @return false Unable to send disconnect command to server
      */
     bool disconnect();
+    /**
+     * @brief Check if the session is still alive (COM_PING)
+     *
+     * Costs a single round-trip and does not touch the session state,
+     * it can be used to validate a connection kept open for a long time.
+     * @return true Server replied OK
+     * @return false Connection lost or server error
+     */
+    bool ping();
+    /**
+     * @brief Reset the session state on the open connection (COM_RESET_CONNECTION)
+     *
+     * Temporary tables, user variables, transactions and prepared statements
+     * are dropped as with a new connection, but without TCP connection and
+     * authentication: it costs a single round-trip.
+     * @return true Server replied OK
+     * @return false Connection lost or server error
+     */
+    bool resetSession();
+    /**
+     * @brief Login as another user, or select another database, on the open connection (COM_CHANGE_USER)
+     *
+     * Session state is reset as with resetSession().
+     * @param user Username
+     * @param password Password
+     * @param db Default database, nullptr for none
+     * @return true Session opened
+     * @return false Login failed (server may close the connection, see connect())
+     */
+    bool changeUser(const char *user, const char *password, const char *db = nullptr);
     /**
      * @brief Send a simple query and expect Table as result
      * @param Database Database structure to store results
@@ -88,13 +217,176 @@ public:
      * @return bool state
      */
     bool query(DataQuery_t & database, const char *pQuery);
+    /**
+     * @brief Serve repeated read-only queries of query() and queryf() from cache
+     *
+     * Statements that are not reads sent on this connection, also with
+     * queryBatch(), BulkInserter or PreparedStatement, drop cached results.
+     * A result served from cache costs no round-trip.
+     * @param cache Cache shared by queries, nullptr to disable it
+     */
+    void setQueryCache(QueryCache *cache) {
+        mCache = cache;
+    }
+    /**
+     * @brief Format and send a query, the text is written directly in the packet buffer
+     *
+     * Conversions:
+     * %d %i %u (with l or ll for long and long long), %f: numbers
+     * %s: string, quoted and escaped (nullptr is NULL)
+     * %I: identifier (table or column name), quoted with backticks
+     * %%: the '%' char
+     *
+     *   sql.queryf(data, "SELECT * FROM %I WHERE label = %s AND gpio > %d", table, label, 4);
+     *
+     * The whole query must fit in tcp_socket_buffer.
+     * @param Database Database structure to store results
+     * @param fmt Query format
+     * @return bool state, false also if the format is not valid or the query is too long
+     */
+    bool queryf(DataQuery_t & database, const char *fmt, ...);
+    /**
+     * @brief Format and send a query, rows are streamed to handler (see queryf())
+     *
+     * @param handler Callback invoked for each row
+     * @param userData Opaque pointer passed back to the handler
+     * @param fmt Query format
+     * @return bool state
+     */
+    bool queryStreamf(RowHandler handler, void *userData, const char *fmt, ...);
+    /**
+     * @brief Send a query and stream the result rows without storing them
+     *
+     * Every row is decoded as soon as its packet arrives and handed to the
+     * handler as a zero-copy Row_t view, so memory usage is bounded by one packet.
+     * Rows larger than BUFF_SIZE take a heap buffer of their size, up to
+     * MYSQL_MAX_PACKET_SIZE: the query fails with larger ones.
+     * @param pQuery Query
+     * @param handler Callback invoked for each row
+     * @param userData Opaque pointer passed back to the handler
+     * @return bool state
+     */
+    bool queryStream(const char *pQuery, RowHandler handler, void *userData = nullptr);
+    /**
+     * @brief Check if last query has more results (multiple statements or procedure call)
+     *
+     */
+    bool hasMoreResults() {
+        return mMoreResults;
+    }
+    /**
+     * @brief Read next result of a query with multiple statements
+     *
+     *   sql.query(data, "UPDATE t SET a = 1; SELECT * FROM t");
+     *   while (sql.hasMoreResults())
+     *     sql.nextResult(data);
+     *
+     * Results not read are discarded before next command is sent.
+     * @param Database Database structure to store results
+     * @return bool state, false also if there are no more results
+     */
+    bool nextResult(DataQuery_t & database);
+    /**
+     * @brief Read next result of a query with multiple statements, rows are streamed
+     *
+     * @param handler Callback invoked for each row
+     * @param userData Opaque pointer passed back to the handler
+     * @return bool state, false also if there are no more results
+     */
+    bool nextResult(RowHandler handler, void *userData = nullptr);
+    /**
+     * @brief Send more queries at once and then read all responses in order
+     *
+     * Queries are written back-to-back before reading any response, so a
+     * batch costs about one round-trip. A failed query does not stop the
+     * following ones: check BatchQuery_t::success of each query.
+     * @param batch Array of queries
+     * @param count Number of queries
+     * @return true All queries succeeded
+     * @return false One or more queries failed
+     */
+    bool queryBatch(BatchQuery_t *batch, uint8_t count);
+    /**
+     * @brief Send more queries at once, results are stored in array results
+     *
+     * @param queries Array of queries
+     * @param results Array of DataQuery_t, one for each query
+     * @param count Number of queries
+     * @return true All queries succeeded
+     * @return false One or more queries failed
+     */
+    bool queryBatch(const char *const queries[], DataQuery_t results[], uint8_t count);
+    /**
+     * @brief Send a query and return immediately, response is read by poll()
+     *
+     * Call poll() from loop() until the query is completed: onDone is then
+     * invoked with the query result. Only one query at a time can run on
+     * a MySQL object, use more objects to run queries concurrently.
+     * @param Database Database structure to store results, valid until onDone is called
+     * @param pQuery Query
+     * @param onDone Callback invoked when query is completed
+     * @param userData Opaque pointer passed back to onDone
+     * @return bool false if a query is already running or sending failed
+     */
+    bool beginQuery(DataQuery_t & database, const char *pQuery, QueryCallback onDone, void *userData = nullptr);
+    /**
+     * @brief Send a query and return immediately, rows are streamed by poll()
+     *
+     * @param pQuery Query
+     * @param handler Callback invoked for each row
+     * @param onDone Callback invoked when query is completed
+     * @param userData Opaque pointer passed back to both callbacks
+     * @return bool false if a query is already running or sending failed
+     */
+    bool beginQuery(const char *pQuery, RowHandler handler, QueryCallback onDone, void *userData = nullptr);
+    /**
+     * @brief Process the response of a query started with beginQuery()
+     *
+     * Only bytes already recieved are read, it never waits for the server.
+     * @return true Query still running
+     * @return false No query running
+     */
+    bool poll();
+    /**
+     * @brief Check if a query started with beginQuery() is still running
+     *
+     */
+    bool busy() {
+        return mState != QUERY_IDLE;
+    }
+    /**
+     * @brief Max time to wait for server response
+     *
+     * @param timeout Milliseconds
+     */
+    void setTimeout(uint32_t timeout) {
+        mTimeout = timeout;
+    }
+    /**
+     * @brief Request the compressed protocol (CLIENT_COMPRESS), call it before connect()
+     *
+     * Packets recieved from server are inflated, so large result sets cost
+     * much less bytes on the wire. Commands are sent uncompressed.
+     * Heap is used for the last compressed packet and its decompressed payload.
+     * @param enable true to request compression on next connect()
+     */
+    void setCompression(bool enable) {
+        mCompressRequested = enable;
+    }
+    /**
+     * @brief Check if the session is using the compressed protocol
+     *
+     */
+    bool compressed() {
+        return mCompress;
+    }
     /**
      * @brief Prints the recieved table to the default stdout buffer
      * @param Database Database structure to store results
      *
      */
     template <typename TDestination>
-    void printHeading(std::vector<Field_t> &fields, TDestination& destination) {
+    void printHeading(FieldList &fields, TDestination& destination) {
         char sep[MAX_PRINT_LEN + 3] = { 0 };
         const int printfLen = MAX_PRINT_LEN + 4;
         int str_len;
@@ -136,20 +428,16 @@ public:
         int str_len;
 
         // Print records values
-        for (Record_t rec : database.records) {
-            int i = 0;
-            for (String value: rec.record) {
-                int len = getMax(database.fields.at(i).size, database.fields.at(i).name.length());                        
-                str_len = (len > MAX_PRINT_LEN || database.fields.at(i).size == 0)  ? MAX_PRINT_LEN : len;
-
-                if (!value.length())
-                    value = " ";
-                if (value.length() > MAX_PRINT_LEN) {
-                    value = value.substring(0, MAX_PRINT_LEN);
-                    value.replace(value.substring(MAX_PRINT_LEN-3, MAX_PRINT_LEN), "...");
-                }
-                this->printf_n(destination, printfLen + 1, "| %*s ", str_len, value.c_str());
-                i++;
+        for (uint32_t row = 0; row < database.recordCount; row++) {
+            for (int col = 0; col < database.fieldCount; col++) {
+                int len = getMax(database.fields.at(col).size, database.fields.at(col).name.length());
+                str_len = (len > MAX_PRINT_LEN || database.fields.at(col).size == 0)  ? MAX_PRINT_LEN : len;
+
+                const char* value = database.getRowValue(row, col);
+                if (database.getValueLength(row, col) > MAX_PRINT_LEN)
+                    this->printf_n(destination, printfLen + 1, "| %.*s... ", MAX_PRINT_LEN - 3, value);
+                else
+                    this->printf_n(destination, printfLen + 1, "| %*s ", str_len, *value ? value : " ");
             }
             destination.print("|\n");
         }
@@ -164,15 +452,71 @@ public:
         destination.print("+\n");
     }
 
+    /**
+     * @brief Rows changed, deleted or inserted by last command (from OK packet)
+     *
+     */
+    uint64_t getAffectedRows() {
+        return mAffectedRows;
+    }
+
+    /**
+     * @brief AUTO_INCREMENT value generated by last INSERT (from OK packet)
+     *
+     */
+    uint64_t getLastInsertId() {
+        return mLastInsertId;
+    }
+
+    /**
+     * @brief Number of warnings of last command (see SHOW WARNINGS)
+     *
+     */
+    uint16_t getWarnings() {
+        return mWarnings;
+    }
+
+    /**
+     * @brief Server status flags from last OK or EOF packet (SERVER_* defines)
+     *
+     */
+    uint16_t getServerStatus() {
+        return mServerStatus;
+    }
+
     const char* getLastSQLSTATE() {
         return SQL_state;
     }
 
+#if MYSQL_STATS
+    /**
+     * @brief Statistics of last completed query (only with MYSQL_STATS 1)
+     *
+     */
+    const QueryStats_t& getQueryStats() {
+        return mStats;
+    }
+
+    /**
+     * @brief Invoke callback with the statistics of each completed query
+     *
+     * @param callback Function to call, nullptr to disable
+     * @param userData Opaque pointer passed back to callback
+     */
+    void setStatsCallback(QueryStatsCallback callback, void *userData = nullptr) {
+        mStatsCallback = callback;
+        mStatsUserData = userData;
+    }
+#endif
+
     const char* getLastError() {
         return error_message.c_str();
     }
 
 private:
+    friend class PreparedStatement;
+    friend class BulkInserter;
+
     // User-configured TCP socket attached to NetworkInterface
     Client *client = nullptr;
 
@@ -186,31 +530,169 @@ private:
     char SQL_state[6];
     String error_message;
 
-    // Class containing packet header and payload
-    MySQL_Packet *packet = nullptr;
+    // Last recieved packet (a view of tcp_socket_buffer)
+    MySQL_Packet packet;
 
     // Fixed-Size buffer for raw data from TCP socket
     uint8_t tcp_socket_buffer[BUFF_SIZE] = {0};
 
+    // Recieved bytes not yet consumed are tcp_socket_buffer[mRxHead, mRxTail)
+    size_t mRxHead = 0;
+    size_t mRxTail = 0;
+    size_t mRxPacketSize = 0;
+
+    // Bytes collected in tcp_socket_buffer waiting to be sent
+    size_t mTxLen = 0;
+
+    // Payload of last packet when it does not fit in tcp_socket_buffer
+    uint8_t *mSpill = nullptr;
+
+    // Last packet was larger than MYSQL_MAX_PACKET_SIZE (or out of memory) and has been dropped
+    bool mRxSkipped = false;
+
     // MySQL Server IP
     const char *mServerIP = nullptr;
     uint16_t mPort = 3306;
 
-    // MySQL packets parsed from mBuffer
-    std::vector<MySQL_Packet*> mPacketsRecieved;
+    // State of running query
+    typedef enum {
+        QUERY_IDLE,
+        QUERY_RESPONSE,
+        QUERY_FIELDS,
+        QUERY_ROWS,
+        QUERY_DONE
+    } QueryState_t;
+
+    QueryState_t mState = QUERY_IDLE;
+    bool mQueryOk = false;
+    bool mMoreResults = false;
+    FieldList *mFields = nullptr;
+    FieldList mStreamFields;
+    // Statement with rows of last execution not read yet, dropped before next command
+    PreparedStatement *mStatement = nullptr;
+    // Result failed (too many columns, definition or row not valid), its rows are dropped
+    bool mFieldsOverflow = false;
+#if MYSQL_STATIC_STORAGE
+    Column_t mColumns[MYSQL_MAX_COLUMNS];
+#else
+    Column_t *mColumns = nullptr;
+#endif
+    RowHandler mRowHandler = nullptr;
+    void *mRowUserData = nullptr;
+    DataQuery_t *mResult = nullptr;
+    QueryCallback mOnDone = nullptr;
+    void *mDoneUserData = nullptr;
+    uint32_t mLastRecieved = 0;
+
+    // Results of read-only queries, optional
+    QueryCache *mCache = nullptr;
+
+    uint32_t mTimeout = QUERY_TIMEOUT;
+
+    // Capabilities of session
+    uint32_t mCapabilities = 0;
+
+    // Last OK or EOF packet
+    uint64_t mAffectedRows = 0;
+    uint64_t mLastInsertId = 0;
+    uint16_t mServerStatus = 0;
+    uint16_t mWarnings = 0;
+
+    // Compressed protocol, header of compressed packets is
+    // int<3> compressed length, int<1> sequence ID, int<3> uncompressed length
+    bool mCompressRequested = false;
+    bool mCompress = false;
+    uint8_t mZSequence = 0;
+    uint8_t mZHeader[7] = {0};
+    uint8_t mZHeaderLen = 0;
+
+    // Payload of compressed packet being recieved
+    uint8_t *mZIn = nullptr;
+    uint32_t mZInSize = 0;
+    uint32_t mZInLen = 0;
+    uint32_t mZInRecv = 0;
+
+    // Decompressed bytes not yet read are mZOut[mZOutPos, mZOutLen)
+    uint8_t *mZOut = nullptr;
+    uint32_t mZOutSize = 0;
+    uint32_t mZOutLen = 0;
+    uint32_t mZOutPos = 0;
+
+    // A compressed packet has been dropped, the rest of the response is dropped too
+    bool mZDrop = false;
+
+#if MYSQL_STATS
+    // Record of the running query
+    QueryStats_t mStats = {};
+    bool mStatsActive = false;
+    uint32_t mStatsStart = 0;
+    uint32_t mStatsSent = 0;
+    uint32_t mStatsHeap = 0;
+    QueryStatsCallback mStatsCallback = nullptr;
+    void *mStatsUserData = nullptr;
+
+    void stats_begin(void);
+    void stats_end(bool success);
+    void stats_bytes_in(int len);
+#endif
 
     // Seed used to hash password through SHA-1
     uint8_t mSeed[20] = {0};
 
-    bool recieve(void);
-    uint16_t write(char *message, uint16_t len);
-    int send_authentication_packet(const char *user, const char *password, const char *db);
-    void parse_handshake_packet(void);
-    bool parse_textresultset(DataQuery_t* dataquery);
-    void free_recieved_packets(void);
-    int  scramble_password(const char *password, uint8_t *pwd_hash);
-    void flush_packet(void);
+    // Authentication plugin of session
+    uint8_t mAuthPlugin = AUTH_NATIVE_PASSWORD;
+
+    // Hash(password) and Hash(Hash(password)) of last password for mPwdPlugin
+    uint8_t mPwdStage1[SHA256_DIGEST_SIZE] = {0};
+    uint8_t mPwdStage2[SHA256_DIGEST_SIZE] = {0};
+    uint8_t mPwdPlugin = AUTH_NONE;
+
+    bool recieve(bool wait = true);
+    bool recieve_large(uint32_t payload_len, uint32_t sequence_id);
+    bool rx_require(size_t len, bool wait = true);
+    bool rx_skip(uint32_t len);
+    void rx_consume(void);
+    void rx_reset(void);
+    void rx_discard(void);
+    size_t write(const char *message, size_t len);
+    size_t net_available(void);
+    int net_read(uint8_t *buf, size_t len);
+    size_t net_read_bytes(uint8_t *buf, size_t len);
+    bool z_recieve(bool wait);
+    int z_read(uint8_t *buf, size_t len, bool wait);
+    void z_reset(void);
+    void z_drop(void);
+    bool open_session(const char *user, const char *password, const char *db);
+    bool send_authentication_packet(const char *user, const char *password, const char *db);
+    bool read_auth_result(const char *password);
+    bool parse_handshake_packet(const MySQL_Packet *packet);
+    bool send_query(const char *pQuery);
+    bool send_formatted(const char *fmt, va_list args);
+    bool prepare_formatted(size_t &len, const char *fmt, va_list args);
+    bool write_formatted(size_t len);
+    void cache_sent(const char *sql, size_t len);
+    bool format_query(size_t &len, const char *fmt, va_list args);
+    bool send_command(uint8_t command, const uint8_t *data, size_t len);
+    bool command_ok(uint8_t command);
+    bool tx_command(uint8_t command, const uint8_t *data, size_t len);
+    bool tx_packet(size_t payload_len, uint8_t sequence_id);
+    bool tx_append(const void *data, size_t len);
+    bool tx_flush(void);
+    bool run_query(const char *pQuery, FieldList &fields, RowHandler handler, void *userData);
+    bool start_query(const char *pQuery, FieldList *fields, RowHandler handler, void *userData);
+    void expect_response(FieldList *fields, RowHandler handler, void *userData);
+    bool query_step(bool wait);
+    bool finish_query(void);
+    bool read_result(FieldList *fields, RowHandler handler, void *userData);
+    void drain_results(void);
+    bool parse_column_definition(const MySQL_Packet *packet, Field_t &field);
+    bool parse_text_row(const MySQL_Packet *packet, Column_t *columns, uint16_t column_count);
+    static void store_row(const Row_t &row, void *userData);
+    uint8_t scramble_password(const char *password, const uint8_t *seed, uint8_t *out);
     void parse_error_packet(const MySQL_Packet *packet, uint16_t packet_len);
+    void parse_ok_packet(const MySQL_Packet *packet);
+    void parse_eof_packet(const MySQL_Packet *packet);
+    void clear_status(void);
 
     bool isValidIPAddress(const char* str);
 
@@ -226,8 +708,6 @@ private:
     }
 
 #if DEBUG
-    void print_packets_types(void);
-
     void printRawBytes(const uint8_t* data, size_t len) {
         char buf[32];
         snprintf(buf, 32, "Packet length: %d\n", len);
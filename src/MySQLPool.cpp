@@ -0,0 +1,168 @@
+#include "MySQLPool.h"
+
+
+MySQLPool::~MySQLPool()
+{
+    for (Session_t &session : this->sessions) {
+        this->close(session);
+        delete session.sql;
+    }
+}
+
+
+bool MySQLPool::addClient(Client *pClient)
+{
+    if (pClient == nullptr)
+        return false;
+
+#if MYSQL_STATIC_STORAGE
+    if (this->sessions.size() == this->sessions.capacity())
+        return false;
+#endif
+
+    MySQL *sql = new MySQL(pClient, this->mServerIP, this->mPort);
+    if (sql == nullptr)
+        return false;
+
+    Session_t session;
+    session.sql = sql;
+    session.client = pClient;
+    session.lastUsed = 0;
+    session.busy = false;
+    session.ready = false;
+    this->sessions.push_back(session);
+    return true;
+}
+
+
+void MySQLPool::begin(const char *user, const char *password, const char *db)
+{
+    mUser = user;
+    mPassword = password;
+    mDatabase = db;
+}
+
+
+/**
+ * @brief Get a free session, opening a new one only when none is ready
+ *
+ */
+MySQL* MySQLPool::acquire()
+{
+    // First choice: a session already open
+    for (Session_t &session : this->sessions) {
+        if (session.busy || !session.ready || session.sql->busy())
+            continue;
+        if (this->check(session)) {
+            session.busy = true;
+            return session.sql;
+        }
+    }
+
+    // Then open a session on a free socket
+    for (Session_t &session : this->sessions) {
+        if (session.busy || session.ready)
+            continue;
+        if (this->open(session)) {
+            session.busy = true;
+            return session.sql;
+        }
+    }
+    return nullptr;
+}
+
+
+void MySQLPool::release(MySQL *sql)
+{
+    for (Session_t &session : this->sessions) {
+        if (session.sql == sql) {
+            session.busy = false;
+            session.lastUsed = millis();
+            return;
+        }
+    }
+}
+
+
+void MySQLPool::maintain()
+{
+    for (Session_t &session : this->sessions) {
+        // A query started with beginQuery() may still be running
+        if (!session.busy && session.ready && !session.sql->busy())
+            this->check(session);
+    }
+}
+
+
+void MySQLPool::closeIdle()
+{
+    for (Session_t &session : this->sessions) {
+        if (!session.busy)
+            this->close(session);
+    }
+}
+
+
+uint8_t MySQLPool::available() const
+{
+    uint8_t count = 0;
+    for (const Session_t &session : this->sessions) {
+        if (!session.busy)
+            count++;
+    }
+    return count;
+}
+
+
+/**
+ * @brief Open TCP connection and authenticate
+ *
+ */
+bool MySQLPool::open(Session_t &session)
+{
+    if (mUser == nullptr)
+        return false;
+
+    // Drop what remains of a lost connection
+    if (session.client->connected())
+        session.client->stop();
+
+    session.ready = session.sql->connect(mUser, mPassword, mDatabase);
+    session.lastUsed = millis();
+    return session.ready;
+}
+
+
+void MySQLPool::close(Session_t &session)
+{
+    if (session.ready && session.client->connected())
+        session.sql->disconnect();
+    session.client->stop();
+    session.ready = false;
+}
+
+
+/**
+ * @brief Check an open session, COM_PING is sent only if idle since more than ping interval
+ *
+ * @return true Session ready
+ * @return false Session lost and closed
+ */
+bool MySQLPool::check(Session_t &session)
+{
+    if (!session.client->connected()) {
+        this->close(session);
+        return false;
+    }
+
+    if (millis() - session.lastUsed < mPingInterval)
+        return true;
+
+    if (session.sql->ping()) {
+        session.lastUsed = millis();
+        return true;
+    }
+
+    this->close(session);
+    return false;
+}
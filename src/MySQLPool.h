@@ -0,0 +1,130 @@
+/**
+ * @file MySQLPool.h
+ * @brief Pool of MySQL sessions kept open between queries
+ */
+
+#ifndef MYSQL_POOL_H
+#define MYSQL_POOL_H
+
+#include "MySQL.h"
+
+// Sessions idle for longer are checked with COM_PING before use
+#define POOL_PING_INTERVAL 30000
+
+/**
+ * @brief Authenticated sessions, one for each Client, opened on demand and kept alive.
+ *
+ * A query on a session taken from the pool costs a single round-trip, instead
+ * of TCP connection, handshake and authentication each time.
+ *
+ *   MySQLPool pool(dbHost, dbPort);
+ *   pool.addClient(&client1);
+ *   pool.addClient(&client2);
+ *   pool.begin(user, password, database);
+ *
+ *   MySQL *sql = pool.acquire();
+ *   if (sql) {
+ *     sql->query(data, "SELECT * FROM gpios");
+ *     pool.release(sql);
+ *   }
+ *
+ * Server address and credentials are not copied: they must stay valid
+ * as long as the pool is used.
+ */
+class MySQLPool
+{
+public:
+    MySQLPool(const char *server_ip, uint16_t port = 3306) : mServerIP(server_ip), mPort(port) {;}
+    ~MySQLPool();
+
+    MySQLPool(const MySQLPool &) = delete;
+    MySQLPool& operator=(const MySQLPool &) = delete;
+
+    /**
+     * @brief Add a socket to the pool, a session will be opened on it when needed
+     *
+     * @param pClient Socket attached to a network interface
+     * @return true Added
+     * @return false Out of memory, or MYSQL_POOL_SIZE clients already added (MYSQL_STATIC_STORAGE)
+     */
+    bool addClient(Client *pClient);
+
+    /**
+     * @brief Set credentials used to open sessions
+     *
+     * @param user Username
+     * @param password Password
+     * @param db Default database
+     */
+    void begin(const char *user, const char *password, const char *db = nullptr);
+
+    /**
+     * @brief Get a free session
+     *
+     * Sessions already open are preferred: if one is idle since more than
+     * ping interval it's checked with COM_PING and opened again when lost.
+     * @return MySQL* Session ready for queries, nullptr if none is available
+     */
+    MySQL* acquire();
+
+    /**
+     * @brief Give back a session taken with acquire()
+     *
+     * @param sql Session to release
+     */
+    void release(MySQL *sql);
+
+    /**
+     * @brief Ping idle sessions to keep them alive, call it periodically from loop()
+     *
+     * Lost sessions are closed and they will be opened again on next acquire().
+     */
+    void maintain();
+
+    /**
+     * @brief Close all sessions not in use
+     *
+     */
+    void closeIdle();
+
+    void setPingInterval(uint32_t interval) {
+        mPingInterval = interval;
+    }
+
+    uint8_t size() const {
+        return sessions.size();
+    }
+
+    // Number of sessions not in use
+    uint8_t available() const;
+
+private:
+    typedef struct {
+        MySQL       *sql;
+        Client      *client;
+        uint32_t    lastUsed;
+        bool        busy;
+        bool        ready;
+    } Session_t;
+
+#if MYSQL_STATIC_STORAGE
+    FixedVector<Session_t, MYSQL_POOL_SIZE> sessions;
+#else
+    std::vector<Session_t> sessions;
+#endif
+
+    const char *mServerIP = nullptr;
+    uint16_t mPort = 3306;
+
+    const char *mUser = nullptr;
+    const char *mPassword = nullptr;
+    const char *mDatabase = nullptr;
+
+    uint32_t mPingInterval = POOL_PING_INTERVAL;
+
+    bool open(Session_t &session);
+    void close(Session_t &session);
+    bool check(Session_t &session);
+};
+
+#endif
@@ -4,6 +4,9 @@ Packet_Type MySQL_Packet::getPacketType(void)
 {
     Packet_Type type = PACKET_UNKNOWN;
 
+    if (this->mPayloadLength == 0)
+        return type;
+
     switch (this->mPayload[0])
     {
     case 0x00:
@@ -31,4 +34,19 @@ Packet_Type MySQL_Packet::getPacketType(void)
     }
 
     return type;
-}
\ No newline at end of file
+}
+
+bool MySQL_Packet::keep(void)
+{
+    if (this->mOwner || this->mPayloadLength == 0)
+        return true;
+
+    uint8_t *payload = (uint8_t *)malloc(sizeof(uint8_t) * this->mPayloadLength);
+    if (payload == nullptr)
+        return false;
+
+    memcpy(payload, this->mPayload, this->mPayloadLength);
+    this->mPayload = payload;
+    this->mOwner = true;
+    return true;
+}
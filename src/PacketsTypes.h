@@ -13,6 +13,63 @@ typedef enum
     PACKET_ERR = 0xFF
 } Packet_Type;
 
+// Column and parameter types
+// Source : https://dev.mysql.com/doc/dev/mysql-server/latest/field__types_8h.html
+typedef enum
+{
+    MYSQL_TYPE_DECIMAL = 0x00,
+    MYSQL_TYPE_TINY = 0x01,
+    MYSQL_TYPE_SHORT = 0x02,
+    MYSQL_TYPE_LONG = 0x03,
+    MYSQL_TYPE_FLOAT = 0x04,
+    MYSQL_TYPE_DOUBLE = 0x05,
+    MYSQL_TYPE_NULL = 0x06,
+    MYSQL_TYPE_TIMESTAMP = 0x07,
+    MYSQL_TYPE_LONGLONG = 0x08,
+    MYSQL_TYPE_INT24 = 0x09,
+    MYSQL_TYPE_DATE = 0x0A,
+    MYSQL_TYPE_TIME = 0x0B,
+    MYSQL_TYPE_DATETIME = 0x0C,
+    MYSQL_TYPE_YEAR = 0x0D,
+    MYSQL_TYPE_VARCHAR = 0x0F,
+    MYSQL_TYPE_BIT = 0x10,
+    MYSQL_TYPE_JSON = 0xF5,
+    MYSQL_TYPE_NEWDECIMAL = 0xF6,
+    MYSQL_TYPE_ENUM = 0xF7,
+    MYSQL_TYPE_SET = 0xF8,
+    MYSQL_TYPE_TINY_BLOB = 0xF9,
+    MYSQL_TYPE_MEDIUM_BLOB = 0xFA,
+    MYSQL_TYPE_LONG_BLOB = 0xFB,
+    MYSQL_TYPE_BLOB = 0xFC,
+    MYSQL_TYPE_VAR_STRING = 0xFD,
+    MYSQL_TYPE_STRING = 0xFE,
+    MYSQL_TYPE_GEOMETRY = 0xFF
+} Field_Type;
+
+// Column flags
+#define NOT_NULL_FLAG   0x0001
+#define UNSIGNED_FLAG   0x0020
+#define BINARY_FLAG     0x0080
+
+// Capability flags
+// Source : https://dev.mysql.com/doc/dev/mysql-server/latest/group__group__cs__capabilities__flags.html
+#define CLIENT_LONG_PASSWORD        0x00000001
+#define CLIENT_LONG_FLAG            0x00000004
+#define CLIENT_CONNECT_WITH_DB      0x00000008
+#define CLIENT_COMPRESS             0x00000020
+#define CLIENT_PROTOCOL_41          0x00000200
+#define CLIENT_INTERACTIVE          0x00000400
+#define CLIENT_TRANSACTIONS         0x00002000
+#define CLIENT_SECURE_CONNECTION    0x00008000
+#define CLIENT_MULTI_STATEMENTS     0x00010000
+#define CLIENT_MULTI_RESULTS        0x00020000
+#define CLIENT_PLUGIN_AUTH          0x00080000
+
+// Server status flags (OK and EOF packets)
+#define SERVER_STATUS_IN_TRANS          0x0001
+#define SERVER_STATUS_AUTOCOMMIT        0x0002
+#define SERVER_MORE_RESULTS_EXISTS      0x0008
+
 
 // /**
 //  * @brief Stores the raw MySQL packet
@@ -29,6 +86,13 @@ typedef enum
 
 
 
+/**
+ * @brief MySQL packet header and payload.
+ *
+ * A packet recieved with MySQL::recieve() is only a view of the TCP socket
+ * buffer and is valid until the next packet is recieved: call keep() to
+ * take a private copy of the payload.
+ */
 class MySQL_Packet
 {
 public:
@@ -38,6 +102,7 @@ public:
         this->mPacketNumber = readFixedLengthInt(pPacket, 3, 1);
         this->mPayload = (uint8_t *)malloc(sizeof(uint8_t) * this->mPayloadLength);
         memcpy(this->mPayload, pPacket + 4, this->mPayloadLength);
+        this->mOwner = true;
     }
 
     MySQL_Packet()
@@ -49,15 +114,35 @@ public:
 
     ~MySQL_Packet()
     {
-        free(this->mPayload);
-        this->mPayload = nullptr;
-        this->mPayloadLength = 0;
-        this->mPacketNumber = 0;
+        this->release();
     }
 
+    // Payload may be owned, copies must be explicit (see keep())
+    MySQL_Packet(const MySQL_Packet &) = delete;
+    MySQL_Packet& operator=(const MySQL_Packet &) = delete;
+
+    /**
+     * @brief Point the packet to a payload owned by someone else (no copy)
+     *
+     */
+    void attach(uint8_t *payload, uint32_t length, uint32_t number)
+    {
+        this->release();
+        this->mPayload = payload;
+        this->mPayloadLength = length;
+        this->mPacketNumber = number;
+    }
+
+    /**
+     * @brief Copy the payload, so the packet stays valid after next recieve()
+     *
+     * @return true Payload is owned by this packet
+     */
+    bool keep(void);
+
     Packet_Type getPacketType(void);
 
-    uint32_t getPacketLength(void)
+    uint32_t getPacketLength(void) const
     {
         return this->mPayloadLength + 4;
     }
@@ -65,6 +150,19 @@ public:
     uint32_t mPacketNumber = 0;
     uint32_t mPayloadLength = 0;
     uint8_t *mPayload = nullptr;
+
+private:
+    bool mOwner = false;
+
+    void release(void)
+    {
+        if (this->mOwner)
+            free(this->mPayload);
+        this->mOwner = false;
+        this->mPayload = nullptr;
+        this->mPayloadLength = 0;
+        this->mPacketNumber = 0;
+    }
 };
 
 #endif
\ No newline at end of file
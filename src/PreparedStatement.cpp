@@ -0,0 +1,750 @@
+#include "MySQL.h"
+
+#define COM_STMT_PREPARE  0x16
+#define COM_STMT_EXECUTE  0x17
+#define COM_STMT_CLOSE    0x19
+
+/**
+ * @brief Read a little-endian unsigned integer of size bytes
+ *
+ */
+static uint64_t read_uint(const uint8_t *data, uint8_t size)
+{
+    uint64_t value = 0;
+    for (int i = size - 1; i >= 0; i--)
+        value = (value << 8) | data[i];
+    return value;
+}
+
+static void store_uint(uint8_t *data, uint64_t value, uint8_t size)
+{
+    for (uint8_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)value;
+        value >>= 8;
+    }
+}
+
+/**
+ * @brief Decode an IEEE 754 double, also where double is only 32 bits wide (AVR)
+ *
+ */
+static double read_double(const uint8_t *data)
+{
+    if (sizeof(double) == 8) {
+        double value;
+        memcpy(&value, data, 8);
+        return value;
+    }
+
+    uint64_t bits = read_uint(data, 8);
+    int exponent = (bits >> 52) & 0x7FF;
+    double mantissa = (double)(bits & 0xFFFFFFFFFFFFFULL) / 4503599627370496.0;  // 2^52
+    double value;
+    if (exponent == 0)
+        value = 0;
+    else if (exponent == 0x7FF)
+        value = (mantissa == 0) ? INFINITY : NAN;
+    else
+        value = ldexp(1.0 + mantissa, exponent - 1023);
+    return (bits >> 63) ? -value : value;
+}
+
+
+PreparedStatement::~PreparedStatement()
+{
+    this->close();
+    this->drain(false, false);
+    free(this->params);
+    free(this->columns);
+}
+
+/**
+ * @brief Send query to server for parsing (COM_STMT_PREPARE)
+ *
+ * Response layout (COM_STMT_PREPARE_OK) :
+ * int<1>   status (0x00)
+ * int<4>   statement_id
+ * int<2>   num_columns
+ * int<2>   num_params
+ * int<1>   reserved
+ * int<2>   warning_count
+ * followed by num_params and num_columns column definitions, each block terminated by EOF
+ *
+ * Source : https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_stmt_prepare.html
+ */
+bool PreparedStatement::prepare(const char *pQuery)
+{
+    // Response of a query started with beginQuery() still to be read
+    if (sql->busy())
+        return false;
+    this->close();
+
+    size_t len = strlen(pQuery);
+    if (!sql->send_command(COM_STMT_PREPARE, (const uint8_t *)pQuery, len))
+        return false;
+    this->readOnly = QueryCache::isReadOnly(pQuery, len);
+
+    bool ok = this->read_prepare_response();
+    MYSQL_STATS_DO(sql->stats_end(ok));
+
+    // A statement that can't be executed is released on server
+    if (!ok)
+        this->close();
+    return ok;
+}
+
+/**
+ * @brief Read COM_STMT_PREPARE_OK and the definitions following it
+ *
+ */
+bool PreparedStatement::read_prepare_response(void)
+{
+    if (!sql->recieve())
+        return false;
+
+    MySQL_Packet *packet = &sql->packet;
+    if (packet->getPacketType() == PACKET_ERR) {
+        sql->parse_error_packet(packet, packet->getPacketLength());
+        return false;
+    }
+    if (packet->mPayload[0] != 0x00 || packet->mPayloadLength < 12)
+        return false;
+
+    this->id = readFixedLengthInt(packet->mPayload, 1, 4);
+    uint16_t column_count = readFixedLengthInt(packet->mPayload, 5, 2);
+    uint16_t param_count = readFixedLengthInt(packet->mPayload, 7, 2);
+
+    // Statement is allocated on server, from now on it must be closed
+    this->prepared = true;
+
+    // Parameters definitions carry no useful information
+    bool ok = (param_count == 0 || this->read_definitions(nullptr))
+              && (column_count == 0 || this->read_definitions(&this->fields));
+
+    if (ok && param_count) {
+        Param_t *new_params = (Param_t *)realloc(this->params, param_count * sizeof(Param_t));
+        if (new_params == nullptr) {
+            sql->error_message = "Out of memory";
+            ok = false;
+        }
+        else {
+            this->params = new_params;
+            this->paramCount = param_count;
+            for (uint16_t i = 0; i < param_count; i++)
+                this->bindNull(i);
+        }
+    }
+    return ok;
+}
+
+/**
+ * @brief Read column definitions packets until EOF
+ *
+ * @param fields Vector to fill, nullptr to skip definitions
+ */
+bool PreparedStatement::read_definitions(FieldList *fields)
+{
+    if (fields)
+        fields->clear();
+
+    // Definitions are read until EOF also after an error
+    bool failed = false;
+    while (sql->recieve()) {
+        if (sql->packet.getPacketType() == PACKET_EOF)
+            return !failed;
+
+        if (fields == nullptr || failed)
+            continue;
+        if (fields->size() == MYSQL_MAX_COLUMNS) {
+            sql->error_message = "Result has too many columns";
+            failed = true;
+            continue;
+        }
+
+        Field_t field;
+        if (!sql->parse_column_definition(&sql->packet, field)) {
+            sql->error_message = "Column definition not valid";
+            failed = true;
+            continue;
+        }
+        fields->push_back(field);
+    }
+    return false;
+}
+
+/**
+ * @brief Execute statement with the bound parameters (COM_STMT_EXECUTE)
+ *
+ */
+bool PreparedStatement::execute(void)
+{
+    if (!this->prepared || sql->busy())
+        return false;
+
+    // Rows of previous execution must be consumed before sending a new command
+    while (this->pending)
+        this->next();
+
+    if (!this->send_execute()) {
+        MYSQL_STATS_DO(if (sql->mStatsActive) sql->stats_end(false));
+        return false;
+    }
+
+    bool ok = this->read_execute_response();
+
+    // Record of a result set ends with its last row, see drain()
+    MYSQL_STATS_DO(if (!this->pending) sql->stats_end(ok));
+    return ok;
+}
+
+/**
+ * @brief Read OK, ERR or the column definitions of a binary result set
+ *
+ */
+bool PreparedStatement::read_execute_response(void)
+{
+    if (!sql->recieve())
+        return false;
+
+    MySQL_Packet *packet = &sql->packet;
+    Packet_Type type = packet->getPacketType();
+    if (type == PACKET_ERR) {
+        sql->parse_error_packet(packet, packet->getPacketLength());
+        return false;
+    }
+    if (type != PACKET_TEXTRESULTSET) {
+        sql->parse_ok_packet(packet);
+        return true;
+    }
+
+    // Binary result set: column count, column definitions, EOF and then rows
+    if (!this->read_definitions(&this->fields))
+        return false;
+
+    Column_t *new_columns = (Column_t *)realloc(this->columns, (this->fields.size() + 1) * sizeof(Column_t));
+    if (new_columns == nullptr)
+        return false;
+    this->columns = new_columns;
+    this->pending = true;
+    sql->mStatement = this;
+    return true;
+}
+
+/**
+ * @brief Build and send COM_STMT_EXECUTE packet
+ *
+ * Packet layout :
+ * int<1>   command (0x17)
+ * int<4>   statement_id
+ * int<1>   flags (0x00: CURSOR_TYPE_NO_CURSOR)
+ * int<4>   iteration_count (always 1)
+ * if num_params > 0:
+ *   binary<var>    NULL bitmap, (num_params + 7) / 8 bytes
+ *   int<1>         new_params_bound_flag (always 1)
+ *   int<2>[]       type of each parameter (0x80 in high byte if unsigned)
+ *   binary<var>[]  value of each parameter not NULL
+ *
+ * Source : https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_com_stmt_execute.html
+ */
+bool PreparedStatement::send_execute(void)
+{
+    size_t bitmap_len = (this->paramCount + 7) / 8;
+    size_t payload_len = 10;
+    if (this->paramCount) {
+        payload_len += bitmap_len + 1 + this->paramCount * 2;
+        for (uint16_t i = 0; i < this->paramCount; i++)
+            payload_len += this->param_length(&this->params[i]);
+    }
+    if (payload_len >= MAX_PACKET_PAYLOAD)
+        return false;
+
+    // Results of previous query not read yet, then buffer is shared with recieved packets
+    sql->drain_results();
+    sql->clear_status();
+    sql->rx_reset();
+    if (!this->readOnly && sql->mCache != nullptr)
+        sql->mCache->invalidate();
+    MYSQL_STATS_DO(sql->stats_begin());
+
+    uint8_t header[10] = {COM_STMT_EXECUTE, 0, 0, 0, 0, 0x00, 1, 0, 0, 0};
+    store_uint(header + 1, this->id, 4);
+    if (!sql->tx_packet(payload_len, 0) || !sql->tx_append(header, sizeof(header)))
+        return false;
+
+    if (this->paramCount) {
+        for (size_t i = 0; i < bitmap_len; i++) {
+            uint8_t bitmap = 0;
+            for (uint8_t bit = 0; bit < 8 && i * 8 + bit < this->paramCount; bit++) {
+                if (this->params[i * 8 + bit].isNull)
+                    bitmap |= (1 << bit);
+            }
+            sql->tx_append(&bitmap, 1);
+        }
+
+        uint8_t bound = 1;
+        sql->tx_append(&bound, 1);
+
+        for (uint16_t i = 0; i < this->paramCount; i++) {
+            uint8_t type[2] = {this->params[i].type, (uint8_t)(this->params[i].isUnsigned ? 0x80 : 0x00)};
+            sql->tx_append(type, 2);
+        }
+
+        for (uint16_t i = 0; i < this->paramCount; i++) {
+            const Param_t *p = &this->params[i];
+            if (p->isNull)
+                continue;
+
+            uint8_t value[9];
+            switch (p->type) {
+                case MYSQL_TYPE_TINY:
+                case MYSQL_TYPE_SHORT:
+                case MYSQL_TYPE_LONG:
+                case MYSQL_TYPE_LONGLONG:
+                    store_uint(value, p->value.u, p->length);
+                    sql->tx_append(value, p->length);
+                    break;
+                case MYSQL_TYPE_FLOAT:
+                    sql->tx_append(&p->value.f, 4);
+                    break;
+                case MYSQL_TYPE_DOUBLE:
+                    sql->tx_append(&p->value.d, 8);
+                    break;
+                default: {
+                    int len = storeLenEncInt(value, p->length);
+                    sql->tx_append(value, len);
+                    if (!sql->tx_append(p->value.p, p->length))
+                        return false;
+                    break;
+                }
+            }
+        }
+    }
+    return sql->tx_flush();
+}
+
+/**
+ * @brief Number of bytes used by the parameter value in COM_STMT_EXECUTE
+ *
+ */
+size_t PreparedStatement::param_length(const Param_t *p)
+{
+    if (p->isNull)
+        return 0;
+
+    switch (p->type) {
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_LONGLONG:
+            return p->length;
+        case MYSQL_TYPE_FLOAT:
+            return 4;
+        case MYSQL_TYPE_DOUBLE:
+            return 8;
+        default:
+            uint8_t header[9];
+            return storeLenEncInt(header, p->length) + p->length;
+    }
+}
+
+/**
+ * @brief Read next row of result
+ *
+ */
+bool PreparedStatement::next(void)
+{
+    if (!this->pending)
+        return false;
+
+    if (!sql->recieve()) {
+        // A row larger than MYSQL_MAX_PACKET_SIZE was dropped: the rest of the result is dropped too
+        this->drain(sql->mRxSkipped, false);
+        return false;
+    }
+
+    MySQL_Packet *packet = &sql->packet;
+    uint8_t header = packet->mPayload[0];
+
+    if (header == 0xFE && packet->mPayloadLength < 9) {
+        sql->parse_eof_packet(packet);
+        this->drain(false, true);
+        return false;
+    }
+    if (header == 0xFF) {
+        sql->parse_error_packet(packet, packet->getPacketLength());
+        this->drain(false, false);
+        return false;
+    }
+    if (!this->parse_binary_row()) {
+        sql->error_message = "Row not valid";
+        this->drain(true, false);
+        return false;
+    }
+    MYSQL_STATS_DO(sql->mStats.rows++);
+    return true;
+}
+
+/**
+ * @brief Forget the rows of last execution
+ *
+ * @param read Read and drop the rows still on the wire, up to EOF or ERR
+ * @param success Result of the execution, for its statistics record
+ */
+void PreparedStatement::drain(bool read, bool success)
+{
+    (void)success;
+    MYSQL_STATS_DO(if (this->pending && sql->mStatsActive) sql->stats_end(success));
+
+    while (read && (sql->recieve() || sql->mRxSkipped)) {
+        if (sql->mRxSkipped)
+            continue;
+        uint8_t header = sql->packet.mPayload[0];
+        if ((header == 0xFE && sql->packet.mPayloadLength < 9) || header == 0xFF)
+            break;
+    }
+    this->pending = false;
+    if (sql->mStatement == this)
+        sql->mStatement = nullptr;
+}
+
+/**
+ * @brief Find the position of each value inside a binary row packet
+ *
+ * Row layout :
+ * int<1>       header (0x00)
+ * binary<var>  NULL bitmap, (column_count + 7 + 2) / 8 bytes (first 2 bits unused)
+ * binary<var>  value of each column not NULL
+ *
+ * Source : https://dev.mysql.com/doc/dev/mysql-server/latest/page_protocol_binary_resultset.html
+ */
+bool PreparedStatement::parse_binary_row(void)
+{
+    const uint8_t *payload = sql->packet.mPayload;
+    uint32_t payload_len = sql->packet.mPayloadLength;
+    uint16_t column_count = this->fields.size();
+    uint32_t offset = 1 + (column_count + 7 + 2) / 8;
+    if (offset > payload_len)
+        return false;
+
+    for (uint16_t col = 0; col < column_count; col++) {
+        uint16_t bit = col + 2;
+        Column_t *column = &this->columns[col];
+        column->null = payload[1 + bit / 8] & (1 << (bit % 8));
+        column->offset = offset;
+        column->length = 0;
+        if (column->null)
+            continue;
+
+        if (offset >= payload_len)
+            return false;
+
+        switch (this->fields.at(col).type) {
+            case MYSQL_TYPE_NULL:
+                break;
+            case MYSQL_TYPE_TINY:
+                column->length = 1;
+                break;
+            case MYSQL_TYPE_SHORT:
+            case MYSQL_TYPE_YEAR:
+                column->length = 2;
+                break;
+            case MYSQL_TYPE_LONG:
+            case MYSQL_TYPE_INT24:
+            case MYSQL_TYPE_FLOAT:
+                column->length = 4;
+                break;
+            case MYSQL_TYPE_LONGLONG:
+            case MYSQL_TYPE_DOUBLE:
+                column->length = 8;
+                break;
+            case MYSQL_TYPE_DATE:
+            case MYSQL_TYPE_DATETIME:
+            case MYSQL_TYPE_TIMESTAMP:
+            case MYSQL_TYPE_TIME:
+                // One byte with the length of the value
+                column->length = payload[offset];
+                column->offset = ++offset;
+                break;
+            default: {
+                uint8_t header_size;
+                uint64_t str_len = readLenEncInt(payload, offset, &header_size);
+                offset += header_size;
+                if (offset > payload_len || str_len > payload_len - offset)
+                    return false;
+                column->length = str_len;
+                column->offset = offset;
+                break;
+            }
+        }
+        if (column->length > payload_len - offset)
+            return false;
+        offset += column->length;
+    }
+    return true;
+}
+
+/**
+ * @brief Release the statement on server (COM_STMT_CLOSE, no response)
+ *
+ */
+bool PreparedStatement::close(void)
+{
+    if (sql->busy())
+        return false;
+
+    while (this->pending)
+        this->next();
+
+    if (!this->prepared)
+        return true;
+
+    this->prepared = false;
+    this->paramCount = 0;
+    this->fields.clear();
+
+    // Server does not reply
+    uint8_t statement_id[4];
+    store_uint(statement_id, this->id, 4);
+    bool ret = sql->send_command(COM_STMT_CLOSE, statement_id, 4);
+    MYSQL_STATS_DO(if (ret) sql->stats_end(true));
+    return ret;
+}
+
+
+PreparedStatement::Param_t* PreparedStatement::param(uint16_t index)
+{
+    if (index >= this->paramCount)
+        return nullptr;
+    return &this->params[index];
+}
+
+bool PreparedStatement::bindNull(uint16_t index)
+{
+    Param_t *p = this->param(index);
+    if (p == nullptr)
+        return false;
+    p->type = MYSQL_TYPE_NULL;
+    p->isUnsigned = false;
+    p->isNull = true;
+    p->length = 0;
+    return true;
+}
+
+bool PreparedStatement::bindInt(uint16_t index, int64_t value)
+{
+    Param_t *p = this->param(index);
+    if (p == nullptr)
+        return false;
+
+    // Use the smallest integer type able to hold the value
+    if (value >= -128 && value <= 127) {
+        p->type = MYSQL_TYPE_TINY;
+        p->length = 1;
+    }
+    else if (value >= -32768 && value <= 32767) {
+        p->type = MYSQL_TYPE_SHORT;
+        p->length = 2;
+    }
+    else if (value >= -2147483647LL - 1 && value <= 2147483647LL) {
+        p->type = MYSQL_TYPE_LONG;
+        p->length = 4;
+    }
+    else {
+        p->type = MYSQL_TYPE_LONGLONG;
+        p->length = 8;
+    }
+    p->isUnsigned = false;
+    p->isNull = false;
+    p->value.i = value;
+    return true;
+}
+
+bool PreparedStatement::bindUnsigned(uint16_t index, uint64_t value)
+{
+    Param_t *p = this->param(index);
+    if (p == nullptr)
+        return false;
+
+    if (value <= 0xFF) {
+        p->type = MYSQL_TYPE_TINY;
+        p->length = 1;
+    }
+    else if (value <= 0xFFFF) {
+        p->type = MYSQL_TYPE_SHORT;
+        p->length = 2;
+    }
+    else if (value <= 0xFFFFFFFFULL) {
+        p->type = MYSQL_TYPE_LONG;
+        p->length = 4;
+    }
+    else {
+        p->type = MYSQL_TYPE_LONGLONG;
+        p->length = 8;
+    }
+    p->isUnsigned = true;
+    p->isNull = false;
+    p->value.u = value;
+    return true;
+}
+
+bool PreparedStatement::bindFloat(uint16_t index, float value)
+{
+    Param_t *p = this->param(index);
+    if (p == nullptr)
+        return false;
+    p->type = MYSQL_TYPE_FLOAT;
+    p->isUnsigned = false;
+    p->isNull = false;
+    p->length = 4;
+    p->value.f = value;
+    return true;
+}
+
+bool PreparedStatement::bindDouble(uint16_t index, double value)
+{
+    // double is a 32 bit float on some platforms (AVR)
+    if (sizeof(double) != 8)
+        return this->bindFloat(index, value);
+
+    Param_t *p = this->param(index);
+    if (p == nullptr)
+        return false;
+    p->type = MYSQL_TYPE_DOUBLE;
+    p->isUnsigned = false;
+    p->isNull = false;
+    p->length = 8;
+    p->value.d = value;
+    return true;
+}
+
+bool PreparedStatement::bindString(uint16_t index, const char *value)
+{
+    if (value == nullptr)
+        return this->bindNull(index);
+
+    if (!this->bindBlob(index, (const uint8_t *)value, strlen(value)))
+        return false;
+    this->params[index].type = MYSQL_TYPE_VAR_STRING;
+    return true;
+}
+
+bool PreparedStatement::bindBlob(uint16_t index, const uint8_t *value, size_t len)
+{
+    Param_t *p = this->param(index);
+    if (p == nullptr)
+        return false;
+    p->type = MYSQL_TYPE_BLOB;
+    p->isUnsigned = false;
+    p->isNull = false;
+    p->length = len;
+    p->value.p = value;
+    return true;
+}
+
+
+bool PreparedStatement::column_ready(int col)
+{
+    return this->pending && col >= 0 && col < (int)this->fields.size();
+}
+
+bool PreparedStatement::isNull(int col)
+{
+    if (!this->column_ready(col))
+        return true;
+    return this->columns[col].null;
+}
+
+const char* PreparedStatement::getValue(int col)
+{
+    if (this->isNull(col))
+        return nullptr;
+    return (const char *)(sql->packet.mPayload + this->columns[col].offset);
+}
+
+uint32_t PreparedStatement::getLength(int col)
+{
+    if (this->isNull(col))
+        return 0;
+    return this->columns[col].length;
+}
+
+size_t PreparedStatement::copyValue(int col, char *dest, size_t size)
+{
+    if (size == 0)
+        return 0;
+    const char *value = this->getValue(col);
+    size_t len = value ? this->getLength(col) : 0;
+    if (len > size - 1)
+        len = size - 1;
+    if (len)
+        memcpy(dest, value, len);
+    dest[len] = '\0';
+    return len;
+}
+
+int64_t PreparedStatement::getInt(int col)
+{
+    const uint8_t *value = (const uint8_t *)this->getValue(col);
+    if (value == nullptr)
+        return 0;
+
+    bool is_unsigned = this->fields.at(col).flags & UNSIGNED_FLAG;
+    switch (this->fields.at(col).type) {
+        case MYSQL_TYPE_TINY:
+            return is_unsigned ? (int64_t)value[0] : (int64_t)(int8_t)value[0];
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_YEAR:
+            return is_unsigned ? (int64_t)read_uint(value, 2) : (int64_t)(int16_t)read_uint(value, 2);
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_INT24:
+            return is_unsigned ? (int64_t)read_uint(value, 4) : (int64_t)(int32_t)read_uint(value, 4);
+        case MYSQL_TYPE_LONGLONG:
+            return (int64_t)read_uint(value, 8);
+        case MYSQL_TYPE_FLOAT:
+        case MYSQL_TYPE_DOUBLE:
+            return (int64_t)this->getDouble(col);
+        case MYSQL_TYPE_DATE:
+        case MYSQL_TYPE_DATETIME:
+        case MYSQL_TYPE_TIMESTAMP:
+        case MYSQL_TYPE_TIME:
+            // Binary date and time fields, not a number
+            return 0;
+        default:
+            // Decimal and strings are sent as text
+            return readTextInt((const char *)value, this->getLength(col));
+    }
+}
+
+double PreparedStatement::getDouble(int col)
+{
+    const uint8_t *value = (const uint8_t *)this->getValue(col);
+    if (value == nullptr)
+        return 0;
+
+    switch (this->fields.at(col).type) {
+        case MYSQL_TYPE_FLOAT: {
+            float f;
+            memcpy(&f, value, 4);
+            return f;
+        }
+        case MYSQL_TYPE_DOUBLE:
+            return read_double(value);
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_YEAR:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_INT24:
+        case MYSQL_TYPE_LONGLONG:
+            return (double)this->getInt(col);
+        case MYSQL_TYPE_DATE:
+        case MYSQL_TYPE_DATETIME:
+        case MYSQL_TYPE_TIMESTAMP:
+        case MYSQL_TYPE_TIME:
+            return 0;
+        default: {
+            char buf[32];
+            this->copyValue(col, buf, sizeof(buf));
+            return strtod(buf, nullptr);
+        }
+    }
+}
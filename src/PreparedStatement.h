@@ -0,0 +1,162 @@
+/**
+ * @file PreparedStatement.h
+ * @brief Server-side prepared statements using MySQL binary protocol
+ */
+
+#ifndef PREPARED_STATEMENT_H
+#define PREPARED_STATEMENT_H
+
+#include <Arduino.h>
+#include "DataQuery.h"
+
+class MySQL;
+
+/**
+ * @brief Statement parsed once by the server and executed many times.
+ *
+ * Parameters are marked with '?' in the query and are bound with typed values:
+ * values travel in binary form, as do the values of result rows.
+ *
+ *   PreparedStatement stmt(&sql);
+ *   stmt.prepare("INSERT INTO t (gpio, state) VALUES (?, ?)");
+ *   stmt.bindInt(0, 4);
+ *   stmt.bindInt(1, HIGH);
+ *   stmt.execute();
+ */
+class PreparedStatement
+{
+public:
+    PreparedStatement(MySQL *pSQL) : sql(pSQL) {;}
+    ~PreparedStatement();
+
+    PreparedStatement(const PreparedStatement &) = delete;
+    PreparedStatement& operator=(const PreparedStatement &) = delete;
+
+    /**
+     * @brief Send query to server for parsing (COM_STMT_PREPARE)
+     *
+     * @param pQuery Query with '?' parameter markers
+     * @return true Statement ready
+     * @return false Error (see MySQL::getLastError())
+     */
+    bool prepare(const char *pQuery);
+
+    /**
+     * @brief Execute statement with the bound parameters (COM_STMT_EXECUTE)
+     *
+     * If the statement returns rows, they are read with next(): rows not
+     * read yet are dropped when another command is sent on the same connection.
+     * @return true Executed
+     * @return false Error (see MySQL::getLastError())
+     */
+    bool execute(void);
+
+    /**
+     * @brief Read next row of result
+     *
+     * @return true Row available
+     * @return false No more rows, or row not valid (rest of result is dropped)
+     */
+    bool next(void);
+
+    /**
+     * @brief Release the statement on server (COM_STMT_CLOSE)
+     *
+     */
+    bool close(void);
+
+    /**
+     * @brief Bind parameter values, index starts from 0.
+     *
+     * Strings and blobs are not copied: they must stay valid until execute().
+     * Unbound parameters are sent as NULL.
+     */
+    bool bindNull(uint16_t index);
+    bool bindInt(uint16_t index, int64_t value);
+    bool bindUnsigned(uint16_t index, uint64_t value);
+    bool bindFloat(uint16_t index, float value);
+    bool bindDouble(uint16_t index, double value);
+    bool bindString(uint16_t index, const char *value);
+    bool bindBlob(uint16_t index, const uint8_t *value, size_t len);
+
+    /**
+     * @brief Values of current row, col starts from 0.
+     *
+     * Numeric columns are decoded from their binary form, string values are
+     * not null-terminated and valid only until next call to next().
+     * Date and time columns are left in binary form (length byte not included):
+     * getInt() and getDouble() return 0 for them, read bytes with getValue().
+     */
+    bool isNull(int col);
+    int64_t getInt(int col);
+    double getDouble(int col);
+    float getFloat(int col) {
+        return (float)getDouble(col);
+    }
+    const char* getValue(int col);
+    uint32_t getLength(int col);
+    size_t copyValue(int col, char *dest, size_t size);
+
+    uint16_t getParamCount() {
+        return paramCount;
+    }
+
+    uint16_t getFieldCount() {
+        return fields.size();
+    }
+
+    const char* getFieldName(int col) {
+        if (col < 0 || col >= (int)fields.size())
+            return nullptr;
+        return fields.at(col).name.c_str();
+    }
+
+    FieldList* getFields() {return &fields;}
+
+private:
+    friend class MySQL;
+
+    typedef struct {
+        uint8_t type;
+        bool isUnsigned;
+        bool isNull;
+        size_t length;
+        union {
+            int64_t i;
+            uint64_t u;
+            float f;
+            double d;
+            const uint8_t *p;
+        } value;
+    } Param_t;
+
+    MySQL *sql = nullptr;
+
+    // Statement ID assigned by server
+    uint32_t id = 0;
+    bool prepared = false;
+
+    // Statement only reads data, executing it keeps cached results
+    bool readOnly = false;
+
+    // Rows of last execution still to be read
+    bool pending = false;
+
+    uint16_t paramCount = 0;
+    Param_t *params = nullptr;
+
+    FieldList fields;
+    Column_t *columns = nullptr;
+
+    Param_t* param(uint16_t index);
+    size_t param_length(const Param_t *p);
+    bool send_execute(void);
+    bool read_definitions(FieldList *fields);
+    bool parse_binary_row(void);
+    void drain(bool read, bool success);
+    bool read_prepare_response(void);
+    bool read_execute_response(void);
+    bool column_ready(int col);
+};
+
+#endif
@@ -0,0 +1,262 @@
+#include "QueryCache.h"
+#include "SQLVarTypes.h"
+
+// Bytes used to store a field besides its name (size, type, flags, decimals)
+#define FIELD_INFO_SIZE 8
+
+
+QueryCache::~QueryCache()
+{
+    this->invalidate();
+    free(mPending);
+}
+
+
+void QueryCache::invalidate(void)
+{
+    while (mHead != nullptr)
+        this->remove(&mHead);
+}
+
+
+static bool is_word_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static bool match_keyword(const char *sql, size_t len, const char *keyword)
+{
+    size_t i = 0;
+    for (; keyword[i]; i++) {
+        if (i >= len || toupper((unsigned char)sql[i]) != keyword[i])
+            return false;
+    }
+    return i == len || !is_word_char(sql[i]);
+}
+
+// Words of reads that lock rows or have side effects: FOR UPDATE, FOR SHARE,
+// LOCK IN SHARE MODE, SELECT ... INTO and user-level locks
+static const char *const SIDE_EFFECTS[] = {"UPDATE", "SHARE", "INTO", "GET_LOCK", "RELEASE_LOCK", "RELEASE_ALL_LOCKS"};
+
+bool QueryCache::isReadOnly(const char *sql, size_t len)
+{
+    size_t i = 0;
+    while (i < len && (isspace((unsigned char)sql[i]) || sql[i] == '('))
+        i++;
+
+    static const char *const reads[] = {"SELECT", "SHOW", "DESCRIBE", "DESC", "EXPLAIN"};
+    bool read = false;
+    for (const char *keyword : reads)
+        read = read || match_keyword(sql + i, len - i, keyword);
+    if (!read)
+        return false;
+
+    // Quoted text is skipped, a matching word in the rest of the statement is enough
+    while (i < len) {
+        char c = sql[i];
+        if (c == '\'' || c == '"' || c == '`') {
+            for (i++; i < len && sql[i] != c; i++) {
+                if (sql[i] == '\\' && c != '`')
+                    i++;
+            }
+            i++;
+        }
+        else if (c == ';') {
+            // Anything else than spaces starts another statement
+            while (++i < len && isspace((unsigned char)sql[i])) {;}
+            if (i < len)
+                return false;
+        }
+        else if (is_word_char(c)) {
+            size_t word = i;
+            while (i < len && is_word_char(sql[i]))
+                i++;
+            for (const char *keyword : SIDE_EFFECTS) {
+                if (match_keyword(sql + word, i - word, keyword))
+                    return false;
+            }
+        }
+        else {
+            i++;
+        }
+    }
+    return true;
+}
+
+
+bool QueryCache::expired(const CacheEntry_t *entry) const
+{
+    return mTTL != 0 && millis() - entry->stored >= mTTL;
+}
+
+/**
+ * @brief Unlink and free the entry pointed by *link
+ *
+ */
+void QueryCache::remove(CacheEntry_t **link)
+{
+    CacheEntry_t *entry = *link;
+    *link = entry->next;
+    mUsed -= entry->size;
+    mCount--;
+    free(entry);
+}
+
+
+/**
+ * @brief Copy a valid result for query into data
+ *
+ * On a miss the query is kept (if read-only), so that store() can save
+ * its result once recieved.
+ *
+ * @return true data is the cached result, nothing must be sent
+ */
+bool QueryCache::lookup(DataQuery_t &data, const char *sql, size_t len)
+{
+    free(mPending);
+    mPending = nullptr;
+
+    if (!isReadOnly(sql, len))
+        return false;
+
+    uint32_t hash = hashString(sql, len);
+    for (CacheEntry_t **link = &mHead; *link != nullptr; ) {
+        CacheEntry_t *entry = *link;
+        if (this->expired(entry)) {
+            this->remove(link);
+            continue;
+        }
+
+        if (entry->hash == hash && entry->sqlLength == len && memcmp(entry + 1, sql, len) == 0) {
+            // Move to front, it's now the most recently used
+            *link = entry->next;
+            entry->next = mHead;
+            mHead = entry;
+            if (this->restore(entry, data)) {
+                mHits++;
+                return true;
+            }
+
+            // Does not fit in data (static storage), the query is sent again
+            this->remove(&mHead);
+            break;
+        }
+        link = &entry->next;
+    }
+
+    mMisses++;
+    mPending = (char *)malloc(len);
+    if (mPending != nullptr) {
+        memcpy(mPending, sql, len);
+        mPendingLength = len;
+        mPendingHash = hash;
+    }
+    return false;
+}
+
+
+/**
+ * @brief Save the result of the query of last miss
+ *
+ * @param data Result, nullptr if the query failed
+ */
+void QueryCache::store(const DataQuery_t *data)
+{
+    char *sql = mPending;
+    mPending = nullptr;
+    if (sql == nullptr || data == nullptr) {
+        free(sql);
+        return;
+    }
+
+    uint32_t fields_size = 0;
+    for (const Field_t &field : data->fields)
+        fields_size += field.name.length() + 1 + FIELD_INFO_SIZE;
+
+    uint32_t size = sizeof(CacheEntry_t) + mPendingLength + fields_size
+                    + data->cellsUsed * sizeof(Cell_t) + data->bufferUsed;
+    if (size > mBudget) {
+        free(sql);
+        return;
+    }
+
+    // Drop least recently used results until there is room
+    while (mUsed + size > mBudget) {
+        CacheEntry_t **link = &mHead;
+        while ((*link)->next != nullptr)
+            link = &(*link)->next;
+        this->remove(link);
+    }
+
+    CacheEntry_t *entry = (CacheEntry_t *)malloc(size);
+    if (entry == nullptr) {
+        free(sql);
+        return;
+    }
+
+    entry->hash = mPendingHash;
+    entry->stored = millis();
+    entry->size = size;
+    entry->sqlLength = mPendingLength;
+    entry->bufferUsed = data->bufferUsed;
+    entry->cellsUsed = data->cellsUsed;
+    entry->fieldCount = data->fieldCount;
+    entry->recordCount = data->recordCount;
+
+    uint8_t *p = (uint8_t *)(entry + 1);
+    memcpy(p, sql, mPendingLength);
+    p += mPendingLength;
+    free(sql);
+
+    for (const Field_t &field : data->fields) {
+        memcpy(p, field.name.c_str(), field.name.length() + 1);
+        p += field.name.length() + 1;
+        memcpy(p, &field.size, 4);
+        p[4] = field.type;
+        memcpy(p + 5, &field.flags, 2);
+        p[7] = field.decimals;
+        p += FIELD_INFO_SIZE;
+    }
+    if (data->cellsUsed)
+        memcpy(p, data->cells, data->cellsUsed * sizeof(Cell_t));
+    p += data->cellsUsed * sizeof(Cell_t);
+    if (data->bufferUsed)
+        memcpy(p, data->buffer, data->bufferUsed);
+
+    entry->next = mHead;
+    mHead = entry;
+    mUsed += size;
+    mCount++;
+}
+
+
+bool QueryCache::restore(const CacheEntry_t *entry, DataQuery_t &data)
+{
+    data.clear();
+    if (!data.growBuffer(entry->bufferUsed) || !data.growCells(entry->cellsUsed))
+        return false;
+
+    const uint8_t *p = (const uint8_t *)(entry + 1) + entry->sqlLength;
+    for (uint16_t col = 0; col < entry->fieldCount; col++) {
+        Field_t field;
+        field.name = (const char *)p;
+        p += strlen((const char *)p) + 1;
+        memcpy(&field.size, p, 4);
+        field.type = p[4];
+        memcpy(&field.flags, p + 5, 2);
+        field.decimals = p[7];
+        p += FIELD_INFO_SIZE;
+        data.fields.push_back(field);
+    }
+    if (entry->cellsUsed)
+        memcpy(data.cells, p, entry->cellsUsed * sizeof(Cell_t));
+    p += entry->cellsUsed * sizeof(Cell_t);
+    if (entry->bufferUsed)
+        memcpy(data.buffer, p, entry->bufferUsed);
+
+    data.bufferUsed = entry->bufferUsed;
+    data.cellsUsed = entry->cellsUsed;
+    data.fieldCount = entry->fieldCount;
+    data.recordCount = entry->recordCount;
+    return true;
+}
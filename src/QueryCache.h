@@ -0,0 +1,115 @@
+/**
+ * @file QueryCache.h
+ * @brief Client-side cache of read-only query results
+ */
+
+#ifndef QUERY_CACHE_H
+#define QUERY_CACHE_H
+
+#include <Arduino.h>
+#include "DataQuery.h"
+
+class MySQL;
+
+/**
+ * @brief Results of read-only queries kept for a while, keyed by the query text.
+ *
+ * When the same SELECT is run again before ttl milliseconds, the result is
+ * copied from the cache and nothing is sent to the server. Each result is
+ * stored in a single block (query text, fields and values), the least
+ * recently used ones are dropped when the byte budget is exceeded.
+ *
+ * Any statement that is not a read (INSERT, UPDATE, USE, ...) sent on the
+ * same connection drops all results; changes made by other clients are
+ * seen only when results expire.
+ *
+ *   QueryCache cache(4096, 30000);    // 4KB, results valid for 30s
+ *   sql.setQueryCache(&cache);
+ *   sql.query(data, "SELECT * FROM config");
+ */
+class QueryCache
+{
+public:
+    /**
+     * @param budget Max bytes used by results
+     * @param ttl Time a result is valid (ms), 0 to keep results until invalidated
+     */
+    QueryCache(uint32_t budget, uint32_t ttl = 10000) : mBudget(budget), mTTL(ttl) {;}
+    ~QueryCache();
+
+    QueryCache(const QueryCache &) = delete;
+    QueryCache& operator=(const QueryCache &) = delete;
+
+    void setTTL(uint32_t ttl) {
+        mTTL = ttl;
+    }
+
+    /**
+     * @brief Drop all results, e.g. when tables are changed in other ways
+     *
+     */
+    void invalidate(void);
+
+    // Bytes used and number of results stored
+    uint32_t used() const {
+        return mUsed;
+    }
+    uint16_t count() const {
+        return mCount;
+    }
+
+    // Queries served from cache, and read-only queries sent to server
+    uint32_t hits() const {
+        return mHits;
+    }
+    uint32_t misses() const {
+        return mMisses;
+    }
+
+    /**
+     * @brief Check if a statement only reads data (SELECT, SHOW, DESCRIBE, EXPLAIN)
+     *
+     * Multiple statements are never considered read-only, nor reads that lock
+     * rows or have side effects (FOR UPDATE, LOCK IN SHARE MODE, INTO, GET_LOCK()).
+     */
+    static bool isReadOnly(const char *sql, size_t len);
+
+private:
+    friend class MySQL;
+
+    // Stored result, followed by query text, fields, cells and values
+    typedef struct CacheEntry_t {
+        struct CacheEntry_t *next;
+        uint32_t hash;
+        uint32_t stored;
+        uint32_t size;
+        uint32_t sqlLength;
+        uint32_t bufferUsed;
+        uint32_t cellsUsed;
+        uint32_t recordCount;
+        uint16_t fieldCount;
+    } CacheEntry_t;
+
+    uint32_t mBudget;
+    uint32_t mTTL;
+    uint32_t mUsed = 0;
+    uint16_t mCount = 0;
+    uint32_t mHits = 0;
+    uint32_t mMisses = 0;
+
+    // Most recently used first
+    CacheEntry_t *mHead = nullptr;
+
+    // Query of last miss, stored by store() when its result is complete
+    char *mPending = nullptr;
+    uint32_t mPendingLength = 0;
+    uint32_t mPendingHash = 0;
+
+    bool lookup(DataQuery_t &data, const char *sql, size_t len);
+    void store(const DataQuery_t *data);
+    bool expired(const CacheEntry_t *entry) const;
+    void remove(CacheEntry_t **link);
+    bool restore(const CacheEntry_t *entry, DataQuery_t &data);
+};
+
+#endif
@@ -118,6 +118,71 @@ int SHA1Result(SHA1Context *context)
     return 1;
 }
 
+/*
+ *  SHA1ResultBytes
+ *
+ *  Description:
+ *      Same as SHA1Result, then the digest is copied into digest as
+ *      20 bytes, most significant byte of each word first.
+ *
+ *  Parameters:
+ *      context: [in/out]
+ *          The context to use to calculate the SHA-1 hash.
+ *      digest: [out]
+ *          Array of 20 bytes where the digest is stored.
+ *
+ *  Returns:
+ *      1 if successful, 0 if it failed.
+ *
+ *  Comments:
+ *
+ */
+int SHA1ResultBytes(SHA1Context *context, unsigned char *digest)
+{
+    int i;
+
+    if (!SHA1Result(context))
+    {
+        return 0;
+    }
+
+    for(i = 0; i < 20; i++)
+    {
+        digest[i] = (context->Message_Digest[i >> 2] >> (24 - 8 * (i & 3))) & 0xFF;
+    }
+
+    return 1;
+}
+
+/*
+ *  SHA1Digest
+ *
+ *  Description:
+ *      This function computes the digest of a whole message in one call.
+ *
+ *  Parameters:
+ *      message_array: [in]
+ *          The message to hash.
+ *      length: [in]
+ *          The length of the message in message_array
+ *      digest: [out]
+ *          Array of 20 bytes where the digest is stored.
+ *
+ *  Returns:
+ *      1 if successful, 0 if it failed.
+ *
+ *  Comments:
+ *
+ */
+int SHA1Digest(const unsigned char *message_array, unsigned length, unsigned char *digest)
+{
+    SHA1Context context;
+
+    SHA1Reset(&context);
+    SHA1Input(&context, message_array, length);
+    return SHA1ResultBytes(&context, digest);
+}
+
 /*
  *  SHA1Input
  *
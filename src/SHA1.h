@@ -49,5 +49,7 @@ typedef struct SHA1Context
 void SHA1Reset(SHA1Context *);
 int SHA1Result(SHA1Context *);
 void SHA1Input( SHA1Context *, const unsigned char *, unsigned);
+int SHA1ResultBytes(SHA1Context *, unsigned char *);
+int SHA1Digest(const unsigned char *, unsigned, unsigned char *);
 
 #endif
@@ -0,0 +1,137 @@
+#include "SHA256.h"
+#include <string.h>
+
+// Round constants, first 32 bits of the fractional parts of the cube roots of the first 64 primes
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+
+/**
+ * @brief Process the 64 bytes in Message_Block
+ *
+ * The message schedule is kept in a 16 words circular buffer, so the
+ * stack used is 64 bytes and not 256 (it matters on AVR).
+ */
+static void SHA256ProcessMessageBlock(SHA256Context *context)
+{
+    uint32_t w[16];
+    uint32_t a, b, c, d, e, f, g, h;
+    uint8_t t;
+
+    for (t = 0; t < 16; t++) {
+        const uint8_t *p = context->Message_Block + t * 4;
+        w[t] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    a = context->State[0];
+    b = context->State[1];
+    c = context->State[2];
+    d = context->State[3];
+    e = context->State[4];
+    f = context->State[5];
+    g = context->State[6];
+    h = context->State[7];
+
+    for (t = 0; t < 64; t++) {
+        if (t >= 16) {
+            uint32_t w15 = w[(t - 15) & 15];
+            uint32_t w2 = w[(t - 2) & 15];
+            uint32_t s0 = ROTR(w15, 7) ^ ROTR(w15, 18) ^ (w15 >> 3);
+            uint32_t s1 = ROTR(w2, 17) ^ ROTR(w2, 19) ^ (w2 >> 10);
+            w[t & 15] += s0 + w[(t - 7) & 15] + s1;
+        }
+
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[t] + w[t & 15];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    context->State[0] += a;
+    context->State[1] += b;
+    context->State[2] += c;
+    context->State[3] += d;
+    context->State[4] += e;
+    context->State[5] += f;
+    context->State[6] += g;
+    context->State[7] += h;
+    context->Message_Block_Index = 0;
+}
+
+
+void SHA256Reset(SHA256Context *context)
+{
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(context->State, init, sizeof(init));
+    context->Length = 0;
+    context->Message_Block_Index = 0;
+}
+
+
+void SHA256Input(SHA256Context *context, const uint8_t *message_array, uint32_t length)
+{
+    context->Length += length;
+    while (length) {
+        uint8_t room = 64 - context->Message_Block_Index;
+        uint8_t len = (length < room) ? length : room;
+        memcpy(context->Message_Block + context->Message_Block_Index, message_array, len);
+        context->Message_Block_Index += len;
+        message_array += len;
+        length -= len;
+        if (context->Message_Block_Index == 64)
+            SHA256ProcessMessageBlock(context);
+    }
+}
+
+
+/**
+ * @brief Pad the message, then store the 32 bytes digest (big-endian words)
+ *
+ * The context must be reset before being used again.
+ */
+void SHA256ResultBytes(SHA256Context *context, uint8_t *digest)
+{
+    uint64_t bits = context->Length * 8;
+    uint8_t i = context->Message_Block_Index;
+
+    context->Message_Block[i++] = 0x80;
+    if (i > 56) {
+        memset(context->Message_Block + i, 0, 64 - i);
+        SHA256ProcessMessageBlock(context);
+        i = 0;
+    }
+    memset(context->Message_Block + i, 0, 56 - i);
+    for (i = 0; i < 8; i++)
+        context->Message_Block[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+    SHA256ProcessMessageBlock(context);
+
+    for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+        digest[i] = (uint8_t)(context->State[i >> 2] >> (24 - 8 * (i & 3)));
+}
+
+
+void SHA256Digest(const uint8_t *message_array, uint32_t length, uint8_t *digest)
+{
+    SHA256Context context;
+    SHA256Reset(&context);
+    SHA256Input(&context, message_array, length);
+    SHA256ResultBytes(&context, digest);
+}
@@ -0,0 +1,29 @@
+/**
+ * @file SHA256.h
+ * @brief SHA-256 (FIPS 180-4), used by caching_sha2_password authentication
+ *
+ * Same usage of SHA1.h: SHA256Reset(), SHA256Input() one or more times and
+ * SHA256ResultBytes(), or SHA256Digest() for a message in a single buffer.
+ */
+
+#ifndef _SHA256_H_
+#define _SHA256_H_
+
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+typedef struct SHA256Context
+{
+    uint32_t State[8];              /* Intermediate hash              */
+    uint64_t Length;                /* Message length in bytes        */
+    uint8_t  Message_Block[64];     /* 512-bit message block          */
+    uint8_t  Message_Block_Index;   /* Index into message block array */
+} SHA256Context;
+
+void SHA256Reset(SHA256Context *);
+void SHA256Input(SHA256Context *, const uint8_t *, uint32_t);
+void SHA256ResultBytes(SHA256Context *, uint8_t *);
+void SHA256Digest(const uint8_t *, uint32_t, uint8_t *);
+
+#endif
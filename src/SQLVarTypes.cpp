@@ -13,60 +13,82 @@ uint32_t readFixedLengthInt(const uint8_t *packet, int offset, int size)
   uint32_t value = 0;
 
   for (int i = 0; i < size; i++) {
-    value |= *(packet + offset + i) << (i * 8);
+    value |= (uint32_t)*(packet + offset + i) << (i * 8);
   }
 
   return value;
 }
 
+// Bytes following the first byte of a Length Encoded Int, for first byte 0xFB to 0xFF
+static const uint8_t LENENC_WIDTH[5] = {0, 2, 3, 8, 0};
+
 /**
  * @brief Read Length Encoded Int from MySQL Packet
  *
+ * Values up to 250 are stored in a single byte, the common case takes one branch.
+ *
  * @param packet Pointer to first byte of MySQL Packet
  * @param offset Offset from start pointer to read
- * @return uint32_t Unsigned 32 bits integer value
+ * @param size If not null, set to the number of bytes used by the encoded value
+ * @return uint64_t Unsigned 64 bits integer value or LENENC_NULL for NULL marker
  */
-uint32_t readLenEncInt(const uint8_t *packet, int offset)
+uint64_t readLenEncInt(const uint8_t *packet, int offset, uint8_t *size)
 {
-  uint32_t value = 0;
+  const uint8_t *data = packet + offset;
+  uint8_t header = data[0];
 
-  if (packet[offset] < 251)
-    value = packet[offset];
-  else if (packet[offset] == 0xFC) {
-    for (int i = 0; i < 2; i++)
-      value |= packet[i + 1 + offset] << (i * 8);
-  }
-  else if (packet[offset] == 0xFD) {
-    for (int i = 0; i < 3; i++)
-      value |= packet[i + 1 + offset] << (i * 8);
-  }
-  else if (packet[offset] == 0xFE) {
-    for (int i = 0; i < 8; i++)
-      value |= packet[i + 1 + offset] << (i * 8);
+  if (header < 0xFB) {
+    if (size)
+      *size = 1;
+    return header;
   }
+
+  uint8_t width = LENENC_WIDTH[header - 0xFB];
+  if (size)
+    *size = 1 + width;
+  if (header == 0xFB)
+    return LENENC_NULL;
+
+  uint64_t value = 0;
+  for (uint8_t i = width; i > 0; i--)
+    value = (value << 8) | data[i];
   return value;
 }
 
+/**
+ * @brief Number of bytes used by a Length Encoded String (length + text)
+ *
+ * @param packet Pointer to first byte of MySQL Packet
+ * @param offset Offset from start pointer to read
+ * @return uint32_t Bytes to skip to reach next value
+ */
+uint32_t skipLenEncString(const uint8_t *packet, int offset)
+{
+  uint8_t size;
+  uint64_t str_size = readLenEncInt(packet, offset, &size);
+  return (str_size == LENENC_NULL) ? size : size + (uint32_t)str_size;
+}
+
 /**
  * @brief Read Length Encoded String from MySQL Packet
  *
- * @param pString Pointer to string to fill
+ * @param pString Pointer to string to fill (NULL is read as empty string)
  * @param packet Pointer to first char of MySQL Packet
  * @param offset Offset from start pointer to read
+ * @param size If not null, set to the number of bytes used by the string length
+ * @return int Length of string
  */
-int readLenEncString(char *pString, const uint8_t *packet, int offset)
+int readLenEncString(char *pString, const uint8_t *packet, int offset, uint8_t *size)
 {
-  int str_size = readLenEncInt(packet, offset);
+  uint8_t header_size;
+  uint64_t str_size = readLenEncInt(packet, offset, &header_size);
+  if (size)
+    *size = header_size;
 
-  if (packet[offset] < 251)
-    memcpy(pString, packet + 1 + offset, str_size);
-  else if (packet[offset] == 0xFC)
-    memcpy(pString, packet + 3 + offset, str_size);
-  else if (packet[offset] == 0xFD)
-    memcpy(pString, packet + 4 + offset, str_size);
-  else if (packet[offset] == 0xFE)
-    memcpy(pString, packet + 9 + offset, str_size);
+  if (str_size == LENENC_NULL)
+    str_size = 0;
 
+  memcpy(pString, packet + offset + header_size, str_size);
   pString[str_size] = '\0';
   return str_size;
 }
@@ -100,3 +122,216 @@ void store_int(uint8_t *buff, long value, int size)
     buff[3] = (uint8_t)(value >> 24);
   }
 }
+
+/**
+ * @brief Store Length Encoded Int
+ *
+ * @param buff Destination, at least 9 bytes
+ * @param value Value to store
+ * @return int Number of bytes written
+ */
+int storeLenEncInt(uint8_t *buff, uint32_t value)
+{
+  if (value < 251) {
+    buff[0] = (uint8_t)value;
+    return 1;
+  }
+  if (value < 0x10000) {
+    buff[0] = 0xFC;
+    buff[1] = (uint8_t)value;
+    buff[2] = (uint8_t)(value >> 8);
+    return 3;
+  }
+  if (value < 0x1000000) {
+    buff[0] = 0xFD;
+    buff[1] = (uint8_t)value;
+    buff[2] = (uint8_t)(value >> 8);
+    buff[3] = (uint8_t)(value >> 16);
+    return 4;
+  }
+  buff[0] = 0xFE;
+  memset(buff + 1, 0, 8);
+  buff[1] = (uint8_t)value;
+  buff[2] = (uint8_t)(value >> 8);
+  buff[3] = (uint8_t)(value >> 16);
+  buff[4] = (uint8_t)(value >> 24);
+  return 9;
+}
+
+/**
+ * @brief Read an integer written as text (not null-terminated)
+ *
+ * @param text First char of the number
+ * @param len Number of chars
+ * @return int64_t Value, conversion stops at first char that is not a digit
+ */
+int64_t readTextInt(const char *text, uint32_t len)
+{
+  uint32_t i = 0;
+  bool negative = false;
+
+  if (len && (text[0] == '-' || text[0] == '+')) {
+    negative = (text[0] == '-');
+    i++;
+  }
+
+  uint64_t value = 0;
+  for (; i < len && text[i] >= '0' && text[i] <= '9'; i++)
+    value = value * 10 + (text[i] - '0');
+
+  return negative ? -(int64_t)value : (int64_t)value;
+}
+
+
+/**
+ * @brief FNV-1a hash of a string
+ *
+ * @param text Pointer to first char
+ * @param len Number of chars to hash
+ * @return uint32_t 32 bits hash value
+ */
+uint32_t hashString(const char *text, uint32_t len)
+{
+  uint32_t hash = 2166136261UL;
+  for (uint32_t i = 0; i < len; i++) {
+    hash ^= (uint8_t)text[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+
+// Escape sequence of chars that can't be sent as they are inside a quoted string, 0 if none
+static char escapeChar(char ch)
+{
+  switch (ch) {
+    case '\0':   return '0';
+    case '\n':   return 'n';
+    case '\r':   return 'r';
+    case '\\':   return '\\';
+    case '\'':   return '\'';
+    case '"':    return '"';
+    case '\x1A': return 'Z';
+    default:     return 0;
+  }
+}
+
+/**
+ * @brief Length of a string once escaped (quotes excluded)
+ *
+ * @param text Pointer to first char
+ * @param len Number of chars
+ * @return uint32_t Length of escaped string
+ */
+uint32_t escapedLength(const char *text, uint32_t len)
+{
+  uint32_t escaped = len;
+  for (uint32_t i = 0; i < len; i++) {
+    if (escapeChar(text[i]))
+      escaped++;
+  }
+  return escaped;
+}
+
+/**
+ * @brief Copy a string escaping special chars, as mysql_real_escape_string() does
+ *
+ * @param dest Destination, at least escapedLength() chars (not null-terminated)
+ * @param text Pointer to first char
+ * @param len Number of chars
+ * @return uint32_t Number of chars written
+ */
+uint32_t escapeString(char *dest, const char *text, uint32_t len)
+{
+  char *start = dest;
+  for (uint32_t i = 0; i < len; i++) {
+    char escaped = escapeChar(text[i]);
+    if (escaped) {
+      *dest++ = '\\';
+      *dest++ = escaped;
+    }
+    else {
+      *dest++ = text[i];
+    }
+  }
+  return dest - start;
+}
+
+/**
+ * @brief Write decimal text of an unsigned integer (64 bits printf is not available everywhere)
+ *
+ * @param buff Destination, at least NUMBER_TEXT_SIZE chars
+ * @param value Value to write
+ * @return int Number of chars written (null-terminator excluded)
+ */
+int formatUInt(char *buff, uint64_t value)
+{
+  char digits[20];
+  int count = 0;
+  do {
+    digits[count++] = '0' + (value % 10);
+    value /= 10;
+  } while (value);
+
+  for (int i = 0; i < count; i++)
+    buff[i] = digits[count - 1 - i];
+  buff[count] = '\0';
+  return count;
+}
+
+int formatInt(char *buff, int64_t value)
+{
+  if (value < 0) {
+    buff[0] = '-';
+    return 1 + formatUInt(buff + 1, (uint64_t)0 - (uint64_t)value);
+  }
+  return formatUInt(buff, value);
+}
+
+/**
+ * @brief Write decimal text of a floating point value
+ *
+ * @param buff Destination, at least NUMBER_TEXT_SIZE chars
+ * @param value Value to write
+ * @return int Number of chars written, 0 for NaN and infinite (not valid in SQL)
+ */
+int formatDouble(char *buff, double value)
+{
+  if (isnan(value) || isinf(value)) {
+    buff[0] = '\0';
+    return 0;
+  }
+#if defined(__AVR__)
+  // avr-libc printf has no floating point support. dtostrf() writes all integer
+  // digits (up to 39 for a float), so large and tiny values use the exponent form
+  double mag = fabs(value);
+  if (mag >= 1e9 || (mag != 0 && mag < 1e-4))
+    dtostre(value, buff, 6, 0);
+  else
+    dtostrf(value, 1, 6, buff);
+  return strlen(buff);
+#else
+  // Shortest form first, all digits only if needed to read back the same value
+  int len = snprintf(buff, NUMBER_TEXT_SIZE, "%.15g", value);
+  if (strtod(buff, nullptr) != value)
+    len = snprintf(buff, NUMBER_TEXT_SIZE, "%.17g", value);
+  return len;
+#endif
+}
+
+int formatFloat(char *buff, float value)
+{
+#if defined(__AVR__)
+  return formatDouble(buff, value);
+#else
+  if (isnan(value) || isinf(value)) {
+    buff[0] = '\0';
+    return 0;
+  }
+  // Digits of a float are enough, those of a double would show the rounding error
+  int len = snprintf(buff, NUMBER_TEXT_SIZE, "%.7g", value);
+  if (strtof(buff, nullptr) != value)
+    len = snprintf(buff, NUMBER_TEXT_SIZE, "%.9g", value);
+  return len;
+#endif
+}
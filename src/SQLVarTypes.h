@@ -3,10 +3,26 @@
 
 #include <Arduino.h>
 
+// Value returned by readLenEncInt() for the NULL marker (0xFB)
+#define LENENC_NULL 0xFFFFFFFFFFFFFFFFULL
+
 uint32_t readFixedLengthInt(const uint8_t * packet, int offset, int size);
-uint32_t readLenEncInt(const uint8_t * packet, int offset);
+uint64_t readLenEncInt(const uint8_t * packet, int offset, uint8_t *size = nullptr);
+uint32_t skipLenEncString(const uint8_t * packet, int offset);
 void store_int(uint8_t *buff, long value, int size);
+int storeLenEncInt(uint8_t *buff, uint32_t value);
+int64_t readTextInt(const char *text, uint32_t len);
+uint32_t hashString(const char *text, uint32_t len);
+
+// Text representation of values sent in queries
+#define NUMBER_TEXT_SIZE 32
+uint32_t escapedLength(const char *text, uint32_t len);
+uint32_t escapeString(char *dest, const char *text, uint32_t len);
+int formatUInt(char *buff, uint64_t value);
+int formatInt(char *buff, int64_t value);
+int formatDouble(char *buff, double value);
+int formatFloat(char *buff, float value);
 
-int readLenEncString(char* pString, const uint8_t * packet, int offset);
+int readLenEncString(char* pString, const uint8_t * packet, int offset, uint8_t *size = nullptr);
 
 #endif
\ No newline at end of file